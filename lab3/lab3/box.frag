@@ -10,14 +10,129 @@ uniform vec3 lightPosition;
 uniform vec3 lightIntensity;
 uniform float reflectance = 0.78;
 
+// Shadow map rendered with lightSpaceMatrix
 uniform sampler2D depthMap;
-in vec2 TexCoords;
+uniform mat4 lightSpaceMatrix;
+
+// The same map through a comparison sampler, and its variance map, see
+// ShadowFilter. depthRange holds the near and far planes of the light.
+uniform sampler2DShadow shadowDepthMap;
+uniform sampler2D momentsMap;
+uniform vec2 depthRange;
+
+// How the spot map is filtered
+const int SHADOW_FILTER_NEAREST = 0;
+const int SHADOW_FILTER_PCF = 1;
+const int SHADOW_FILTER_VARIANCE = 2;
+uniform int shadowFilter;
+uniform int pcfRadius = 1;			// (2 * pcfRadius + 1)^2 fetches
+
+// Above this lit fraction the variance bound is rescaled to 0..1, which
+// trims the light leaking through overlapping casters
+const float lightBleedReduction = 0.2;
+const float minVariance = 1e-5;
+
+// Shadow maps all around the light, see PointShadowMap. Their depths are
+// distances to the light over pointFarPlane.
+uniform samplerCube pointDepthMap;
+uniform sampler2DArray paraboloidDepthMap;
+uniform mat4 paraboloidViews[2];
+uniform float pointFarPlane;
+
+// Which map to look up
+const int SHADOW_LOOKUP_SPOT = 0;
+const int SHADOW_LOOKUP_CUBE = 1;
+const int SHADOW_LOOKUP_PARABOLOID = 2;
+uniform int shadowLookup;
+
+// 1 if the light reaches the fragment, 0 if something closer to the light
+// covers it. Outside the shadow map the fragment counts as lit.
+float spotShadowFactor()
+{
+	vec4 lightSpacePosition = lightSpaceMatrix * vec4(worldPosition, 1.0);
+	vec3 projected = lightSpacePosition.xyz / lightSpacePosition.w * 0.5 + 0.5;
+
+	// Taken before the branches below, where derivatives are undefined,
+	// to pick the variance map's mip level
+	vec2 dx = dFdx(projected.xy);
+	vec2 dy = dFdy(projected.xy);
+
+	if (lightSpacePosition.w <= 0.0) {
+		return 1.0;
+	}
+	if (any(lessThan(projected, vec3(0.0))) || any(greaterThan(projected, vec3(1.0)))) {
+		return 1.0;
+	}
+
+	if (shadowFilter == SHADOW_FILTER_PCF) {
+		// Each fetch is four comparisons, filtered bilinearly
+		vec2 texelSize = 1.0 / vec2(textureSize(shadowDepthMap, 0));
+		float lit = 0.0;
+		for (int y = -pcfRadius; y <= pcfRadius; ++y) {
+			for (int x = -pcfRadius; x <= pcfRadius; ++x) {
+				lit += texture(shadowDepthMap, vec3(projected.xy + vec2(x, y) * texelSize, projected.z));
+			}
+		}
+		float taps = float(2 * pcfRadius + 1);
+		return lit / (taps * taps);
+	} else if (shadowFilter == SHADOW_FILTER_VARIANCE) {
+		// The clip space w of a perspective projection is the view depth
+		float depth = (lightSpacePosition.w - depthRange.x) / (depthRange.y - depthRange.x);
+		vec2 moments = textureGrad(momentsMap, projected.xy, dx, dy).rg;
+		if (depth <= moments.x) {
+			return 1.0;
+		}
+		float variance = max(moments.y - moments.x * moments.x, minVariance);
+		float d = depth - moments.x;
+		float upperBound = variance / (variance + d * d);
+		return clamp((upperBound - lightBleedReduction) / (1.0 - lightBleedReduction), 0.0, 1.0);
+	}
+
+	float closestDepth = texture(depthMap, projected.xy).r;
+	return projected.z > closestDepth ? 0.0 : 1.0;
+}
+
+// The point maps store distances written by the fragment shader, which
+// polygon offset does not reach, so the bias is applied here. Texels grow
+// with the distance and the surface slope, and so does the bias.
+float pointShadowFactor(float closestDistance, float distance, float cosTheta)
+{
+	float bias = distance * mix(0.012, 0.004, cosTheta);
+	return distance - bias > closestDistance ? 0.0 : 1.0;
+}
+
+float cubeShadowFactor(vec3 toFragment, float cosTheta)
+{
+	float closestDistance = texture(pointDepthMap, toFragment).r * pointFarPlane;
+	return pointShadowFactor(closestDistance, length(toFragment), cosTheta);
+}
+
+// Layer 0 looks down -Y, layer 1 up +Y
+float paraboloidShadowFactor(vec3 toFragment, float cosTheta)
+{
+	int layer = toFragment.y < 0.0 ? 0 : 1;
+	vec3 n = normalize(mat3(paraboloidViews[layer]) * toFragment);
+	vec2 uv = n.xy / (1.0 - n.z) * 0.5 + 0.5;
+	float closestDistance = texture(paraboloidDepthMap, vec3(uv, layer)).r * pointFarPlane;
+	return pointShadowFactor(closestDistance, length(toFragment), cosTheta);
+}
+
+float shadowFactor(float cosTheta)
+{
+	vec3 toFragment = worldPosition - lightPosition;
+	if (shadowLookup == SHADOW_LOOKUP_CUBE) {
+		return cubeShadowFactor(toFragment, cosTheta);
+	} else if (shadowLookup == SHADOW_LOOKUP_PARABOLOID) {
+		return paraboloidShadowFactor(toFragment, cosTheta);
+	}
+	return spotShadowFactor();
+}
 
 void main()
 {
 	vec3 lightDir = normalize(lightPosition-worldPosition);
 
-	float cosTheta = dot(lightDir,worldNormal);
+	float cosTheta = max(dot(lightDir,worldNormal), 0.0);
 
 	 // Calculate the distance squared (r^2) between the light source and the fragment
     float distanceSquared = length(lightPosition - worldPosition) * length(lightPosition - worldPosition);
@@ -26,16 +141,11 @@ void main()
     vec3 irradiance = (reflectance / 3.14159) * cosTheta * (lightIntensity / (4.0 * 3.14159 * distanceSquared));
 
 
-	finalColor = color* irradiance;
+	finalColor = color* irradiance * shadowFactor(cosTheta);
 
 	// TODO: lighting, tone mapping, gamma correction
 	finalColor = finalColor / (1.0 + finalColor);
 
     // Apply gamma correction for better display on screen
     finalColor = pow(finalColor, vec3(1.0/ 2.2));
-
-	float depthValue = texture(depthMap, TexCoords).r;
-	// finalColor /= vec3(depthValue);
-
-	finalColor *= depthValue * depthValue;
 }
@@ -7,9 +7,15 @@
 #include <stb/stb_image_write.h>
 
 #include <render/shader.h>
+#include <render/shadow_cache.h>
+#include <render/point_shadow.h>
+#include <render/shadow_filter.h>
 
 #include <vector>
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include <iomanip>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
@@ -40,10 +46,44 @@ static glm::vec3 lightUp(0, 0, 1);
 static int shadowMapWidth = 0;
 static int shadowMapHeight = 0;
 
-// TODO: set these parameters
+// The light looks down from the ceiling; the box is about 560 units deep
 static float depthFoV = 90.f;
-static float depthNear = 0.1f;
-static float depthFar = 10000.0f;
+static float depthNear = 10.0f;
+static float depthFar = 1000.0f;
+
+// View-projection the shadow map was rendered with
+static glm::mat4 lightSpaceMatrix;
+
+// The spot map only covers what is below the light. The point light
+// shines every way, and the cube map or the two paraboloids cover all of
+// it. M cycles through the modes, B times the point light ones.
+enum ShadowMode {
+	SHADOW_SPOT,
+	SHADOW_CUBE,
+	SHADOW_CUBE_SIX_PASSES,
+	SHADOW_PARABOLOID,
+	SHADOW_MODE_COUNT,
+};
+static const char *shadowModeNames[SHADOW_MODE_COUNT] = {
+	"spot", "cube map, one pass", "cube map, six passes", "dual paraboloid",
+};
+static int shadowMode = SHADOW_CUBE;
+static bool benchmarkShadows = false;
+static int pointShadowMapSize = 512;
+
+// Map looked up by box.frag, SHADOW_LOOKUP_* there, and the paraboloid
+// views to look it up with
+static int shadowLookup = 1;
+static glm::mat4 paraboloidViews[2];
+
+// Filtering of the spot map. F cycles through the modes, K through PCF
+// kernels of 1 to 7 texels across.
+static const char *shadowFilterNames[SHADOW_FILTER_MODE_COUNT] = {
+	"nearest", "PCF", "variance",
+};
+static int shadowFilterMode = SHADOW_FILTER_PCF;
+static int pcfRadius = 1;
+static int vsmBlurRadius = 3;
 
 // Helper flag and function to save depth maps for debugging
 static bool saveDepth = false;
@@ -192,6 +232,7 @@ struct CornellBox {
 
 	// OpenGL buffers
 	GLuint vertexArrayID;
+	GLuint depthArrayID;			// Positions only, for depth passes
 	GLuint vertexBufferID;
 	GLuint indexBufferID;
 	GLuint colorBufferID;
@@ -201,6 +242,13 @@ struct CornellBox {
 	GLuint mvpMatrixID;
 	GLuint lightPositionID;
 	GLuint lightIntensityID;
+	GLuint lightSpaceMatrixID;
+	GLuint shadowLookupID;
+	GLuint paraboloidViewsID;
+	GLuint pointFarPlaneID;
+	GLuint shadowFilterID;
+	GLuint pcfRadiusID;
+	GLuint depthRangeID;
 	GLuint programID;
 
 	void initialize() {
@@ -228,6 +276,16 @@ struct CornellBox {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
+		// A second vertex array with the same positions and indices and
+		// nothing else, so depth passes fetch only what they use
+		glGenVertexArrays(1, &depthArrayID);
+		glBindVertexArray(depthArrayID);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		glBindVertexArray(0);
+
 		// Create and compile our GLSL program from the shaders
 		programID = LoadShadersFromFile("../lab3/box.vert", "../lab3/box.frag");
 		if (programID == 0)
@@ -239,10 +297,28 @@ struct CornellBox {
 		mvpMatrixID = glGetUniformLocation(programID, "MVP");
 		lightPositionID = glGetUniformLocation(programID, "lightPosition");
 		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+		lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+		shadowLookupID = glGetUniformLocation(programID, "shadowLookup");
+		paraboloidViewsID = glGetUniformLocation(programID, "paraboloidViews");
+		pointFarPlaneID = glGetUniformLocation(programID, "pointFarPlane");
+		shadowFilterID = glGetUniformLocation(programID, "shadowFilter");
+		pcfRadiusID = glGetUniformLocation(programID, "pcfRadius");
+		depthRangeID = glGetUniformLocation(programID, "depthRange");
+
+		// The spot map is on unit 0, the cube map on 1, the paraboloids on
+		// 2, the spot map through the comparison sampler on 3 and its
+		// variance map on 4
+		glUseProgram(programID);
+		glUniform1i(glGetUniformLocation(programID, "depthMap"), 0);
+		glUniform1i(glGetUniformLocation(programID, "pointDepthMap"), 1);
+		glUniform1i(glGetUniformLocation(programID, "paraboloidDepthMap"), 2);
+		glUniform1i(glGetUniformLocation(programID, "shadowDepthMap"), 3);
+		glUniform1i(glGetUniformLocation(programID, "momentsMap"), 4);
 	}
 
 	void render(glm::mat4 cameraMatrix) {
 		glUseProgram(programID);
+		glBindVertexArray(vertexArrayID);
 
 		glEnableVertexAttribArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
@@ -266,6 +342,15 @@ struct CornellBox {
 		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
 		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
+		// Shadow map lookup
+		glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+		glUniform1i(shadowLookupID, shadowLookup);
+		glUniformMatrix4fv(paraboloidViewsID, 2, GL_FALSE, &paraboloidViews[0][0][0]);
+		glUniform1f(pointFarPlaneID, depthFar);
+		glUniform1i(shadowFilterID, shadowFilterMode);
+		glUniform1i(pcfRadiusID, pcfRadius);
+		glUniform2f(depthRangeID, depthNear, depthFar);
+
 		// Draw the box
 		glDrawElements(
 			GL_TRIANGLES,      // mode
@@ -279,12 +364,20 @@ struct CornellBox {
 		glDisableVertexAttribArray(2);
 	}
 
+	// Draw into the depth pass in progress, see DepthPass::begin
+	void renderDepth() {
+		glBindVertexArray(depthArrayID);
+		glDrawElements(GL_TRIANGLES, 30, GL_UNSIGNED_INT, (void*)0);
+		glBindVertexArray(0);
+	}
+
 	void cleanup() {
 		glDeleteBuffers(1, &vertexBufferID);
 		glDeleteBuffers(1, &colorBufferID);
 		glDeleteBuffers(1, &indexBufferID);
 		glDeleteBuffers(1, &normalBufferID);
 		glDeleteVertexArrays(1, &vertexArrayID);
+		glDeleteVertexArrays(1, &depthArrayID);
 		glDeleteProgram(programID);
 	}
 };
@@ -400,6 +493,7 @@ struct ShortBox {
 
 	// OpenGL buffers
 	GLuint vertexArrayID;
+	GLuint depthArrayID;			// Positions only, for depth passes
 	GLuint vertexBufferID;
 	GLuint indexBufferID;
 	GLuint colorBufferID;
@@ -409,6 +503,13 @@ struct ShortBox {
 	GLuint mvpMatrixID;
 	GLuint lightPositionID;
 	GLuint lightIntensityID;
+	GLuint lightSpaceMatrixID;
+	GLuint shadowLookupID;
+	GLuint paraboloidViewsID;
+	GLuint pointFarPlaneID;
+	GLuint shadowFilterID;
+	GLuint pcfRadiusID;
+	GLuint depthRangeID;
 	GLuint programID;
 
 	void initialize() {
@@ -436,6 +537,16 @@ struct ShortBox {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
+		// A second vertex array with the same positions and indices and
+		// nothing else, so depth passes fetch only what they use
+		glGenVertexArrays(1, &depthArrayID);
+		glBindVertexArray(depthArrayID);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		glBindVertexArray(0);
+
 		// Create and compile our GLSL program from the shaders
 		programID = LoadShadersFromFile("../lab3/box.vert", "../lab3/box.frag");
 		if (programID == 0)
@@ -447,10 +558,28 @@ struct ShortBox {
 		mvpMatrixID = glGetUniformLocation(programID, "MVP");
 		lightPositionID = glGetUniformLocation(programID, "lightPosition");
 		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+		lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+		shadowLookupID = glGetUniformLocation(programID, "shadowLookup");
+		paraboloidViewsID = glGetUniformLocation(programID, "paraboloidViews");
+		pointFarPlaneID = glGetUniformLocation(programID, "pointFarPlane");
+		shadowFilterID = glGetUniformLocation(programID, "shadowFilter");
+		pcfRadiusID = glGetUniformLocation(programID, "pcfRadius");
+		depthRangeID = glGetUniformLocation(programID, "depthRange");
+
+		// The spot map is on unit 0, the cube map on 1, the paraboloids on
+		// 2, the spot map through the comparison sampler on 3 and its
+		// variance map on 4
+		glUseProgram(programID);
+		glUniform1i(glGetUniformLocation(programID, "depthMap"), 0);
+		glUniform1i(glGetUniformLocation(programID, "pointDepthMap"), 1);
+		glUniform1i(glGetUniformLocation(programID, "paraboloidDepthMap"), 2);
+		glUniform1i(glGetUniformLocation(programID, "shadowDepthMap"), 3);
+		glUniform1i(glGetUniformLocation(programID, "momentsMap"), 4);
 	}
 
 	void render(glm::mat4 cameraMatrix) {
 		glUseProgram(programID);
+		glBindVertexArray(vertexArrayID);
 
 		glEnableVertexAttribArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
@@ -474,6 +603,15 @@ struct ShortBox {
 		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
 		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
+		// Shadow map lookup
+		glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+		glUniform1i(shadowLookupID, shadowLookup);
+		glUniformMatrix4fv(paraboloidViewsID, 2, GL_FALSE, &paraboloidViews[0][0][0]);
+		glUniform1f(pointFarPlaneID, depthFar);
+		glUniform1i(shadowFilterID, shadowFilterMode);
+		glUniform1i(pcfRadiusID, pcfRadius);
+		glUniform2f(depthRangeID, depthNear, depthFar);
+
 		// Draw the box
 		glDrawElements(
 			GL_TRIANGLES,      // mode
@@ -487,12 +625,20 @@ struct ShortBox {
 		glDisableVertexAttribArray(2);
 	}
 
+	// Draw into the depth pass in progress, see DepthPass::begin
+	void renderDepth() {
+		glBindVertexArray(depthArrayID);
+		glDrawElements(GL_TRIANGLES, 30, GL_UNSIGNED_INT, (void*)0);
+		glBindVertexArray(0);
+	}
+
 	void cleanup() {
 		glDeleteBuffers(1, &vertexBufferID);
 		glDeleteBuffers(1, &colorBufferID);
 		glDeleteBuffers(1, &indexBufferID);
 		glDeleteBuffers(1, &normalBufferID);
 		glDeleteVertexArrays(1, &vertexArrayID);
+		glDeleteVertexArrays(1, &depthArrayID);
 		glDeleteProgram(programID);
 	}
 };
@@ -609,6 +755,7 @@ struct TallBox {
 
 	// OpenGL buffers
 	GLuint vertexArrayID;
+	GLuint depthArrayID;			// Positions only, for depth passes
 	GLuint vertexBufferID;
 	GLuint indexBufferID;
 	GLuint colorBufferID;
@@ -618,6 +765,13 @@ struct TallBox {
 	GLuint mvpMatrixID;
 	GLuint lightPositionID;
 	GLuint lightIntensityID;
+	GLuint lightSpaceMatrixID;
+	GLuint shadowLookupID;
+	GLuint paraboloidViewsID;
+	GLuint pointFarPlaneID;
+	GLuint shadowFilterID;
+	GLuint pcfRadiusID;
+	GLuint depthRangeID;
 	GLuint programID;
 
 	void initialize() {
@@ -645,6 +799,16 @@ struct TallBox {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
+		// A second vertex array with the same positions and indices and
+		// nothing else, so depth passes fetch only what they use
+		glGenVertexArrays(1, &depthArrayID);
+		glBindVertexArray(depthArrayID);
+		glEnableVertexAttribArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+		glBindVertexArray(0);
+
 		// Create and compile our GLSL program from the shaders
 		programID = LoadShadersFromFile("../lab3/box.vert", "../lab3/box.frag");
 		if (programID == 0)
@@ -656,10 +820,28 @@ struct TallBox {
 		mvpMatrixID = glGetUniformLocation(programID, "MVP");
 		lightPositionID = glGetUniformLocation(programID, "lightPosition");
 		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+		lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+		shadowLookupID = glGetUniformLocation(programID, "shadowLookup");
+		paraboloidViewsID = glGetUniformLocation(programID, "paraboloidViews");
+		pointFarPlaneID = glGetUniformLocation(programID, "pointFarPlane");
+		shadowFilterID = glGetUniformLocation(programID, "shadowFilter");
+		pcfRadiusID = glGetUniformLocation(programID, "pcfRadius");
+		depthRangeID = glGetUniformLocation(programID, "depthRange");
+
+		// The spot map is on unit 0, the cube map on 1, the paraboloids on
+		// 2, the spot map through the comparison sampler on 3 and its
+		// variance map on 4
+		glUseProgram(programID);
+		glUniform1i(glGetUniformLocation(programID, "depthMap"), 0);
+		glUniform1i(glGetUniformLocation(programID, "pointDepthMap"), 1);
+		glUniform1i(glGetUniformLocation(programID, "paraboloidDepthMap"), 2);
+		glUniform1i(glGetUniformLocation(programID, "shadowDepthMap"), 3);
+		glUniform1i(glGetUniformLocation(programID, "momentsMap"), 4);
 	}
 
 	void render(glm::mat4 cameraMatrix) {
 		glUseProgram(programID);
+		glBindVertexArray(vertexArrayID);
 
 		glEnableVertexAttribArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
@@ -683,6 +865,15 @@ struct TallBox {
 		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
 		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
+		// Shadow map lookup
+		glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+		glUniform1i(shadowLookupID, shadowLookup);
+		glUniformMatrix4fv(paraboloidViewsID, 2, GL_FALSE, &paraboloidViews[0][0][0]);
+		glUniform1f(pointFarPlaneID, depthFar);
+		glUniform1i(shadowFilterID, shadowFilterMode);
+		glUniform1i(pcfRadiusID, pcfRadius);
+		glUniform2f(depthRangeID, depthNear, depthFar);
+
 		// Draw the box
 		glDrawElements(
 			GL_TRIANGLES,      // mode
@@ -696,16 +887,98 @@ struct TallBox {
 		glDisableVertexAttribArray(2);
 	}
 
+	// Draw into the depth pass in progress, see DepthPass::begin
+	void renderDepth() {
+		glBindVertexArray(depthArrayID);
+		glDrawElements(GL_TRIANGLES, 30, GL_UNSIGNED_INT, (void*)0);
+		glBindVertexArray(0);
+	}
+
 	void cleanup() {
 		glDeleteBuffers(1, &vertexBufferID);
 		glDeleteBuffers(1, &colorBufferID);
 		glDeleteBuffers(1, &indexBufferID);
 		glDeleteBuffers(1, &normalBufferID);
 		glDeleteVertexArrays(1, &vertexArrayID);
+		glDeleteVertexArrays(1, &depthArrayID);
 		glDeleteProgram(programID);
 	}
 };
 
+// Run draw repeatedly and return the mean GPU time per run from a timer
+// query, in milliseconds, and the CPU time spent issuing it in cpuMs
+static double timeRenders(const std::function<void()> &draw, int iterations, double &cpuMs)
+{
+	GLuint query;
+	glGenQueries(1, &query);
+	GLuint64 gpuNs = 0;
+	cpuMs = 0.0;
+	glFinish();
+	for (int i = 0; i < iterations; ++i) {
+		auto start = std::chrono::high_resolution_clock::now();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		draw();
+		glEndQuery(GL_TIME_ELAPSED);
+		cpuMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		gpuNs += elapsed;
+	}
+	glDeleteQueries(1, &query);
+	cpuMs /= iterations;
+	return gpuNs / 1e6 / iterations;
+}
+
+// Render each point light mode repeatedly and print the GPU and CPU time
+// per render
+static void benchmarkPointShadows(PointShadowMap &pointShadow, int iterations)
+{
+	const PointShadowMode modes[3] = { POINT_SHADOW_CUBE, POINT_SHADOW_CUBE_SIX_PASSES, POINT_SHADOW_PARABOLOID };
+	const int shadowModes[3] = { SHADOW_CUBE, SHADOW_CUBE_SIX_PASSES, SHADOW_PARABOLOID };
+
+	std::cout << std::fixed << std::setprecision(3);
+	for (int m = 0; m < 3; ++m) {
+		double cpuMs;
+		double gpuMs = timeRenders([&]() { pointShadow.render(lightPosition, modes[m]); }, iterations, cpuMs);
+		std::cout << std::setw(22) << shadowModeNames[shadowModes[m]] << ": "
+			<< gpuMs << " ms GPU, " << cpuMs << " ms CPU, "
+			<< pointShadow.drawCalls << " draw calls" << std::endl;
+	}
+
+	// Whatever mode the scene uses is rendered again next frame
+	pointShadow.valid = false;
+}
+
+// Render the scene with the spot map under each filter and print the time
+// per frame, and the time to build the variance map it needs
+static void benchmarkShadowFilters(ShadowCache &shadowCache, ShadowFilter &shadowFilter,
+	const std::function<void()> &renderScene, int iterations)
+{
+	int savedLookup = shadowLookup;
+	int savedFilter = shadowFilterMode;
+	shadowLookup = 0;
+	shadowCache.update(lightSpaceMatrix);
+
+	double cpuMs;
+	double gpuMs = timeRenders([&]() { shadowFilter.renderMoments(shadowCache.depthTexture()); }, iterations, cpuMs);
+	std::cout << std::setw(22) << "variance map" << ": " << gpuMs << " ms GPU, "
+		<< 2 * (2 * shadowFilter.blurRadius + 1) << " fetches per texel" << std::endl;
+
+	for (int f = 0; f < SHADOW_FILTER_MODE_COUNT; ++f) {
+		shadowFilterMode = f;
+		int fetches = f == SHADOW_FILTER_PCF ? (2 * pcfRadius + 1) * (2 * pcfRadius + 1) : 1;
+		gpuMs = timeRenders([&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			renderScene();
+		}, iterations, cpuMs);
+		std::cout << std::setw(22) << shadowFilterNames[f] << ": " << gpuMs << " ms GPU per frame, "
+			<< fetches << " fetches per fragment" << std::endl;
+	}
+
+	shadowLookup = savedLookup;
+	shadowFilterMode = savedFilter;
+}
 
 int main(void)
 {
@@ -764,74 +1037,95 @@ int main(void)
 	TallBox tb;
 	tb.initialize();
 
-	// Initialize a depth buffer object
-	GLuint depthMapFrameBufferObject;
-	glGenFramebuffers(1, &depthMapFrameBufferObject);
-
-	// Create a texture which will store the depth information
-	GLuint depthMapTexture;
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D,depthMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,shadowMapWidth,shadowMapHeight,0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// Attach the depth buffer with the texture
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFrameBufferObject);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture,0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	// Light view setup
-	glm::mat4 lightViewMatrix, lightProjectionMatrix;
-	lightProjectionMatrix = glm::perspective(glm::radians(depthFoV),(float)shadowMapWidth/shadowMapHeight,depthNear,depthFar);
-	lightViewMatrix = glm::lookAt(eye_center,lookat,lightUp);
-	glm::mat4 lightVp = lightProjectionMatrix * lightViewMatrix;
-
-	// First render according to the light's perspective
+	// Shadow map of the same size as the window. None of the boxes move, so
+	// they are all static casters and the map is only redrawn when the
+	// light moves.
+	ShadowCache shadowCache;
+	if (!shadowCache.initialize(shadowMapWidth, shadowMapHeight)) {
+		return -1;
+	}
+	shadowCache.addCaster([&b]() { b.renderDepth(); }, true);
+	shadowCache.addCaster([&sb]() { sb.renderDepth(); }, true);
+	shadowCache.addCaster([&tb]() { tb.renderDepth(); }, true);
 
-	// configure some matrices and shader functions
-	GLuint programID = LoadShadersFromFile("../lab3/shadow.vert","../lab3/shadow.frag");
-	if(programID==0){
-		std::cerr << "Failed to load shaders" << std::endl;
-		return 1;
+	// The point light maps, with the same casters and range
+	PointShadowMap pointShadow;
+	if (!pointShadow.initialize(pointShadowMapSize, depthNear, depthFar)) {
+		return -1;
 	}
-	GLuint lightMatrixID = glGetUniformLocation(programID,"lightSpaceMatrix");
-	glUniformMatrix4fv(lightMatrixID, 1, GL_FALSE, &lightVp[0][0]);
-	glViewport(0,0, shadowMapWidth, shadowMapHeight);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFrameBufferObject);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	pointShadow.addCaster([&b]() { b.renderDepth(); });
+	pointShadow.addCaster([&sb]() { sb.renderDepth(); });
+	pointShadow.addCaster([&tb]() { tb.renderDepth(); });
 
-	// Render the scene from light's perspective
-	b.render(lightVp);
-	sb.render(lightVp);
-	tb.render(lightVp);
+	// Filtering for the spot map
+	ShadowFilter shadowFilter;
+	if (!shadowFilter.initialize(shadowMapWidth, shadowMapHeight, depthNear, depthFar, vsmBlurRadius)) {
+		return -1;
+	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glm::mat4 lightProjectionMatrix;
+	lightProjectionMatrix = glm::perspective(glm::radians(depthFoV),(float)shadowMapWidth/shadowMapHeight,depthNear,depthFar);
 
 	// Camera setup
-    glm::mat4 viewMatrix, projectionMatrix;
+    glm::mat4 viewMatrix, projectionMatrix, vp;
 	projectionMatrix = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
 
-	// now render the scene normally
-	glViewport(0,0, shadowMapWidth,shadowMapHeight);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	// configure shader matrices
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
+	auto renderScene = [&]() {
+		b.render(vp);
+		sb.render(vp);
+		tb.render(vp);
+	};
+
+	// Render the scene normally, looking the shadow maps up on units 0 to 4
+	glViewport(0, 0, shadowMapWidth, shadowMapHeight);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, shadowCache.depthTexture());
+	glBindSampler(3, shadowFilter.compareSamplerID);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, shadowFilter.momentsTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, pointShadow.depthTexture(POINT_SHADOW_CUBE));
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, pointShadow.depthTexture(POINT_SHADOW_PARABOLOID));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, shadowCache.depthTexture());
 
 	do
 	{
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 		viewMatrix = glm::lookAt(eye_center, lookat, up);
-		glm::mat4 vp = projectionMatrix * viewMatrix;
+		vp = projectionMatrix * viewMatrix;
 
-		b.render(vp);
-		sb.render(vp);
-		tb.render(vp);
+		// Light view setup, looking down at the floor from the light
+		glm::mat4 lightViewMatrix = glm::lookAt(lightPosition, lightPosition - glm::vec3(0.0f, 1.0f, 0.0f), lightUp);
+		lightSpaceMatrix = lightProjectionMatrix * lightViewMatrix;
+
+		if (benchmarkShadows) {
+			benchmarkPointShadows(pointShadow, 100);
+			benchmarkShadowFilters(shadowCache, shadowFilter, renderScene, 100);
+			benchmarkShadows = false;
+		}
+
+		// Only the map in use is kept up to date, and each is redrawn only
+		// if the light or a caster changed
+		if (shadowMode == SHADOW_SPOT) {
+			if (shadowCache.update(lightSpaceMatrix)) {
+				shadowFilter.invalidate();
+			}
+			if (shadowFilterMode == SHADOW_FILTER_VARIANCE) {
+				shadowFilter.update(shadowCache.depthTexture());
+			}
+			shadowLookup = 0;
+		} else {
+			PointShadowMode pointMode = shadowMode == SHADOW_CUBE ? POINT_SHADOW_CUBE
+				: shadowMode == SHADOW_CUBE_SIX_PASSES ? POINT_SHADOW_CUBE_SIX_PASSES : POINT_SHADOW_PARABOLOID;
+			pointShadow.update(lightPosition, pointMode);
+			paraboloidViews[0] = pointShadow.paraboloidViews[0];
+			paraboloidViews[1] = pointShadow.paraboloidViews[1];
+			shadowLookup = pointMode == POINT_SHADOW_PARABOLOID ? 2 : 1;
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderScene();
 
 		if (saveDepth) {
             std::string filename = "depth_camera.png";
@@ -852,11 +1146,9 @@ int main(void)
 	sb.cleanup();
 	tb.cleanup();
 
-	// Delete the remaining shadow buffers
-	glDeleteBuffers(1,&depthMapFrameBufferObject);
-	glDeleteTextures(1, &depthMapTexture);
-	glDeleteProgram(programID);
-	glDeleteBuffers(1, &lightMatrixID);
+	shadowCache.cleanup();
+	pointShadow.cleanup();
+	shadowFilter.cleanup();
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -918,6 +1210,29 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
         saveDepth = true;
     }
 
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+	{
+		shadowMode = (shadowMode + 1) % SHADOW_MODE_COUNT;
+		std::cout << "Shadows: " << shadowModeNames[shadowMode] << std::endl;
+	}
+
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		benchmarkShadows = true;
+	}
+
+	if (key == GLFW_KEY_F && action == GLFW_PRESS)
+	{
+		shadowFilterMode = (shadowFilterMode + 1) % SHADOW_FILTER_MODE_COUNT;
+		std::cout << "Spot map filter: " << shadowFilterNames[shadowFilterMode] << std::endl;
+	}
+
+	if (key == GLFW_KEY_K && action == GLFW_PRESS)
+	{
+		pcfRadius = (pcfRadius + 1) % 4;
+		std::cout << "PCF kernel: " << 2 * pcfRadius + 1 << "x" << 2 * pcfRadius + 1 << std::endl;
+	}
+
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 }
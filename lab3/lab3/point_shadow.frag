@@ -0,0 +1,12 @@
+#version 330 core
+
+// Depth is the distance to the light over the far plane, the same in every
+// cube face and paraboloid, so the lookup compares distances directly
+in vec3 worldPosition;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main() {
+    gl_FragDepth = length(worldPosition - lightPosition) / farPlane;
+}
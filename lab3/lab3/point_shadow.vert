@@ -0,0 +1,11 @@
+#version 330 core
+
+// Positions only, already in world space. The geometry shader projects
+// them once per cube face or paraboloid.
+layout(location = 0) in vec3 vertexPosition;
+
+out vec3 position;
+
+void main() {
+    position = vertexPosition;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// One cube face per draw, for comparison with the single pass
+layout(location = 0) in vec3 vertexPosition;
+
+out vec3 worldPosition;
+
+uniform mat4 faceMatrix;
+
+void main() {
+    worldPosition = vertexPosition;
+    gl_Position = faceMatrix * vec4(vertexPosition, 1.0);
+}
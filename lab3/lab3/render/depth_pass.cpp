@@ -0,0 +1,73 @@
+#include "depth_pass.h"
+#include "shader.h"
+
+#include <iostream>
+
+bool DepthPass::initialize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	// Create a texture which will store the depth information
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Attach it as the only buffer of a frame buffer
+	glGenFramebuffers(1, &frameBufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Depth frame buffer is incomplete." << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	programID = LoadShadersFromFile("../lab3/shadow.vert", "../lab3/shadow.frag");
+	if (programID == 0) {
+		std::cerr << "Failed to load shaders." << std::endl;
+		return false;
+	}
+	lightSpaceMatrixID = glGetUniformLocation(programID, "lightSpaceMatrix");
+	return true;
+}
+
+void DepthPass::begin(const glm::mat4 &lightSpaceMatrix, bool clear)
+{
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID);
+	glViewport(0, 0, width, height);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	if (clear) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	// Push the stored depths back by the surface slope, so lit surfaces do
+	// not shadow themselves
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(1.1f, 4.0f);
+
+	// The uniform goes to the program in use, so bind it first
+	glUseProgram(programID);
+	glUniformMatrix4fv(lightSpaceMatrixID, 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+}
+
+void DepthPass::end()
+{
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void DepthPass::cleanup()
+{
+	glDeleteFramebuffers(1, &frameBufferID);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteProgram(programID);
+}
@@ -0,0 +1,38 @@
+#ifndef _DEPTH_PASS_H_
+#define _DEPTH_PASS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// Renders scene objects into a depth texture, e.g. a shadow map from the
+// light's point of view. Objects draw with their position-only vertex
+// arrays, the fragment shader is empty and colour writes are off, so each
+// vertex is one matrix multiply and each fragment a depth write.
+struct DepthPass {
+	int width;
+	int height;
+	GLuint frameBufferID;
+	GLuint depthTexture;
+	GLint savedViewport[4];			// Restored by end()
+
+	// Shader variable IDs
+	GLuint lightSpaceMatrixID;
+	GLuint programID;
+
+	// Create the depth texture, its frame buffer and the depth-only program.
+	// Returns false if the program fails to load.
+	bool initialize(int width, int height);
+
+	// Bind the depth texture, clear it unless told otherwise, and set up the
+	// depth-only program with the given view-projection. Scene objects then
+	// draw their depth.
+	void begin(const glm::mat4 &lightSpaceMatrix, bool clear = true);
+
+	// Back to the default frame buffer and the viewport before begin(),
+	// with colour writes on again
+	void end();
+
+	void cleanup();
+};
+
+#endif
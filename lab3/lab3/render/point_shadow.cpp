@@ -0,0 +1,195 @@
+#include "point_shadow.h"
+#include "shader.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+static bool checkFrameBuffer(const char *name)
+{
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << name << " frame buffer is incomplete." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Nearest texel, clamped: the lookup compares raw distances
+static void setDepthParameters(GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+bool PointShadowMap::initialize(int size, float nearPlane, float farPlane)
+{
+	this->size = size;
+	this->nearPlane = nearPlane;
+	this->farPlane = farPlane;
+	valid = false;
+	drawCalls = 0;
+
+	// Cube map of depths, one face per layer
+	glGenTextures(1, &cubeTexture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+	for (int face = 0; face < 6; ++face) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	}
+	setDepthParameters(GL_TEXTURE_CUBE_MAP);
+
+	// Attaching the whole cube makes the frame buffer layered, so gl_Layer
+	// picks the face
+	glGenFramebuffers(1, &cubeFrameBufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, cubeFrameBufferID);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cubeTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	checkFrameBuffer("Cube map");
+
+	// The faces are attached one by one when rendering them separately
+	glGenFramebuffers(1, &faceFrameBufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, faceFrameBufferID);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, cubeTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	checkFrameBuffer("Cube face");
+
+	// The two paraboloids, layered the same way
+	glGenTextures(1, &paraboloidTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, paraboloidTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, size, size, 2, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	setDepthParameters(GL_TEXTURE_2D_ARRAY);
+
+	glGenFramebuffers(1, &paraboloidFrameBufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, paraboloidFrameBufferID);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, paraboloidTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	checkFrameBuffer("Paraboloid");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	cubeProgramID = LoadShadersFromFile("../lab3/point_shadow.vert", "../lab3/point_shadow.geom", "../lab3/point_shadow.frag");
+	faceProgramID = LoadShadersFromFile("../lab3/point_shadow_face.vert", "../lab3/point_shadow.frag");
+	paraboloidProgramID = LoadShadersFromFile("../lab3/point_shadow.vert", "../lab3/paraboloid.geom", "../lab3/point_shadow.frag");
+	if (cubeProgramID == 0 || faceProgramID == 0 || paraboloidProgramID == 0) {
+		std::cerr << "Failed to load shaders." << std::endl;
+		return false;
+	}
+
+	cubeFaceMatricesID = glGetUniformLocation(cubeProgramID, "faceMatrices");
+	cubeLightPositionID = glGetUniformLocation(cubeProgramID, "lightPosition");
+	cubeFarPlaneID = glGetUniformLocation(cubeProgramID, "farPlane");
+	faceMatrixID = glGetUniformLocation(faceProgramID, "faceMatrix");
+	faceLightPositionID = glGetUniformLocation(faceProgramID, "lightPosition");
+	faceFarPlaneID = glGetUniformLocation(faceProgramID, "farPlane");
+	paraboloidViewsID = glGetUniformLocation(paraboloidProgramID, "paraboloidViews");
+	paraboloidLightPositionID = glGetUniformLocation(paraboloidProgramID, "lightPosition");
+	paraboloidFarPlaneID = glGetUniformLocation(paraboloidProgramID, "farPlane");
+	return true;
+}
+
+void PointShadowMap::addCaster(const std::function<void()> &renderDepth)
+{
+	casters.push_back(renderDepth);
+	valid = false;
+}
+
+bool PointShadowMap::update(const glm::vec3 &lightPosition, PointShadowMode mode)
+{
+	if (valid && lightPosition == this->lightPosition && mode == this->mode) {
+		return false;
+	}
+	render(lightPosition, mode);
+	return true;
+}
+
+void PointShadowMap::render(const glm::vec3 &lightPosition, PointShadowMode mode)
+{
+	this->lightPosition = lightPosition;
+	this->mode = mode;
+	valid = true;
+	drawCalls = 0;
+
+	// The usual cube map orientation: looking down each axis, with the up
+	// vectors that make the faces line up with samplerCube lookups
+	static const glm::vec3 directions[6] = {
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0),
+		glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+		glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+	};
+	static const glm::vec3 ups[6] = {
+		glm::vec3(0, -1, 0), glm::vec3(0, -1, 0),
+		glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+		glm::vec3(0, -1, 0), glm::vec3(0, -1, 0),
+	};
+	glm::mat4 faceProjection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+	for (int face = 0; face < 6; ++face) {
+		faceMatrices[face] = faceProjection * glm::lookAt(lightPosition, lightPosition + directions[face], ups[face]);
+	}
+	paraboloidViews[0] = glm::lookAt(lightPosition, lightPosition - glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
+	paraboloidViews[1] = glm::lookAt(lightPosition, lightPosition + glm::vec3(0, 1, 0), glm::vec3(0, 0, 1));
+
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glViewport(0, 0, size, size);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	// The fragment shader writes its own depth, which polygon offset does
+	// not apply to; the lookup carries the bias instead
+	if (mode == POINT_SHADOW_CUBE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, cubeFrameBufferID);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glUseProgram(cubeProgramID);
+		glUniformMatrix4fv(cubeFaceMatricesID, 6, GL_FALSE, &faceMatrices[0][0][0]);
+		glUniform3fv(cubeLightPositionID, 1, &lightPosition[0]);
+		glUniform1f(cubeFarPlaneID, farPlane);
+		for (size_t i = 0; i < casters.size(); ++i) {
+			casters[i]();
+		}
+		drawCalls += casters.size();
+	} else if (mode == POINT_SHADOW_CUBE_SIX_PASSES) {
+		glBindFramebuffer(GL_FRAMEBUFFER, faceFrameBufferID);
+		glUseProgram(faceProgramID);
+		glUniform3fv(faceLightPositionID, 1, &lightPosition[0]);
+		glUniform1f(faceFarPlaneID, farPlane);
+		for (int face = 0; face < 6; ++face) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubeTexture, 0);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glUniformMatrix4fv(faceMatrixID, 1, GL_FALSE, &faceMatrices[face][0][0]);
+			for (size_t i = 0; i < casters.size(); ++i) {
+				casters[i]();
+			}
+			drawCalls += casters.size();
+		}
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, paraboloidFrameBufferID);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_CLIP_DISTANCE0);
+		glUseProgram(paraboloidProgramID);
+		glUniformMatrix4fv(paraboloidViewsID, 2, GL_FALSE, &paraboloidViews[0][0][0]);
+		glUniform3fv(paraboloidLightPositionID, 1, &lightPosition[0]);
+		glUniform1f(paraboloidFarPlaneID, farPlane);
+		for (size_t i = 0; i < casters.size(); ++i) {
+			casters[i]();
+		}
+		drawCalls += casters.size();
+		glDisable(GL_CLIP_DISTANCE0);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void PointShadowMap::cleanup()
+{
+	glDeleteFramebuffers(1, &cubeFrameBufferID);
+	glDeleteFramebuffers(1, &faceFrameBufferID);
+	glDeleteFramebuffers(1, &paraboloidFrameBufferID);
+	glDeleteTextures(1, &cubeTexture);
+	glDeleteTextures(1, &paraboloidTexture);
+	glDeleteProgram(cubeProgramID);
+	glDeleteProgram(faceProgramID);
+	glDeleteProgram(paraboloidProgramID);
+}
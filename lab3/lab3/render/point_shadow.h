@@ -0,0 +1,82 @@
+#ifndef _POINT_SHADOW_H_
+#define _POINT_SHADOW_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+
+enum PointShadowMode {
+	POINT_SHADOW_CUBE,				// Cube map, all faces in one pass
+	POINT_SHADOW_CUBE_SIX_PASSES,	// Cube map, one pass per face
+	POINT_SHADOW_PARABOLOID,		// Two paraboloids in one pass
+};
+
+// Shadow map covering every direction around a point light. The cube map
+// renders all six faces in one draw per caster: a geometry shader sends
+// each triangle to the layers of the faces it overlaps. The dual-paraboloid
+// map covers the two hemispheres along the Y axis with two layers instead of
+// six, at the cost of bending straight edges. Both store the distance to the
+// light over the far plane, so the lookup compares distances directly.
+struct PointShadowMap {
+	int size;						// Width and height of each face or layer
+	float nearPlane;
+	float farPlane;
+
+	GLuint cubeTexture;
+	GLuint cubeFrameBufferID;		// All six faces, layered
+	GLuint faceFrameBufferID;		// One face at a time
+	GLuint paraboloidTexture;		// Two layer array, -Y then +Y
+	GLuint paraboloidFrameBufferID;
+	GLint savedViewport[4];
+
+	glm::mat4 faceMatrices[6];		// View-projection of each cube face
+	glm::mat4 paraboloidViews[2];
+
+	// Shader variable IDs
+	GLuint cubeProgramID;
+	GLuint cubeFaceMatricesID;
+	GLuint cubeLightPositionID;
+	GLuint cubeFarPlaneID;
+	GLuint faceProgramID;
+	GLuint faceMatrixID;
+	GLuint faceLightPositionID;
+	GLuint faceFarPlaneID;
+	GLuint paraboloidProgramID;
+	GLuint paraboloidViewsID;
+	GLuint paraboloidLightPositionID;
+	GLuint paraboloidFarPlaneID;
+
+	// Each draws into the depth pass in progress with a position-only
+	// vertex array, as for DepthPass
+	std::vector<std::function<void()> > casters;
+
+	// What the maps were last rendered with
+	glm::vec3 lightPosition;
+	PointShadowMode mode;
+	bool valid;
+
+	// Caster draws in the last render, for profiling
+	int drawCalls;
+
+	// Returns false if a program fails to load
+	bool initialize(int size, float nearPlane, float farPlane);
+
+	void addCaster(const std::function<void()> &renderDepth);
+
+	// Render the map of the given mode if the light moved, the mode changed
+	// or a caster was added since the last render. Returns true if it did.
+	bool update(const glm::vec3 &lightPosition, PointShadowMode mode);
+
+	// Render unconditionally
+	void render(const glm::vec3 &lightPosition, PointShadowMode mode);
+
+	// The texture the scene samples in the given mode
+	GLuint depthTexture(PointShadowMode mode) const {
+		return mode == POINT_SHADOW_PARABOLOID ? paraboloidTexture : cubeTexture;
+	}
+
+	void cleanup();
+};
+
+#endif
@@ -1,195 +1,127 @@
 #include "shader.h"
 
-#include <string> 
-#include <iostream> 
+#include <string>
+#include <iostream>
 #include <fstream>
-#include <sstream> 
+#include <sstream>
 #include <vector>
 
-GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+static bool ReadShaderFile(const char *file_path, std::string &code)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open())
-	{
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else
-	{
-		printf("Vertex shader not found %s.\n", vertex_file_path);
-		return 0;
+	std::ifstream stream(file_path, std::ios::in);
+	if (!stream.is_open()) {
+		printf("Shader not found %s.\n", file_path);
+		return false;
 	}
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	code = sstr.str();
+	return true;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open())
-	{
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
-	else
-	{
-		printf("Fragment shader not found %s.\n", fragment_file_path);
-		return 0;
-	}
+// Returns 0 and prints the log if the shader does not compile. name is the
+// file path, or the stage for shaders given as strings.
+static GLuint CompileShader(GLenum type, const char *name, const std::string &code)
+{
+	printf("Compiling shader : %s\n", name);
+	GLuint ShaderID = glCreateShader(type);
+	char const *SourcePointer = code.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer, NULL);
+	glCompileShader(ShaderID);
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling vertex shader : %s\n", vertex_file_path);
-	char const *VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
 	if (!Result) {
-		printf("Error compiling vertex shader : %s\n", vertex_file_path);
-		glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		printf("Error compiling shader : %s\n", name);
+		glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 		if (InfoLogLength > 0) {
-			std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-			printf("%s\n", &VertexShaderErrorMessage[0]);
+			std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+			glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+			printf("%s\n", &ShaderErrorMessage[0]);
 		}
+		glDeleteShader(ShaderID);
 		return 0;
 	}
+	return ShaderID;
+}
 
-	// Compile Fragment Shader
-	printf("Compiling fragment shader : %s\n", fragment_file_path);
-	char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
+// Link the compiled shaders into a program and delete them. Returns 0 if
+// one of them failed to compile (is 0) or the program does not link.
+static GLuint LinkProgram(const GLuint *ShaderIDs, int count)
+{
+	GLuint ProgramID = 0;
+	bool compiled = true;
+	for (int i = 0; i < count; ++i) {
+		compiled = compiled && ShaderIDs[i] != 0;
+	}
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling fragment shader : %s\n", fragment_file_path);
-		glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-			printf("%s\n", &FragmentShaderErrorMessage[0]);
+	if (compiled) {
+		printf("Linking program\n");
+		ProgramID = glCreateProgram();
+		for (int i = 0; i < count; ++i) {
+			glAttachShader(ProgramID, ShaderIDs[i]);
+		}
+		glLinkProgram(ProgramID);
+
+		GLint Result = GL_FALSE;
+		int InfoLogLength;
+		glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+		if (!Result) {
+			printf("Error linking program\n");
+			glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+			if (InfoLogLength > 0)
+			{
+				std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+				glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+				printf("%s\n", &ProgramErrorMessage[0]);
+			}
+			glDeleteProgram(ProgramID);
+			ProgramID = 0;
 		}
-		return 0;
 	}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	if (!Result) {
-		printf("Error linking program\n");
-		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			printf("%s\n", &ProgramErrorMessage[0]);
+	for (int i = 0; i < count; ++i) {
+		if (ProgramID != 0) {
+			glDetachShader(ProgramID, ShaderIDs[i]);
 		}
-		return 0;
+		glDeleteShader(ShaderIDs[i]);
 	}
 
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
 	return ProgramID;
 }
 
-GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
+// Read and compile the stages in order, stopping at the first failure
+static GLuint LoadShaderFiles(const char **paths, const GLenum *types, int count)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling vertex shader\n");
-	char const *VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling vertex shader\n");
-		glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0) {
-			std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-			printf("%s\n", &VertexShaderErrorMessage[0]);
-		}
-		return 0;
+	GLuint ShaderIDs[3] = { 0, 0, 0 };
+	bool compiled = true;
+	for (int i = 0; i < count && compiled; ++i) {
+		std::string code;
+		compiled = ReadShaderFile(paths[i], code) && (ShaderIDs[i] = CompileShader(types[i], paths[i], code)) != 0;
 	}
+	return LinkProgram(ShaderIDs, count);
+}
 
-	// Compile Fragment Shader
-	printf("Compiling fragment shader\n");
-	char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling fragment shader\n");
-		glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-			printf("%s\n", &FragmentShaderErrorMessage[0]);
-		}
-		return 0;
-	}
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+{
+	const char *paths[2] = { vertex_file_path, fragment_file_path };
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	return LoadShaderFiles(paths, types, 2);
+}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *geometry_file_path, const char *fragment_file_path)
+{
+	const char *paths[3] = { vertex_file_path, geometry_file_path, fragment_file_path };
+	const GLenum types[3] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	return LoadShaderFiles(paths, types, 3);
+}
 
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	if (!Result) {
-		printf("Error linking program\n");
-		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			printf("%s\n", &ProgramErrorMessage[0]);
-		}
-		return 0;
+GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
+{
+	GLuint ShaderIDs[2] = { CompileShader(GL_VERTEX_SHADER, "vertex shader", VertexShaderCode), 0 };
+	if (ShaderIDs[0] != 0) {
+		ShaderIDs[1] = CompileShader(GL_FRAGMENT_SHADER, "fragment shader", FragmentShaderCode);
 	}
-
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
+	return LinkProgram(ShaderIDs, 2);
 }
@@ -6,6 +6,9 @@
 
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
 
+// Same with a geometry shader between the vertex and fragment stages
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *geometry_file_path, const char *fragment_file_path);
+
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
 #endif
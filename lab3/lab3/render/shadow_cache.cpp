@@ -0,0 +1,79 @@
+#include "shadow_cache.h"
+
+bool ShadowCache::initialize(int width, int height)
+{
+	lightSpaceMatrix = glm::mat4(0.0f);
+	staticValid = false;
+	dynamicValid = false;
+	staticRenders = 0;
+	dynamicRenders = 0;
+	return staticPass.initialize(width, height) && shadowPass.initialize(width, height);
+}
+
+void ShadowCache::addCaster(const std::function<void()> &renderDepth, bool isStatic)
+{
+	Caster caster = { renderDepth, isStatic };
+	casters.push_back(caster);
+
+	// The first dynamic caster also moves the static casters to their own
+	// layer, so start over
+	staticValid = false;
+	dynamicValid = false;
+}
+
+bool ShadowCache::update(const glm::mat4 &lightSpaceMatrix)
+{
+	if (lightSpaceMatrix != this->lightSpaceMatrix) {
+		this->lightSpaceMatrix = lightSpaceMatrix;
+		staticValid = false;
+	}
+	if (staticValid && dynamicValid) {
+		return false;
+	}
+
+	bool hasDynamic = false;
+	for (size_t i = 0; i < casters.size(); ++i) {
+		hasDynamic = hasDynamic || !casters[i].isStatic;
+	}
+
+	// Without dynamic casters the static layer would only be copied over,
+	// so draw the static casters straight into the shadow map
+	DepthPass &staticTarget = hasDynamic ? staticPass : shadowPass;
+	if (!staticValid) {
+		staticTarget.begin(lightSpaceMatrix);
+		for (size_t i = 0; i < casters.size(); ++i) {
+			if (casters[i].isStatic) {
+				casters[i].renderDepth();
+			}
+		}
+		staticTarget.end();
+		staticValid = true;
+		staticRenders++;
+	}
+
+	if (hasDynamic) {
+		// Start from the static depths, then draw the dynamic casters on top
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticPass.frameBufferID);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowPass.frameBufferID);
+		glBlitFramebuffer(0, 0, staticPass.width, staticPass.height, 0, 0, shadowPass.width, shadowPass.height,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		shadowPass.begin(lightSpaceMatrix, false);
+		for (size_t i = 0; i < casters.size(); ++i) {
+			if (!casters[i].isStatic) {
+				casters[i].renderDepth();
+			}
+		}
+		shadowPass.end();
+		dynamicRenders++;
+	}
+	dynamicValid = true;
+
+	return true;
+}
+
+void ShadowCache::cleanup()
+{
+	staticPass.cleanup();
+	shadowPass.cleanup();
+}
@@ -0,0 +1,60 @@
+#ifndef _SHADOW_CACHE_H_
+#define _SHADOW_CACHE_H_
+
+#include "depth_pass.h"
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+
+// Keeps a shadow map up to date with as little rendering as possible.
+// Static casters are drawn into a depth layer of their own, redrawn only
+// when the light view changes. When dynamic casters move, the static layer
+// is copied into the shadow map and they are drawn on top. While neither
+// the light nor a caster changes the map is reused and costs nothing.
+struct ShadowCache {
+	struct Caster {
+		std::function<void()> renderDepth;	// Draws into the depth pass in progress
+		bool isStatic;
+	};
+	std::vector<Caster> casters;
+
+	DepthPass staticPass;			// Static casters only
+	DepthPass shadowPass;			// Everything, sampled by the scene
+
+	glm::mat4 lightSpaceMatrix;		// The view both layers were rendered with
+	bool staticValid;
+	bool dynamicValid;
+
+	// Counts of layer renders, for profiling
+	int staticRenders;
+	int dynamicRenders;
+
+	bool initialize(int width, int height);
+
+	// Register a caster. Static casters must not move; dynamic ones call
+	// invalidateDynamic() when they do.
+	void addCaster(const std::function<void()> &renderDepth, bool isStatic);
+
+	// A dynamic caster moved
+	void invalidateDynamic() {
+		dynamicValid = false;
+	}
+
+	// A static caster was edited
+	void invalidateStatic() {
+		staticValid = false;
+	}
+
+	// Bring the shadow map up to date for the given light view. Returns
+	// true if anything was rendered.
+	bool update(const glm::mat4 &lightSpaceMatrix);
+
+	GLuint depthTexture() const {
+		return shadowPass.depthTexture;
+	}
+
+	void cleanup();
+};
+
+#endif
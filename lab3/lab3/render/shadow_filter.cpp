@@ -0,0 +1,138 @@
+#include "shadow_filter.h"
+#include "shader.h"
+
+#include <iostream>
+
+static GLuint createMomentsTexture(int width, int height, bool mipmapped)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mipmapped ? GL_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (mipmapped) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	return texture;
+}
+
+static GLuint createColorFrameBuffer(GLuint texture)
+{
+	GLuint frameBufferID;
+	glGenFramebuffers(1, &frameBufferID);
+	glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Variance frame buffer is incomplete." << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return frameBufferID;
+}
+
+bool ShadowFilter::initialize(int width, int height, float nearPlane, float farPlane, int blurRadius)
+{
+	this->width = width;
+	this->height = height;
+	this->nearPlane = nearPlane;
+	this->farPlane = farPlane;
+	this->blurRadius = blurRadius;
+	momentsValid = false;
+	momentRenders = 0;
+
+	// Compare against the reference depth and filter the four results
+	glGenSamplers(1, &compareSamplerID);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	momentsTexture = createMomentsTexture(width, height, true);
+	blurTexture = createMomentsTexture(width, height, false);
+	momentsFrameBufferID = createColorFrameBuffer(momentsTexture);
+	blurFrameBufferID = createColorFrameBuffer(blurTexture);
+	glGenVertexArrays(1, &emptyArrayID);
+
+	momentsProgramID = LoadShadersFromFile("../lab3/fullscreen.vert", "../lab3/vsm_moments.frag");
+	blurProgramID = LoadShadersFromFile("../lab3/fullscreen.vert", "../lab3/vsm_blur.frag");
+	if (momentsProgramID == 0 || blurProgramID == 0) {
+		std::cerr << "Failed to load shaders." << std::endl;
+		return false;
+	}
+	momentsDepthRangeID = glGetUniformLocation(momentsProgramID, "depthRange");
+	momentsRadiusID = glGetUniformLocation(momentsProgramID, "radius");
+	blurRadiusID = glGetUniformLocation(blurProgramID, "radius");
+
+	// Both read their source on unit 0
+	glUseProgram(momentsProgramID);
+	glUniform1i(glGetUniformLocation(momentsProgramID, "source"), 0);
+	glUseProgram(blurProgramID);
+	glUniform1i(glGetUniformLocation(blurProgramID, "source"), 0);
+	return true;
+}
+
+bool ShadowFilter::update(GLuint depthTexture)
+{
+	if (momentsValid) {
+		return false;
+	}
+	renderMoments(depthTexture);
+	return true;
+}
+
+void ShadowFilter::renderMoments(GLuint depthTexture)
+{
+	GLint activeTexture, boundTexture;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyArrayID);
+
+	// Moments of the linear depths, averaged along the rows
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFrameBufferID);
+	glUseProgram(momentsProgramID);
+	glUniform2f(momentsDepthRangeID, nearPlane, farPlane);
+	glUniform1i(momentsRadiusID, blurRadius);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Then along the columns, into the mipmapped texture
+	glBindFramebuffer(GL_FRAMEBUFFER, momentsFrameBufferID);
+	glUseProgram(blurProgramID);
+	glUniform1i(blurRadiusID, blurRadius);
+	glBindTexture(GL_TEXTURE_2D, blurTexture);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindTexture(GL_TEXTURE_2D, momentsTexture);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+	glBindTexture(GL_TEXTURE_2D, boundTexture);
+	glActiveTexture(activeTexture);
+
+	momentsValid = true;
+	++momentRenders;
+}
+
+void ShadowFilter::cleanup()
+{
+	glDeleteSamplers(1, &compareSamplerID);
+	glDeleteFramebuffers(1, &momentsFrameBufferID);
+	glDeleteFramebuffers(1, &blurFrameBufferID);
+	glDeleteTextures(1, &momentsTexture);
+	glDeleteTextures(1, &blurTexture);
+	glDeleteVertexArrays(1, &emptyArrayID);
+	glDeleteProgram(momentsProgramID);
+	glDeleteProgram(blurProgramID);
+}
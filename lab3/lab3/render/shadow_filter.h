@@ -0,0 +1,68 @@
+#ifndef _SHADOW_FILTER_H_
+#define _SHADOW_FILTER_H_
+
+#include <glad/gl.h>
+
+enum ShadowFilterMode {
+	SHADOW_FILTER_NEAREST,			// One depth texel, hard edges
+	SHADOW_FILTER_PCF,				// Hardware comparisons over a kernel
+	SHADOW_FILTER_VARIANCE,			// Blurred depth moments
+	SHADOW_FILTER_MODE_COUNT,
+};
+
+// Soft edges for a 2D shadow map at a small, fixed number of fetches.
+//
+// PCF samples the depth texture through a comparison sampler: each fetch
+// compares four texels against the fragment depth and filters the results
+// bilinearly, so a kernel of (2r + 1)^2 fetches covers about twice as many
+// texels per side. The sampler object leaves the texture's own parameters
+// alone, so it can still be read as plain depth through another unit.
+//
+// The variance map stores the mean linear depth and squared depth around
+// each texel. It is blurred with two one-dimensional passes and mipmapped,
+// so a single trilinear fetch gives the moments over the fragment's
+// footprint, and Chebyshev's inequality bounds the lit fraction.
+struct ShadowFilter {
+	int width;
+	int height;
+	float nearPlane;				// Of the light projection, to linearize depth
+	float farPlane;
+	int blurRadius;					// Each blur pass averages 2 * blurRadius + 1 texels
+
+	GLuint compareSamplerID;
+	GLuint momentsTexture;			// RG32F, mipmapped
+	GLuint blurTexture;				// RG32F, horizontal pass
+	GLuint momentsFrameBufferID;
+	GLuint blurFrameBufferID;
+	GLuint emptyArrayID;			// Full screen triangles come from gl_VertexID
+	GLint savedViewport[4];
+
+	// Shader variable IDs
+	GLuint momentsProgramID;
+	GLuint momentsDepthRangeID;
+	GLuint momentsRadiusID;
+	GLuint blurProgramID;
+	GLuint blurRadiusID;
+
+	bool momentsValid;
+	int momentRenders;				// For profiling
+
+	// Returns false if a program fails to load
+	bool initialize(int width, int height, float nearPlane, float farPlane, int blurRadius);
+
+	// The shadow map changed
+	void invalidate() {
+		momentsValid = false;
+	}
+
+	// Rebuild the variance map from the depth texture if it is out of date.
+	// Returns true if it did.
+	bool update(GLuint depthTexture);
+
+	// Rebuild unconditionally. Uses texture unit 0 and restores its binding.
+	void renderMoments(GLuint depthTexture);
+
+	void cleanup();
+};
+
+#endif
@@ -1,13 +1,5 @@
 #version 330 core
 
-out vec4 FragColor;
-
-in vec2 TexCoords;
-
-uniform sampler2D depthMap;
-
-void main(){
-    // do nothing for now
-    float depthValue = texture(depthMap, TexCoords).r;
-    FragColor = vec4(vec3(depthValue),1.0);
-}
\ No newline at end of file
+// Depth only: the depth test writes gl_FragCoord.z, there is no colour output
+void main() {
+}
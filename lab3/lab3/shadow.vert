@@ -1,10 +1,10 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
+// Positions only, already in world space
+layout(location = 0) in vec3 vertexPosition;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
 
-void main(){
-    gl_Position = lightSpaceMatrix * model * vec4(aPos,1.0);
-}
\ No newline at end of file
+void main() {
+    gl_Position = lightSpaceMatrix * vec4(vertexPosition, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+// Second half of the separable blur, along the columns
+uniform sampler2D source;
+uniform int radius;
+
+out vec2 moments;
+
+void main() {
+    ivec2 size = textureSize(source, 0);
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    vec2 sum = vec2(0.0);
+    for (int i = -radius; i <= radius; ++i) {
+        int y = clamp(texel.y + i, 0, size.y - 1);
+        sum += texelFetch(source, ivec2(texel.x, y), 0).rg;
+    }
+    moments = sum / float(2 * radius + 1);
+}
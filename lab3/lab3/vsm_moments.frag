@@ -0,0 +1,32 @@
+#version 330 core
+
+// First half of the separable blur: the mean linear depth and squared
+// depth over 2 * radius + 1 texels of the row. Linear depths spread the
+// range evenly, where the projected depths of the far walls all crowd
+// just below 1 and leave the variance nothing to work with.
+uniform sampler2D source;
+uniform vec2 depthRange;            // Near and far planes of the light
+uniform int radius;
+
+out vec2 moments;
+
+float linearDepth(float depth)
+{
+    float n = depthRange.x;
+    float f = depthRange.y;
+    float viewDepth = 2.0 * n * f / (f + n - (depth * 2.0 - 1.0) * (f - n));
+    return (viewDepth - n) / (f - n);
+}
+
+void main() {
+    ivec2 size = textureSize(source, 0);
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    vec2 sum = vec2(0.0);
+    for (int i = -radius; i <= radius; ++i) {
+        int x = clamp(texel.x + i, 0, size.x - 1);
+        float depth = linearDepth(texelFetch(source, ivec2(x, texel.y), 0).r);
+        sum += vec2(depth, depth * depth);
+    }
+    moments = sum / float(2 * radius + 1);
+}
@@ -0,0 +1,245 @@
+#include "animation.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <math.h>
+
+// Number of keyframes the cursor may walk linearly before giving up and
+// bisecting. Large steps only happen at high playback speeds or seeks.
+static const int MAX_CURSOR_STEPS = 4;
+
+int findKeyframeIndex(const float *times, int count, float animationTime)
+{
+	if (count < 2 || animationTime < times[0]) {
+		return 0;
+	}
+
+	int left = 0;
+	int right = count - 1;
+
+	while (left <= right) {
+		int mid = (left + right) / 2;
+
+		if (mid + 1 < count && times[mid] <= animationTime && animationTime < times[mid + 1]) {
+			return mid;
+		}
+		else if (times[mid] > animationTime) {
+			right = mid - 1;
+		}
+		else { // animationTime >= times[mid + 1]
+			left = mid + 1;
+		}
+	}
+
+	// Target not found
+	return count - 2;
+}
+
+int findKeyframeIndex(const float *times, int count, float animationTime, KeyframeCursor &cursor)
+{
+	if (count < 2) {
+		cursor.index = 0;
+		return 0;
+	}
+
+	int last = count - 2;
+	int index = cursor.index;
+	if (index < 0 || index > last) {
+		index = 0;
+	}
+
+	if (animationTime < times[index]) {
+		// Time went backwards: the clip wrapped around or playback was seeked.
+		// After a wrap the time is almost always inside the first interval.
+		if (animationTime < times[1]) {
+			index = 0;
+		} else {
+			index = findKeyframeIndex(times, count, animationTime);
+		}
+	} else {
+		int steps = 0;
+		while (index < last && times[index + 1] <= animationTime) {
+			if (++steps > MAX_CURSOR_STEPS) {
+				index = findKeyframeIndex(times, count, animationTime);
+				break;
+			}
+			++index;
+		}
+	}
+
+	cursor.index = index;
+	return index;
+}
+
+// Copy count elements of an accessor into dst, widening each to vec4
+static void readAccessor(const tinygltf::Model &model, int accessorIndex, glm::vec4 *dst)
+{
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+
+	assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+
+	int components = tinygltf::GetNumComponentsInType(accessor.type);
+	int stride = accessor.ByteStride(bufferView);
+	const unsigned char *ptr = &buffer.data[bufferView.byteOffset + accessor.byteOffset];
+
+	for (size_t i = 0; i < accessor.count; ++i) {
+		dst[i] = glm::vec4(0.0f);
+		memcpy(&dst[i][0], ptr + i * stride, components * sizeof(float));
+	}
+}
+
+AnimationClip compileAnimation(const tinygltf::Model &model, const tinygltf::Animation &anim,
+	const SkeletonHierarchy &hierarchy)
+{
+	AnimationClip clip;
+	clip.duration = 0.0f;
+
+	for (const auto &channel : anim.channels) {
+		if (channel.target_node < 0 || hierarchy.jointOfNode[channel.target_node] < 0) {
+			continue;
+		}
+
+		AnimationTrack track;
+		if (channel.target_path == "translation") {
+			track.path = TRACK_TRANSLATION;
+		} else if (channel.target_path == "rotation") {
+			track.path = TRACK_ROTATION;
+		} else if (channel.target_path == "scale") {
+			track.path = TRACK_SCALE;
+		} else {
+			std::cout << "Unsupported animation path: " << channel.target_path << std::endl;
+			continue;
+		}
+
+		// A sampler without keys has nothing to play and no last key time
+		const tinygltf::AnimationSampler &sampler = anim.samplers[channel.sampler];
+		if (model.accessors[sampler.input].count == 0) {
+			continue;
+		}
+
+		if (sampler.interpolation == "STEP") {
+			track.interpolation = INTERPOLATION_STEP;
+		} else {
+			if (sampler.interpolation != "LINEAR") {
+				std::cout << "Unsupported interpolation " << sampler.interpolation << ", using LINEAR" << std::endl;
+			}
+			track.interpolation = INTERPOLATION_LINEAR;
+		}
+
+		track.target = hierarchy.jointOfNode[channel.target_node];
+		// Temporarily remember the sampler; keys are gathered after sorting
+		track.firstKey = channel.sampler;
+		track.keyCount = (int)model.accessors[sampler.input].count;
+		clip.tracks.push_back(track);
+	}
+
+	// Tracks of the same joint end up next to each other, and joints are
+	// visited in hierarchy order
+	std::stable_sort(clip.tracks.begin(), clip.tracks.end(),
+		[](const AnimationTrack &a, const AnimationTrack &b) {
+			return a.target != b.target ? a.target < b.target : a.path < b.path;
+		});
+
+	size_t totalKeys = 0;
+	for (const auto &track : clip.tracks) {
+		totalKeys += track.keyCount;
+	}
+	clip.times.resize(totalKeys);
+	clip.values.resize(totalKeys);
+
+	int firstKey = 0;
+	for (auto &track : clip.tracks) {
+		const tinygltf::AnimationSampler &sampler = anim.samplers[track.firstKey];
+		track.firstKey = firstKey;
+
+		const tinygltf::Accessor &inputAccessor = model.accessors[sampler.input];
+		const tinygltf::BufferView &inputBufferView = model.bufferViews[inputAccessor.bufferView];
+		const tinygltf::Buffer &inputBuffer = model.buffers[inputBufferView.buffer];
+
+		assert(inputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+		assert(inputAccessor.type == TINYGLTF_TYPE_SCALAR);
+		assert(model.accessors[sampler.output].count == inputAccessor.count);
+
+		const unsigned char *inputPtr = &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset];
+		int stride = inputAccessor.ByteStride(inputBufferView);
+		for (int i = 0; i < track.keyCount; ++i) {
+			clip.times[firstKey + i] = *reinterpret_cast<const float*>(inputPtr + i * stride);
+		}
+		readAccessor(model, sampler.output, &clip.values[firstKey]);
+
+		clip.duration = std::max(clip.duration, clip.times[firstKey + track.keyCount - 1]);
+		firstKey += track.keyCount;
+	}
+
+	return clip;
+}
+
+glm::vec4 sampleTrack(const AnimationClip &clip, const AnimationTrack &track,
+	float animationTime, KeyframeCursor &cursor)
+{
+	const float *times = &clip.times[track.firstKey];
+	const glm::vec4 *values = &clip.values[track.firstKey];
+
+	if (track.keyCount < 2) {
+		return values[0];
+	}
+
+	int k = findKeyframeIndex(times, track.keyCount, animationTime, cursor);
+	float factor = (animationTime - times[k]) / (times[k + 1] - times[k]);
+	factor = glm::clamp(factor, 0.0f, 1.0f);
+	if (track.interpolation == INTERPOLATION_STEP) {
+		return factor < 1.0f ? values[k] : values[k + 1];
+	}
+
+	if (track.path == TRACK_ROTATION) {
+		glm::quat rotation0(values[k].w, values[k].x, values[k].y, values[k].z);
+		glm::quat rotation1(values[k + 1].w, values[k + 1].x, values[k + 1].y, values[k + 1].z);
+		glm::quat rotation = glm::slerp(rotation0, rotation1, factor);
+		return glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	}
+	return glm::mix(values[k], values[k + 1], factor);
+}
+
+void sampleAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<KeyframeCursor> &cursors,
+	std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty)
+{
+	float animationTime = clip.duration > 0.0f ? fmod(time, clip.duration) : 0.0f;
+
+	size_t i = 0;
+	while (i < clip.tracks.size()) {
+		int joint = clip.tracks[i].target;
+		glm::vec3 translation = hierarchy.restTranslations[joint];
+		glm::quat rotation = hierarchy.restRotations[joint];
+		glm::vec3 scale = hierarchy.restScales[joint];
+
+		// All tracks of this joint are adjacent
+		for (; i < clip.tracks.size() && clip.tracks[i].target == joint; ++i) {
+			const AnimationTrack &track = clip.tracks[i];
+			glm::vec4 value = sampleTrack(clip, track, animationTime, cursors[i]);
+			if (track.path == TRACK_TRANSLATION) {
+				translation = glm::vec3(value);
+			} else if (track.path == TRACK_ROTATION) {
+				rotation = glm::quat(value.w, value.x, value.y, value.z);
+			} else {
+				scale = glm::vec3(value);
+			}
+		}
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation);
+		transform *= glm::mat4_cast(rotation);
+		transform = glm::scale(transform, scale);
+		if (dirty != NULL && transform != localTransforms[joint]) {
+			(*dirty)[joint] = 1;
+		}
+		localTransforms[joint] = transform;
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include "skeleton.h"
+
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <vector>
+
+namespace tinygltf {
+	class Model;
+	struct Animation;
+}
+
+// Playback cursor for one keyframe sampler. Animation time mostly moves
+// forward between frames, so the interval found on the previous frame is
+// the best starting point for the next search.
+struct KeyframeCursor {
+	int index;
+
+	KeyframeCursor() : index(0) {}
+};
+
+// Find i such that times[i] <= animationTime < times[i + 1] by bisection.
+// Returns 0 before the first keyframe and count - 2 after the last one.
+int findKeyframeIndex(const float *times, int count, float animationTime);
+
+// Same as above, but steps forward from the cursor in amortized O(1) and
+// falls back to bisection when the time jumps backwards (wrap or seek) or
+// too far ahead.
+int findKeyframeIndex(const float *times, int count, float animationTime, KeyframeCursor &cursor);
+
+inline int findKeyframeIndex(const std::vector<float> &times, float animationTime) {
+	return findKeyframeIndex(times.data(), (int)times.size(), animationTime);
+}
+
+inline int findKeyframeIndex(const std::vector<float> &times, float animationTime, KeyframeCursor &cursor) {
+	return findKeyframeIndex(times.data(), (int)times.size(), animationTime, cursor);
+}
+
+enum TrackPath {
+	TRACK_TRANSLATION,
+	TRACK_ROTATION,
+	TRACK_SCALE
+};
+
+enum TrackInterpolation {
+	INTERPOLATION_STEP,
+	INTERPOLATION_LINEAR
+};
+
+// One animated property of one joint. Its keys live contiguously in the
+// owning clip's times/values arrays, starting at firstKey.
+struct AnimationTrack {
+	TrackPath path;
+	TrackInterpolation interpolation;
+	int target;			// Joint index in the SkeletonHierarchy
+	int firstKey;
+	int keyCount;
+};
+
+// A glTF animation compiled at load time, so that sampling needs no
+// accessor lookups or string compares. Tracks are sorted by target joint
+// and then by path (translation, rotation, scale).
+struct AnimationClip {
+	std::vector<AnimationTrack> tracks;
+	std::vector<float> times;
+	std::vector<glm::vec4> values;	// vec3 keys leave w unused, rotations are (x, y, z, w)
+	float duration;
+};
+
+// Channels that target nodes outside the hierarchy are dropped
+AnimationClip compileAnimation(const tinygltf::Model &model, const tinygltf::Animation &anim,
+	const SkeletonHierarchy &hierarchy);
+
+// Interpolate one track at animationTime, which must already lie within
+// the clip duration. Rotations are returned as (x, y, z, w).
+glm::vec4 sampleTrack(const AnimationClip &clip, const AnimationTrack &track,
+	float animationTime, KeyframeCursor &cursor);
+
+// Evaluate every track of the clip at the given time (wrapped to the clip
+// duration) and write the local transform of each animated joint. Parts of
+// the transform without a track keep their rest value; joints without any
+// track are left untouched. cursors must hold one entry per track and
+// persist across frames. If dirty is given, joints whose local transform
+// changed get their flag set.
+void sampleAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<KeyframeCursor> &cursors,
+	std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty = NULL);
+
+#endif
@@ -0,0 +1,113 @@
+#include "bake.h"
+#include "skinning.h"
+
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+static const char BAKE_MAGIC[4] = { 'B', 'A', 'K', 'E' };
+static const int BAKE_VERSION = 1;
+
+BakedAnimation bakeAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	int skinIndex, const std::vector<glm::mat4> &inverseBindMatrices, float frameRate)
+{
+	BakedAnimation baked;
+	baked.jointCount = (int)hierarchy.skinJoints[skinIndex].size();
+	baked.duration = clip.duration;
+	if (clip.duration > 0.0f) {
+		// Round the rate so a whole number of frames spans the clip exactly
+		baked.frameCount = (int)ceil(clip.duration * frameRate) + 1;
+		baked.frameRate = (baked.frameCount - 1) / clip.duration;
+	} else {
+		baked.frameCount = 2;
+		baked.frameRate = frameRate;
+	}
+	baked.matrices.resize((size_t)baked.frameCount * baked.jointCount);
+
+	std::vector<KeyframeCursor> cursors(clip.tracks.size());
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+	std::vector<glm::mat4> globalTransforms;
+	std::vector<glm::mat4> jointMatrices;
+
+	for (int f = 0; f < baked.frameCount; ++f) {
+		// The final frame repeats the first one so the loop closes smoothly
+		float time = f == baked.frameCount - 1 ? 0.0f : f / baked.frameRate;
+
+		sampleAnimation(clip, hierarchy, time, cursors, localTransforms);
+		computeGlobalTransforms(hierarchy, localTransforms, globalTransforms);
+		computeJointMatrices(hierarchy, skinIndex, globalTransforms, inverseBindMatrices, jointMatrices);
+
+		std::copy(jointMatrices.begin(), jointMatrices.end(),
+			baked.matrices.begin() + (size_t)f * baked.jointCount);
+	}
+
+	return baked;
+}
+
+bool saveBakedAnimation(const char *filename, const BakedAnimation &baked)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Failed to write baked animation: " << filename << std::endl;
+		return false;
+	}
+
+	file.write(BAKE_MAGIC, sizeof(BAKE_MAGIC));
+	file.write(reinterpret_cast<const char *>(&BAKE_VERSION), sizeof(BAKE_VERSION));
+	file.write(reinterpret_cast<const char *>(&baked.jointCount), sizeof(baked.jointCount));
+	file.write(reinterpret_cast<const char *>(&baked.frameCount), sizeof(baked.frameCount));
+	file.write(reinterpret_cast<const char *>(&baked.frameRate), sizeof(baked.frameRate));
+	file.write(reinterpret_cast<const char *>(&baked.duration), sizeof(baked.duration));
+	file.write(reinterpret_cast<const char *>(&baked.matrices[0][0][0]), baked.matrices.size() * sizeof(glm::mat4));
+
+	return file.good();
+}
+
+bool loadBakedAnimation(const char *filename, BakedAnimation &baked)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	char magic[4];
+	int version = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char *>(&version), sizeof(version));
+	if (!file || memcmp(magic, BAKE_MAGIC, sizeof(magic)) != 0 || version != BAKE_VERSION) {
+		std::cout << "Not a baked animation or wrong version: " << filename << std::endl;
+		return false;
+	}
+
+	file.read(reinterpret_cast<char *>(&baked.jointCount), sizeof(baked.jointCount));
+	file.read(reinterpret_cast<char *>(&baked.frameCount), sizeof(baked.frameCount));
+	file.read(reinterpret_cast<char *>(&baked.frameRate), sizeof(baked.frameRate));
+	file.read(reinterpret_cast<char *>(&baked.duration), sizeof(baked.duration));
+	// Playback blends between two frames at a rate derived from frameCount - 1
+	if (!file || baked.jointCount <= 0 || baked.frameCount < 2
+		|| !isfinite(baked.frameRate) || baked.frameRate <= 0.0f
+		|| !isfinite(baked.duration) || baked.duration < 0.0f) {
+		std::cout << "Invalid baked animation header: " << filename << std::endl;
+		return false;
+	}
+
+	// The rest of the file must hold exactly the matrices the header
+	// announces, checked without multiplying the counts
+	std::streamoff matricesStart = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t remaining = (uint64_t)(file.tellg() - matricesStart);
+	file.seekg(matricesStart);
+	uint64_t matrixCount = remaining / sizeof(glm::mat4);
+	if (remaining % sizeof(glm::mat4) != 0 || matrixCount % baked.jointCount != 0
+		|| matrixCount / baked.jointCount != (uint64_t)baked.frameCount) {
+		std::cout << "Baked animation size does not match its header: " << filename << std::endl;
+		return false;
+	}
+
+	baked.matrices.resize((size_t)matrixCount);
+	file.read(reinterpret_cast<char *>(&baked.matrices[0][0][0]), baked.matrices.size() * sizeof(glm::mat4));
+
+	return file.good();
+}
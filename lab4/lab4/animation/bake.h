@@ -0,0 +1,32 @@
+#ifndef _BAKE_H_
+#define _BAKE_H_
+
+#include "animation.h"
+#include "skeleton.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Joint matrices of one skin sampled at a fixed rate over a whole clip.
+// Row f holds the jointCount matrices of frame f, which maps directly onto
+// a float texture of jointCount * 4 RGBA texels by frameCount rows. The
+// last row equals the first so playback can wrap by interpolation.
+struct BakedAnimation {
+	int jointCount;
+	int frameCount;
+	float frameRate;
+	float duration;
+	std::vector<glm::mat4> matrices;
+};
+
+// Evaluate the clip at roughly frameRate samples per second with the regular
+// sampling, hierarchy and skinning code. The stored rate is adjusted so the
+// frames span the clip duration exactly.
+BakedAnimation bakeAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	int skinIndex, const std::vector<glm::mat4> &inverseBindMatrices, float frameRate);
+
+// Binary file: magic, version, header fields, then the raw matrices
+bool saveBakedAnimation(const char *filename, const BakedAnimation &baked);
+bool loadBakedAnimation(const char *filename, BakedAnimation &baked);
+
+#endif
@@ -0,0 +1,342 @@
+#include "compression.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <math.h>
+
+static const float QUANTIZED_MAX = 65535.0f;
+static const float ROTATION_QUANTIZED_MAX = 32767.0f;		// 15 bits per component
+static const float ROTATION_RANGE = 0.70710678f;			// Smallest three lie in [-1/sqrt(2), 1/sqrt(2)]
+
+// Same stepping strategy as the float version in animation.cpp
+static const int MAX_CURSOR_STEPS = 4;
+
+static uint16_t quantize(float value, float minimum, float step)
+{
+	if (step <= 0.0f) {
+		return 0;
+	}
+	float q = (value - minimum) / step + 0.5f;
+	return (uint16_t)glm::clamp(q, 0.0f, QUANTIZED_MAX);
+}
+
+// Smallest three: drop the largest component, which is made positive and
+// recovered from the unit length. Two bits select it, spread over the top
+// bits of the first two words; the three others get 15 bits each.
+static void encodeRotation(glm::vec4 q, uint16_t *out)
+{
+	q = glm::normalize(q);
+	int largest = 0;
+	for (int c = 1; c < 4; ++c) {
+		if (fabs(q[c]) > fabs(q[largest])) {
+			largest = c;
+		}
+	}
+	if (q[largest] < 0.0f) {
+		q = -q;
+	}
+
+	int word = 0;
+	for (int c = 0; c < 4; ++c) {
+		if (c == largest) {
+			continue;
+		}
+		float normalized = (q[c] / ROTATION_RANGE) * 0.5f + 0.5f;
+		out[word++] = (uint16_t)glm::clamp(normalized * ROTATION_QUANTIZED_MAX + 0.5f, 0.0f, ROTATION_QUANTIZED_MAX);
+	}
+	out[0] |= (uint16_t)((largest >> 1) << 15);
+	out[1] |= (uint16_t)((largest & 1) << 15);
+}
+
+static glm::vec4 decodeRotation(const uint16_t *in)
+{
+	int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+
+	glm::vec4 q;
+	float sum = 0.0f;
+	int word = 0;
+	for (int c = 0; c < 4; ++c) {
+		if (c == largest) {
+			continue;
+		}
+		float normalized = (in[word++] & 0x7fff) / ROTATION_QUANTIZED_MAX;
+		q[c] = (normalized * 2.0f - 1.0f) * ROTATION_RANGE;
+		sum += q[c] * q[c];
+	}
+	q[largest] = sqrt(std::max(0.0f, 1.0f - sum));
+	return q;
+}
+
+static glm::vec4 decodeValue(const CompressedClip &clip, const CompressedTrack &track, int key)
+{
+	const uint16_t *in = &clip.values[(track.firstKey + key) * 3];
+	if (track.path == TRACK_ROTATION) {
+		return decodeRotation(in);
+	}
+	return glm::vec4(track.rangeMin + track.rangeStep * glm::vec3(in[0], in[1], in[2]), 0.0f);
+}
+
+static glm::vec4 interpolate(TrackPath path, const glm::vec4 &value0, const glm::vec4 &value1, float factor)
+{
+	if (path == TRACK_ROTATION) {
+		glm::quat rotation0(value0.w, value0.x, value0.y, value0.z);
+		glm::quat rotation1(value1.w, value1.x, value1.y, value1.z);
+		glm::quat rotation = glm::slerp(rotation0, rotation1, factor);
+		return glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	}
+	return glm::mix(value0, value1, factor);
+}
+
+// Position error caused by replacing value by approximation on joint
+static float keyError(TrackPath path, const glm::vec4 &value, const glm::vec4 &approximation,
+	float parentScale, float reach)
+{
+	if (path == TRACK_TRANSLATION) {
+		return glm::length(glm::vec3(value - approximation)) * parentScale;
+	}
+	if (path == TRACK_ROTATION) {
+		float cosine = std::min(1.0f, (float)fabs(glm::dot(value, approximation)));
+		return 2.0f * acos(cosine) * reach;
+	}
+	glm::vec3 difference = glm::abs(glm::vec3(value - approximation));
+	return std::max(difference.x, std::max(difference.y, difference.z)) * reach;
+}
+
+// Distance from each joint to its farthest descendant in the rest pose, at
+// least its own bone length so that leaves still carry some weight
+static std::vector<float> computeReach(const SkeletonHierarchy &hierarchy,
+	const std::vector<glm::mat4> &globalTransforms)
+{
+	size_t count = hierarchy.nodes.size();
+	std::vector<float> reach(count, 0.0f);
+
+	for (size_t j = 0; j < count; ++j) {
+		int parent = hierarchy.parents[j];
+		if (parent < 0) {
+			continue;
+		}
+		glm::vec3 position(globalTransforms[j][3]);
+		reach[parent] = std::max(reach[parent], glm::length(position - glm::vec3(globalTransforms[parent][3])));
+
+		// Walk up: every ancestor reaches this joint too
+		for (int ancestor = hierarchy.parents[parent]; ancestor >= 0; ancestor = hierarchy.parents[ancestor]) {
+			float distance = glm::length(position - glm::vec3(globalTransforms[ancestor][3]));
+			reach[ancestor] = std::max(reach[ancestor], distance);
+		}
+	}
+
+	for (size_t j = 0; j < count; ++j) {
+		int parent = hierarchy.parents[j];
+		if (reach[j] == 0.0f && parent >= 0) {
+			reach[j] = glm::length(glm::vec3(globalTransforms[j][3] - globalTransforms[parent][3]));
+		}
+	}
+	return reach;
+}
+
+// Greedily extend each segment while interpolating its end keys reproduces
+// every key in between within the tolerance
+static std::vector<int> reduceKeys(const AnimationClip &clip, const AnimationTrack &track,
+	float tolerance, float parentScale, float reach)
+{
+	const float *times = &clip.times[track.firstKey];
+	const glm::vec4 *values = &clip.values[track.firstKey];
+
+	std::vector<int> kept(1, 0);
+	int start = 0;
+	while (start < track.keyCount - 1) {
+		int end = start + 1;
+		while (end + 1 < track.keyCount) {
+			int candidate = end + 1;
+			bool fits = true;
+			for (int k = start + 1; k < candidate && fits; ++k) {
+				glm::vec4 approximation = values[start];
+				if (track.interpolation == INTERPOLATION_LINEAR) {
+					float factor = (times[k] - times[start]) / (times[candidate] - times[start]);
+					approximation = interpolate(track.path, values[start], values[candidate], factor);
+				}
+				fits = keyError(track.path, values[k], approximation, parentScale, reach) <= tolerance;
+			}
+			if (!fits) {
+				break;
+			}
+			end = candidate;
+		}
+		kept.push_back(end);
+		start = end;
+	}
+
+	// A constant track needs one key only
+	if (kept.size() == 2 && keyError(track.path, values[kept[0]], values[kept[1]], parentScale, reach) <= tolerance) {
+		kept.pop_back();
+	}
+	return kept;
+}
+
+CompressedClip compressAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	float tolerance)
+{
+	std::vector<glm::mat4> globalTransforms;
+	computeGlobalTransforms(hierarchy, hierarchy.restTransforms, globalTransforms);
+	std::vector<float> reach = computeReach(hierarchy, globalTransforms);
+
+	CompressedClip compressed;
+	compressed.duration = clip.duration;
+	float timeStep = clip.duration > 0.0f ? clip.duration / QUANTIZED_MAX : 0.0f;
+
+	for (size_t i = 0; i < clip.tracks.size(); ++i) {
+		const AnimationTrack &track = clip.tracks[i];
+		int parent = hierarchy.parents[track.target];
+		float parentScale = 1.0f;
+		if (parent >= 0) {
+			const glm::mat4 &m = globalTransforms[parent];
+			parentScale = std::max(glm::length(glm::vec3(m[0])),
+				std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+		}
+
+		std::vector<int> kept;
+		if (track.keyCount > 0) {
+			kept = reduceKeys(clip, track, tolerance, parentScale, reach[track.target]);
+		}
+
+		CompressedTrack compressedTrack;
+		compressedTrack.path = track.path;
+		compressedTrack.interpolation = track.interpolation;
+		compressedTrack.target = track.target;
+		compressedTrack.firstKey = (int)compressed.times.size();
+		compressedTrack.keyCount = (int)kept.size();
+		compressedTrack.rangeMin = glm::vec3(0.0f);
+		compressedTrack.rangeStep = glm::vec3(0.0f);
+
+		const glm::vec4 *values = &clip.values[track.firstKey];
+		if (track.path != TRACK_ROTATION && !kept.empty()) {
+			glm::vec3 minimum(values[kept[0]]), maximum(values[kept[0]]);
+			for (size_t k = 1; k < kept.size(); ++k) {
+				minimum = glm::min(minimum, glm::vec3(values[kept[k]]));
+				maximum = glm::max(maximum, glm::vec3(values[kept[k]]));
+			}
+			compressedTrack.rangeMin = minimum;
+			compressedTrack.rangeStep = (maximum - minimum) / QUANTIZED_MAX;
+		}
+
+		for (size_t k = 0; k < kept.size(); ++k) {
+			compressed.times.push_back(quantize(clip.times[track.firstKey + kept[k]], 0.0f, timeStep));
+
+			uint16_t words[3];
+			const glm::vec4 &value = values[kept[k]];
+			if (track.path == TRACK_ROTATION) {
+				encodeRotation(value, words);
+			} else {
+				for (int c = 0; c < 3; ++c) {
+					words[c] = quantize(value[c], compressedTrack.rangeMin[c], compressedTrack.rangeStep[c]);
+				}
+			}
+			compressed.values.insert(compressed.values.end(), words, words + 3);
+		}
+
+		compressed.tracks.push_back(compressedTrack);
+	}
+
+	return compressed;
+}
+
+size_t animationClipBytes(const AnimationClip &clip)
+{
+	return clip.tracks.size() * sizeof(AnimationTrack) + clip.times.size() * sizeof(float) +
+		clip.values.size() * sizeof(glm::vec4);
+}
+
+size_t compressedClipBytes(const CompressedClip &clip)
+{
+	return clip.tracks.size() * sizeof(CompressedTrack) + clip.times.size() * sizeof(uint16_t) +
+		clip.values.size() * sizeof(uint16_t);
+}
+
+// Find k such that times[k] <= time < times[k + 1], stepping from the cursor
+static int findKey(const uint16_t *times, int count, float time, KeyframeCursor &cursor)
+{
+	int last = count - 2;
+	int index = cursor.index;
+	if (index < 0 || index > last) {
+		index = 0;
+	}
+
+	bool search = time < times[index];
+	for (int steps = 0; !search && index < last && times[index + 1] <= time; ++steps) {
+		if (steps == MAX_CURSOR_STEPS) {
+			search = true;
+		} else {
+			++index;
+		}
+	}
+
+	if (search) {
+		// Time wrapped or jumped: bisect, comparing in quantized units
+		const uint16_t *upper = std::upper_bound(times, times + count, (uint16_t)std::min(time, QUANTIZED_MAX));
+		index = glm::clamp((int)(upper - times) - 1, 0, last);
+	}
+
+	cursor.index = index;
+	return index;
+}
+
+static glm::vec4 sampleTrack(const CompressedClip &clip, const CompressedTrack &track,
+	float quantizedTime, KeyframeCursor &cursor)
+{
+	if (track.keyCount < 2) {
+		return decodeValue(clip, track, 0);
+	}
+
+	const uint16_t *times = &clip.times[track.firstKey];
+	int k = findKey(times, track.keyCount, quantizedTime, cursor);
+
+	float span = (float)(times[k + 1] - times[k]);
+	float factor = span > 0.0f ? glm::clamp((quantizedTime - times[k]) / span, 0.0f, 1.0f) : 0.0f;
+	if (track.interpolation == INTERPOLATION_STEP) {
+		return decodeValue(clip, track, factor < 1.0f ? k : k + 1);
+	}
+	return interpolate(track.path, decodeValue(clip, track, k), decodeValue(clip, track, k + 1), factor);
+}
+
+void sampleAnimation(const CompressedClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<KeyframeCursor> &cursors,
+	std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty)
+{
+	float animationTime = clip.duration > 0.0f ? fmod(time, clip.duration) : 0.0f;
+	float quantizedTime = clip.duration > 0.0f ? animationTime / clip.duration * QUANTIZED_MAX : 0.0f;
+
+	size_t i = 0;
+	while (i < clip.tracks.size()) {
+		int joint = clip.tracks[i].target;
+		glm::vec3 translation = hierarchy.restTranslations[joint];
+		glm::quat rotation = hierarchy.restRotations[joint];
+		glm::vec3 scale = hierarchy.restScales[joint];
+
+		// All tracks of this joint are adjacent
+		for (; i < clip.tracks.size() && clip.tracks[i].target == joint; ++i) {
+			const CompressedTrack &track = clip.tracks[i];
+			if (track.keyCount == 0) {
+				continue;
+			}
+			glm::vec4 value = sampleTrack(clip, track, quantizedTime, cursors[i]);
+			if (track.path == TRACK_TRANSLATION) {
+				translation = glm::vec3(value);
+			} else if (track.path == TRACK_ROTATION) {
+				rotation = glm::quat(value.w, value.x, value.y, value.z);
+			} else {
+				scale = glm::vec3(value);
+			}
+		}
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation);
+		transform *= glm::mat4_cast(rotation);
+		transform = glm::scale(transform, scale);
+		if (dirty != NULL && transform != localTransforms[joint]) {
+			(*dirty)[joint] = 1;
+		}
+		localTransforms[joint] = transform;
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef _COMPRESSION_H_
+#define _COMPRESSION_H_
+
+#include "animation.h"
+#include "skeleton.h"
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// One track of a compressed clip. Keys that interpolation between their
+// neighbours reproduces within the tolerance are removed, and the rest are
+// quantized to 16 bits per component: times over the clip duration,
+// translations and scales over the track's own range, and rotations as the
+// three smallest quaternion components (48 bits per key).
+struct CompressedTrack {
+	TrackPath path;
+	TrackInterpolation interpolation;
+	int target;				// Joint index in the SkeletonHierarchy
+	int firstKey;			// Into times; values hold three entries per key
+	int keyCount;
+	glm::vec3 rangeMin;		// Translation and scale dequantization
+	glm::vec3 rangeStep;
+};
+
+struct CompressedClip {
+	std::vector<CompressedTrack> tracks;	// Same order as the source clip
+	std::vector<uint16_t> times;
+	std::vector<uint16_t> values;
+	float duration;
+};
+
+// tolerance is the largest position error a removed key may cause, in
+// model units. Rotation and scale errors are converted to position errors
+// using each joint's reach, the distance to its farthest descendant.
+CompressedClip compressAnimation(const AnimationClip &clip, const SkeletonHierarchy &hierarchy,
+	float tolerance);
+
+// Resident size of the key data, tables included
+size_t animationClipBytes(const AnimationClip &clip);
+size_t compressedClipBytes(const CompressedClip &clip);
+
+// Same as sampleAnimation for an uncompressed clip, decoding only the keys
+// around the sampled time
+void sampleAnimation(const CompressedClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<KeyframeCursor> &cursors,
+	std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty = NULL);
+
+#endif
@@ -0,0 +1,125 @@
+#include "resample.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <math.h>
+
+UniformClip resampleAnimation(const AnimationClip &clip, float frameRate)
+{
+	UniformClip uniform;
+	uniform.duration = clip.duration;
+
+	// At least the two end frames, so a sample always has a next frame
+	int intervals = std::max((int)ceil(clip.duration * frameRate - 1e-3f), 1);
+	uniform.frameCount = intervals + 1;
+	uniform.frameRate = clip.duration > 0.0f ? intervals / clip.duration : 0.0f;
+
+	for (size_t i = 0; i < clip.tracks.size(); ++i) {
+		UniformTrack track;
+		track.path = clip.tracks[i].path;
+		track.interpolation = clip.tracks[i].interpolation;
+		track.target = clip.tracks[i].target;
+		uniform.tracks.push_back(track);
+	}
+
+	size_t trackCount = clip.tracks.size();
+	uniform.values.resize(uniform.frameCount * trackCount);
+	std::vector<KeyframeCursor> cursors(trackCount);
+	for (int f = 0; f < uniform.frameCount; ++f) {
+		// The last frame is the end of the clip, not the wrapped start
+		float time = f == intervals ? clip.duration : f / uniform.frameRate;
+		glm::vec4 *row = &uniform.values[f * trackCount];
+
+		for (size_t i = 0; i < trackCount; ++i) {
+			const AnimationTrack &track = clip.tracks[i];
+			glm::vec4 value = sampleTrack(clip, track, time, cursors[i]);
+			if (track.path == TRACK_ROTATION && f > 0 && glm::dot(value, row[i - trackCount]) < 0.0f) {
+				value = -value;
+			}
+			row[i] = value;
+		}
+	}
+
+	return uniform;
+}
+
+size_t uniformClipBytes(const UniformClip &clip)
+{
+	return clip.tracks.size() * sizeof(UniformTrack) + clip.values.size() * sizeof(glm::vec4);
+}
+
+float resampleError(const UniformClip &uniform, const AnimationClip &clip,
+	const SkeletonHierarchy &hierarchy, int samplesPerFrame)
+{
+	std::vector<KeyframeCursor> cursors(clip.tracks.size());
+	std::vector<glm::mat4> local = hierarchy.restTransforms, uniformLocal = hierarchy.restTransforms;
+	std::vector<glm::mat4> global, uniformGlobal;
+
+	float maxError = 0.0f;
+	int samples = (uniform.frameCount - 1) * samplesPerFrame;
+	for (int s = 0; s < samples; ++s) {
+		float time = uniform.duration * s / samples;
+		sampleAnimation(clip, hierarchy, time, cursors, local);
+		sampleAnimation(uniform, hierarchy, time, uniformLocal);
+		computeGlobalTransforms(hierarchy, local, global);
+		computeGlobalTransforms(hierarchy, uniformLocal, uniformGlobal);
+
+		for (size_t j = 0; j < global.size(); ++j) {
+			maxError = std::max(maxError, glm::length(glm::vec3(uniformGlobal[j][3] - global[j][3])));
+		}
+	}
+	return maxError;
+}
+
+void sampleAnimation(const UniformClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty)
+{
+	if (clip.tracks.empty()) {
+		return;
+	}
+
+	float animationTime = clip.duration > 0.0f ? fmod(time, clip.duration) : 0.0f;
+
+	// The frame before the time and the blend towards the next
+	float position = animationTime * clip.frameRate;
+	int frame = std::min((int)position, clip.frameCount - 2);
+	float factor = glm::clamp(position - frame, 0.0f, 1.0f);
+
+	size_t trackCount = clip.tracks.size();
+	const glm::vec4 *row0 = &clip.values[frame * trackCount];
+	const glm::vec4 *row1 = row0 + trackCount;
+
+	size_t i = 0;
+	while (i < trackCount) {
+		int joint = clip.tracks[i].target;
+		glm::vec3 translation = hierarchy.restTranslations[joint];
+		glm::quat rotation = hierarchy.restRotations[joint];
+		glm::vec3 scale = hierarchy.restScales[joint];
+
+		// All tracks of this joint are adjacent
+		for (; i < trackCount && clip.tracks[i].target == joint; ++i) {
+			const UniformTrack &track = clip.tracks[i];
+			glm::vec4 value = track.interpolation == INTERPOLATION_STEP ? row0[i]
+				: glm::mix(row0[i], row1[i], factor);
+			if (track.path == TRACK_TRANSLATION) {
+				translation = glm::vec3(value);
+			} else if (track.path == TRACK_ROTATION) {
+				value = glm::normalize(value);
+				rotation = glm::quat(value.w, value.x, value.y, value.z);
+			} else {
+				scale = glm::vec3(value);
+			}
+		}
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation);
+		transform *= glm::mat4_cast(rotation);
+		transform = glm::scale(transform, scale);
+		if (dirty != NULL && transform != localTransforms[joint]) {
+			(*dirty)[joint] = 1;
+		}
+		localTransforms[joint] = transform;
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include "animation.h"
+#include "skeleton.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// One track of a uniform clip, with its values in column track of each
+// frame of UniformClip::values
+struct UniformTrack {
+	TrackPath path;
+	TrackInterpolation interpolation;
+	int target;				// Joint index in the SkeletonHierarchy
+};
+
+// A clip resampled onto a uniform time grid. Frame f lies at f / frameRate
+// and holds one value per track, so sampling computes the frame index from
+// the time directly and blends two adjacent rows: no key search, no cursors.
+struct UniformClip {
+	std::vector<UniformTrack> tracks;	// Same order as the source clip
+	std::vector<glm::vec4> values;		// frameCount rows of tracks.size() values
+	float frameRate;
+	int frameCount;						// The first and last frames are at 0 and duration
+	float duration;
+};
+
+// Sample every track of the clip at about frameRate frames per second. The
+// rate is adjusted so the frames span the duration exactly. Rotations of
+// adjacent frames are kept in the same hemisphere, so that the normalized
+// lerp used for playback takes the short way round.
+UniformClip resampleAnimation(const AnimationClip &clip, float frameRate);
+
+// Resident size of the frames and the track table
+size_t uniformClipBytes(const UniformClip &clip);
+
+// Largest distance between a joint's model space position sampled from
+// the uniform clip and from its source, over samplesPerFrame times in each
+// frame interval of the grid. Midpoints between frames are where the
+// resampling error peaks.
+float resampleError(const UniformClip &uniform, const AnimationClip &clip,
+	const SkeletonHierarchy &hierarchy, int samplesPerFrame);
+
+// Same as sampleAnimation for a keyframed clip. Rotations are blended with
+// a normalized lerp, which between frames this close differs from the slerp
+// far less than the resampling itself; step tracks hold the earlier frame.
+void sampleAnimation(const UniformClip &clip, const SkeletonHierarchy &hierarchy,
+	float time, std::vector<glm::mat4> &localTransforms,
+	std::vector<unsigned char> *dirty = NULL);
+
+#endif
@@ -0,0 +1,167 @@
+#include "skeleton.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <tiny_gltf.h>
+
+glm::mat4 getNodeTransform(const tinygltf::Model &model, int nodeIndex)
+{
+	const tinygltf::Node &node = model.nodes[nodeIndex];
+	glm::mat4 transform(1.0f);
+
+	if (node.matrix.size() == 16) {
+		transform = glm::make_mat4(node.matrix.data());
+	} else {
+		if (node.translation.size() == 3) {
+			transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+		}
+		if (node.rotation.size() == 4) {
+			glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+			transform *= glm::mat4_cast(q);
+		}
+		if (node.scale.size() == 3) {
+			transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+		}
+	}
+	return transform;
+}
+
+SkeletonHierarchy buildSkeletonHierarchy(const tinygltf::Model &model, const std::vector<int> &roots)
+{
+	SkeletonHierarchy hierarchy;
+	hierarchy.jointOfNode.assign(model.nodes.size(), -1);
+
+	// Breadth-first order guarantees parents are visited before children
+	for (int root : roots) {
+		hierarchy.nodes.push_back(root);
+		hierarchy.parents.push_back(-1);
+		hierarchy.jointOfNode[root] = (int)hierarchy.nodes.size() - 1;
+	}
+	for (size_t j = 0; j < hierarchy.nodes.size(); ++j) {
+		const tinygltf::Node &node = model.nodes[hierarchy.nodes[j]];
+		for (int child : node.children) {
+			assert(hierarchy.jointOfNode[child] == -1);
+			hierarchy.nodes.push_back(child);
+			hierarchy.parents.push_back((int)j);
+			hierarchy.jointOfNode[child] = (int)hierarchy.nodes.size() - 1;
+		}
+	}
+
+	size_t jointCount = hierarchy.nodes.size();
+	hierarchy.restTransforms.resize(jointCount);
+	hierarchy.restTranslations.resize(jointCount, glm::vec3(0.0f));
+	hierarchy.restRotations.resize(jointCount, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	hierarchy.restScales.resize(jointCount, glm::vec3(1.0f));
+
+	for (size_t j = 0; j < jointCount; ++j) {
+		const tinygltf::Node &node = model.nodes[hierarchy.nodes[j]];
+		hierarchy.restTransforms[j] = getNodeTransform(model, hierarchy.nodes[j]);
+		if (node.translation.size() == 3) {
+			hierarchy.restTranslations[j] = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+		}
+		if (node.rotation.size() == 4) {
+			hierarchy.restRotations[j] = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+		}
+		if (node.scale.size() == 3) {
+			hierarchy.restScales[j] = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+		}
+	}
+
+	hierarchy.isSkinJoint.assign(jointCount, false);
+	for (const auto &skin : model.skins) {
+		std::vector<int> joints(skin.joints.size());
+		for (size_t i = 0; i < skin.joints.size(); ++i) {
+			joints[i] = hierarchy.jointOfNode[skin.joints[i]];
+			if (joints[i] >= 0) {
+				hierarchy.isSkinJoint[joints[i]] = true;
+			}
+		}
+		hierarchy.skinJoints.push_back(joints);
+	}
+
+	return hierarchy;
+}
+
+SkeletonHierarchy buildSkeletonHierarchy(const tinygltf::Model &model)
+{
+	std::vector<int> roots;
+	if (model.defaultScene >= 0 && model.defaultScene < (int)model.scenes.size()) {
+		roots = model.scenes[model.defaultScene].nodes;
+	} else {
+		// No scene, start from every node that is nobody's child
+		std::vector<bool> isChild(model.nodes.size(), false);
+		for (const auto &node : model.nodes) {
+			for (int child : node.children) {
+				isChild[child] = true;
+			}
+		}
+		for (size_t i = 0; i < model.nodes.size(); ++i) {
+			if (!isChild[i]) {
+				roots.push_back((int)i);
+			}
+		}
+	}
+	return buildSkeletonHierarchy(model, roots);
+}
+
+int findSkinRoot(const tinygltf::Model &model, const tinygltf::Skin &skin)
+{
+	if (skin.skeleton >= 0) {
+		return skin.skeleton;
+	}
+
+	std::vector<bool> hasJointParent(model.nodes.size(), false);
+	for (int joint : skin.joints) {
+		for (int child : model.nodes[joint].children) {
+			hasJointParent[child] = true;
+		}
+	}
+	for (int joint : skin.joints) {
+		if (!hasJointParent[joint]) {
+			return joint;
+		}
+	}
+	return skin.joints.empty() ? -1 : skin.joints[0];
+}
+
+void computeGlobalTransforms(const SkeletonHierarchy &hierarchy,
+	const std::vector<glm::mat4> &localTransforms,
+	std::vector<glm::mat4> &globalTransforms)
+{
+	size_t jointCount = hierarchy.parents.size();
+	globalTransforms.resize(jointCount);
+
+	const int *parents = hierarchy.parents.data();
+	const glm::mat4 *local = localTransforms.data();
+	glm::mat4 *global = globalTransforms.data();
+	for (size_t j = 0; j < jointCount; ++j) {
+		global[j] = parents[j] < 0 ? local[j] : global[parents[j]] * local[j];
+	}
+}
+
+int updateGlobalTransforms(const SkeletonHierarchy &hierarchy,
+	const std::vector<glm::mat4> &localTransforms,
+	std::vector<glm::mat4> &globalTransforms,
+	std::vector<unsigned char> &dirty)
+{
+	size_t jointCount = hierarchy.parents.size();
+	globalTransforms.resize(jointCount);
+
+	// Parents come first, so a dirty parent has already flagged its
+	// children by the time they are visited
+	const int *parents = hierarchy.parents.data();
+	const glm::mat4 *local = localTransforms.data();
+	glm::mat4 *global = globalTransforms.data();
+	int updated = 0;
+	for (size_t j = 0; j < jointCount; ++j) {
+		int parent = parents[j];
+		if (parent >= 0 && dirty[parent]) {
+			dirty[j] = 1;
+		}
+		if (dirty[j]) {
+			global[j] = parent < 0 ? local[j] : global[parent] * local[j];
+			++updated;
+		}
+	}
+	return updated;
+}
@@ -0,0 +1,60 @@
+#ifndef _SKELETON_H_
+#define _SKELETON_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+namespace tinygltf {
+	class Model;
+	struct Skin;
+}
+
+// glTF node hierarchy flattened at load time. Joints are stored so that
+// every parent comes before its children, which turns the global transform
+// computation into one linear pass with no recursion. All per-joint arrays
+// (rest pose, local and global transforms) use this joint order.
+struct SkeletonHierarchy {
+	std::vector<int> nodes;					// glTF node index of each joint
+	std::vector<int> parents;				// Joint index of the parent, -1 for roots
+	std::vector<int> jointOfNode;			// Inverse of nodes, -1 for nodes outside the hierarchy
+
+	// Rest pose. The TRS parts are what animation tracks override, the
+	// matrix is used as is for joints that are not animated.
+	std::vector<glm::mat4> restTransforms;
+	std::vector<glm::vec3> restTranslations;
+	std::vector<glm::quat> restRotations;
+	std::vector<glm::vec3> restScales;
+
+	// For each glTF skin, the joint index of each of its joints
+	std::vector<std::vector<int> > skinJoints;
+	std::vector<bool> isSkinJoint;
+};
+
+// Build the hierarchy below the given root nodes; their own parents, if
+// any, are ignored
+SkeletonHierarchy buildSkeletonHierarchy(const tinygltf::Model &model, const std::vector<int> &roots);
+
+// Build the hierarchy of the default scene
+SkeletonHierarchy buildSkeletonHierarchy(const tinygltf::Model &model);
+
+// The node every joint of the skin descends from
+int findSkinRoot(const tinygltf::Model &model, const tinygltf::Skin &skin);
+
+glm::mat4 getNodeTransform(const tinygltf::Model &model, int nodeIndex);
+
+void computeGlobalTransforms(const SkeletonHierarchy &hierarchy,
+	const std::vector<glm::mat4> &localTransforms,
+	std::vector<glm::mat4> &globalTransforms);
+
+// Incremental version: only joints flagged in dirty, whose local transform
+// changed, and their descendants are recomputed. On return dirty flags
+// every joint whose global transform changed; the caller clears it once
+// everything derived from those joints is updated. Returns the number of
+// recomputed joints.
+int updateGlobalTransforms(const SkeletonHierarchy &hierarchy,
+	const std::vector<glm::mat4> &localTransforms,
+	std::vector<glm::mat4> &globalTransforms,
+	std::vector<unsigned char> &dirty);
+
+#endif
@@ -0,0 +1,388 @@
+#include "skinning.h"
+
+#include <jobs/job_system.h>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SKINNING_SSE
+#endif
+
+// Read one component of an accessor element as float, converting integer
+// types and applying normalization as glTF specifies
+static float readComponent(const unsigned char *ptr, int componentType, bool normalized)
+{
+	switch (componentType) {
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return normalized ? *ptr / 255.0f : (float)*ptr;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+		unsigned short v;
+		memcpy(&v, ptr, sizeof(v));
+		return normalized ? v / 65535.0f : (float)v;
+	}
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+		unsigned int v;
+		memcpy(&v, ptr, sizeof(v));
+		return (float)v;
+	}
+	default: {
+		float v;
+		memcpy(&v, ptr, sizeof(v));
+		return v;
+	}
+	}
+}
+
+// Normal matrix of an affine joint or blend of joints: the cofactor matrix,
+// which is the inverse transpose scaled by the determinant. The bot's skin
+// has non-uniform scale, so the upper 3x3 alone would skew the normals.
+static glm::mat3 normalMatrix(const glm::mat3 &m)
+{
+	return glm::mat3(glm::cross(m[1], m[2]), glm::cross(m[2], m[0]), glm::cross(m[0], m[1]));
+}
+
+void readVec4Accessor(const tinygltf::Model &model, int accessorIndex,
+	const glm::vec4 &fill, std::vector<glm::vec4> &out)
+{
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+
+	int components = tinygltf::GetNumComponentsInType(accessor.type);
+	int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+	int stride = accessor.ByteStride(bufferView);
+	const unsigned char *ptr = &buffer.data[bufferView.byteOffset + accessor.byteOffset];
+
+	out.resize(accessor.count);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		glm::vec4 v = fill;
+		for (int c = 0; c < components && c < 4; ++c) {
+			v[c] = readComponent(ptr + i * stride + c * componentSize, accessor.componentType, accessor.normalized);
+		}
+		out[i] = v;
+	}
+}
+
+std::vector<glm::mat4> loadInverseBindMatrices(const tinygltf::Model &model, const tinygltf::Skin &skin)
+{
+	std::vector<glm::mat4> inverseBindMatrices(skin.joints.size(), glm::mat4(1.0f));
+	if (skin.inverseBindMatrices < 0) {
+		return inverseBindMatrices;
+	}
+
+	const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
+	assert(accessor.type == TINYGLTF_TYPE_MAT4);
+	assert(skin.joints.size() == accessor.count);
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+	const unsigned char *ptr = buffer.data.data() + accessor.byteOffset + bufferView.byteOffset;
+
+	for (size_t j = 0; j < accessor.count; j++) {
+		float m[16];
+		memcpy(m, ptr + j * 16 * sizeof(float), 16 * sizeof(float));
+		inverseBindMatrices[j] = glm::make_mat4(m);
+	}
+	return inverseBindMatrices;
+}
+
+void computeJointMatrices(const SkeletonHierarchy &hierarchy, int skinIndex,
+	const std::vector<glm::mat4> &globalTransforms,
+	const std::vector<glm::mat4> &inverseBindMatrices,
+	std::vector<glm::mat4> &jointMatrices)
+{
+	const std::vector<int> &joints = hierarchy.skinJoints[skinIndex];
+	jointMatrices.resize(joints.size());
+	for (size_t j = 0; j < joints.size(); ++j) {
+		jointMatrices[j] = globalTransforms[joints[j]] * inverseBindMatrices[j];
+	}
+}
+
+int paletteTexelsPerJoint(PaletteEncoding encoding)
+{
+	switch (encoding) {
+	case PALETTE_MAT3X4:
+		return 3;
+	case PALETTE_DUAL_QUATERNION:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+const char *paletteEncodingName(PaletteEncoding encoding)
+{
+	switch (encoding) {
+	case PALETTE_MAT3X4:
+		return "mat3x4";
+	case PALETTE_DUAL_QUATERNION:
+		return "dual quaternion";
+	default:
+		return "mat4";
+	}
+}
+
+glm::mat4 computeSkinSpace(const SkeletonHierarchy &hierarchy, int skinIndex,
+	const std::vector<glm::mat4> &globalTransforms)
+{
+	// Joints are stored parent-first, so the root has the lowest index
+	const std::vector<int> &joints = hierarchy.skinJoints[skinIndex];
+	if (joints.empty()) {
+		return glm::mat4(1.0f);
+	}
+	int root = *std::min_element(joints.begin(), joints.end());
+	int parent = hierarchy.parents[root];
+	return parent >= 0 ? globalTransforms[parent] : glm::mat4(1.0f);
+}
+
+void encodePalette(const std::vector<glm::mat4> &jointMatrices, PaletteEncoding encoding,
+	std::vector<glm::vec4> &texels)
+{
+	int texelsPerJoint = paletteTexelsPerJoint(encoding);
+	texels.resize(jointMatrices.size() * texelsPerJoint);
+
+	for (size_t j = 0; j < jointMatrices.size(); ++j) {
+		encodePaletteJoint(jointMatrices[j], encoding, &texels[j * texelsPerJoint]);
+	}
+}
+
+void encodePaletteJoint(const glm::mat4 &m, PaletteEncoding encoding, glm::vec4 *out)
+{
+	if (encoding == PALETTE_MAT4) {
+		out[0] = m[0];
+		out[1] = m[1];
+		out[2] = m[2];
+		out[3] = m[3];
+	} else if (encoding == PALETTE_MAT3X4) {
+		// The last row is always (0, 0, 0, 1)
+		out[0] = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+		out[1] = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+		out[2] = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	} else {
+		// Strip any leftover scale before extracting the rotation
+		glm::mat3 rotation(glm::normalize(glm::vec3(m[0])),
+			glm::normalize(glm::vec3(m[1])),
+			glm::normalize(glm::vec3(m[2])));
+		glm::quat real = glm::normalize(glm::quat_cast(rotation));
+		glm::quat dual = glm::quat(0.0f, m[3][0], m[3][1], m[3][2]) * real * 0.5f;
+		out[0] = glm::vec4(real.x, real.y, real.z, real.w);
+		out[1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+	}
+}
+
+void blendPalette(const std::vector<glm::vec4> &from, const std::vector<glm::vec4> &to,
+	PaletteEncoding encoding, float factor, std::vector<glm::vec4> &out)
+{
+	out.resize(to.size());
+	if (encoding != PALETTE_DUAL_QUATERNION) {
+		for (size_t i = 0; i < to.size(); ++i) {
+			out[i] = glm::mix(from[i], to[i], factor);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < to.size(); i += 2) {
+		float sign = glm::dot(from[i], to[i]) < 0.0f ? -1.0f : 1.0f;
+		out[i] = glm::mix(from[i], to[i] * sign, factor);
+		out[i + 1] = glm::mix(from[i + 1], to[i + 1] * sign, factor);
+	}
+}
+
+void skinVerticesEncoded(const SkinnedMesh &mesh, const std::vector<glm::vec4> &texels,
+	PaletteEncoding encoding, const glm::mat4 &skinSpace,
+	SkinnedVertices &out, size_t begin, size_t end)
+{
+	int texelsPerJoint = paletteTexelsPerJoint(encoding);
+
+	if (encoding != PALETTE_DUAL_QUATERNION) {
+		for (size_t i = begin; i < end; ++i) {
+			glm::mat4 skin(0.0f);
+			for (int k = 0; k < 4; ++k) {
+				const glm::vec4 *t = &texels[mesh.joints[i][k] * texelsPerJoint];
+				glm::mat4 m = encoding == PALETTE_MAT4 ? glm::mat4(t[0], t[1], t[2], t[3]) :
+					glm::transpose(glm::mat4(t[0], t[1], t[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+				skin += mesh.weights[i][k] * m;
+			}
+			out.positions[i] = skin * mesh.positions[i];
+			out.normals[i] = glm::vec4(glm::normalize(normalMatrix(glm::mat3(skin)) * glm::vec3(mesh.normals[i])), 0.0f);
+		}
+		return;
+	}
+
+	glm::mat4 skinSpaceInverse = glm::inverse(skinSpace);
+	glm::mat3 normalToSkin = glm::transpose(glm::mat3(skinSpace));
+	glm::mat3 normalFromSkin = glm::transpose(glm::mat3(skinSpaceInverse));
+
+	for (size_t i = begin; i < end; ++i) {
+		// Blend in the hemisphere of the first joint to avoid flipping
+		glm::vec4 real0 = texels[mesh.joints[i][0] * 2];
+		glm::vec4 real(0.0f), dual(0.0f);
+		for (int k = 0; k < 4; ++k) {
+			const glm::vec4 *t = &texels[mesh.joints[i][k] * 2];
+			float weight = glm::dot(real0, t[0]) < 0.0f ? -mesh.weights[i][k] : mesh.weights[i][k];
+			real += weight * t[0];
+			dual += weight * t[1];
+		}
+		float length = glm::length(real);
+		real /= length;
+		dual /= length;
+
+		glm::vec3 r(real), d(dual);
+		glm::vec3 p(skinSpaceInverse * mesh.positions[i]);
+		glm::vec3 n = normalToSkin * glm::vec3(mesh.normals[i]);
+
+		p += 2.0f * glm::cross(r, glm::cross(r, p) + real.w * p) +
+			2.0f * (real.w * d - dual.w * r + glm::cross(r, d));
+		n += 2.0f * glm::cross(r, glm::cross(r, n) + real.w * n);
+
+		out.positions[i] = skinSpace * glm::vec4(p, 1.0f);
+		out.normals[i] = glm::vec4(glm::normalize(normalFromSkin * n), 0.0f);
+	}
+}
+
+bool loadSkinnedMesh(const tinygltf::Model &model, const tinygltf::Primitive &primitive, SkinnedMesh &mesh)
+{
+	const char *required[] = { "POSITION", "NORMAL", "JOINTS_0", "WEIGHTS_0" };
+	for (const char *name : required) {
+		if (primitive.attributes.find(name) == primitive.attributes.end()) {
+			return false;
+		}
+	}
+
+	readVec4Accessor(model, primitive.attributes.at("POSITION"), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), mesh.positions);
+	readVec4Accessor(model, primitive.attributes.at("NORMAL"), glm::vec4(0.0f), mesh.normals);
+	readVec4Accessor(model, primitive.attributes.at("WEIGHTS_0"), glm::vec4(0.0f), mesh.weights);
+
+	std::vector<glm::vec4> joints;
+	readVec4Accessor(model, primitive.attributes.at("JOINTS_0"), glm::vec4(0.0f), joints);
+	mesh.joints.resize(joints.size());
+	for (size_t i = 0; i < joints.size(); ++i) {
+		mesh.joints[i] = glm::u16vec4(joints[i]);
+	}
+
+	return true;
+}
+
+void skinVerticesReference(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i) {
+		const glm::u16vec4 &j = mesh.joints[i];
+		const glm::vec4 &w = mesh.weights[i];
+
+		glm::mat4 skinMatrix =
+			w.x * jointMatrices[j.x] +
+			w.y * jointMatrices[j.y] +
+			w.z * jointMatrices[j.z] +
+			w.w * jointMatrices[j.w];
+
+		out.positions[i] = skinMatrix * mesh.positions[i];
+		glm::vec3 normal = normalMatrix(glm::mat3(skinMatrix)) * glm::vec3(mesh.normals[i]);
+		out.normals[i] = glm::vec4(glm::normalize(normal), 0.0f);
+	}
+}
+
+#ifdef SKINNING_SSE
+
+// Cross product of the xyz parts, w of the result is zero
+static inline __m128 cross(__m128 a, __m128 b)
+{
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+void skinVerticesSIMD(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, size_t begin, size_t end)
+{
+	const float *palette = &jointMatrices[0][0][0];
+	const float *positions = &mesh.positions[0][0];
+	const float *normals = &mesh.normals[0][0];
+	const float *weights = &mesh.weights[0][0];
+	float *outPositions = &out.positions[0][0];
+	float *outNormals = &out.normals[0][0];
+
+	for (size_t i = begin; i < end; ++i) {
+		const glm::u16vec4 &j = mesh.joints[i];
+		const float *m0 = palette + 16 * j.x;
+		const float *m1 = palette + 16 * j.y;
+		const float *m2 = palette + 16 * j.z;
+		const float *m3 = palette + 16 * j.w;
+
+		__m128 w = _mm_loadu_ps(weights + 4 * i);
+		__m128 w0 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 w1 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 w2 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 w3 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3));
+
+		// Blended skin matrix, one column per register
+		__m128 col[4];
+		for (int c = 0; c < 4; ++c) {
+			__m128 sum = _mm_mul_ps(w0, _mm_loadu_ps(m0 + 4 * c));
+			sum = _mm_add_ps(sum, _mm_mul_ps(w1, _mm_loadu_ps(m1 + 4 * c)));
+			sum = _mm_add_ps(sum, _mm_mul_ps(w2, _mm_loadu_ps(m2 + 4 * c)));
+			sum = _mm_add_ps(sum, _mm_mul_ps(w3, _mm_loadu_ps(m3 + 4 * c)));
+			col[c] = sum;
+		}
+
+		__m128 p = _mm_loadu_ps(positions + 4 * i);
+		__m128 result = _mm_mul_ps(col[0], _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm_add_ps(result, _mm_mul_ps(col[1], _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+		result = _mm_add_ps(result, _mm_mul_ps(col[2], _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+		result = _mm_add_ps(result, col[3]);
+		_mm_storeu_ps(outPositions + 4 * i, result);
+
+		// Normals go through the cofactor matrix, see normalMatrix
+		__m128 n = _mm_loadu_ps(normals + 4 * i);
+		__m128 normal = _mm_mul_ps(cross(col[1], col[2]), _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0)));
+		normal = _mm_add_ps(normal, _mm_mul_ps(cross(col[2], col[0]), _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+		normal = _mm_add_ps(normal, _mm_mul_ps(cross(col[0], col[1]), _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		// Normalize the xyz part
+		__m128 sq = _mm_mul_ps(normal, normal);
+		__m128 len = _mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1)));
+		len = _mm_add_ss(len, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 2, 2)));
+		len = _mm_sqrt_ss(len);
+		normal = _mm_div_ps(normal, _mm_shuffle_ps(len, len, _MM_SHUFFLE(0, 0, 0, 0)));
+		_mm_storeu_ps(outNormals + 4 * i, normal);
+	}
+}
+
+#else
+
+void skinVerticesSIMD(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, size_t begin, size_t end)
+{
+	skinVerticesReference(mesh, jointMatrices, out, begin, end);
+}
+
+#endif
+
+void skinMesh(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, JobSystem *jobs)
+{
+	int vertexCount = (int)mesh.positions.size();
+	out.positions.resize(vertexCount);
+	out.normals.resize(vertexCount);
+
+	int threadCount = jobs != NULL ? jobs->threadCount() : 1;
+	int rangeSize = (vertexCount + threadCount - 1) / threadCount;
+	rangeSize = std::max((rangeSize + 15) & ~15, 16);
+	if (rangeSize >= vertexCount) {
+		skinVerticesSIMD(mesh, jointMatrices, out, 0, vertexCount);
+		return;
+	}
+
+	std::function<void(int, int)> skinRange = [&](int begin, int end) {
+		skinVerticesSIMD(mesh, jointMatrices, out, begin, end);
+	};
+	JobCounter counter;
+	jobs->parallelFor(vertexCount, rangeSize, skinRange, counter);
+	jobs->wait(counter);
+}
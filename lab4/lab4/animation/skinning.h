@@ -0,0 +1,108 @@
+#ifndef _SKINNING_H_
+#define _SKINNING_H_
+
+#include "skeleton.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <vector>
+
+struct JobSystem;
+
+namespace tinygltf {
+	class Model;
+	struct Primitive;
+	struct Skin;
+}
+
+// Bind-pose vertex data of one skinned primitive, decoded from its
+// POSITION, NORMAL, JOINTS_0 and WEIGHTS_0 accessors. Positions and normals
+// are padded to vec4 so they can be loaded straight into SSE registers.
+struct SkinnedMesh {
+	std::vector<glm::vec4> positions;	// w = 1
+	std::vector<glm::vec4> normals;		// w = 0
+	std::vector<glm::u16vec4> joints;	// Indices into the skin's joint palette
+	std::vector<glm::vec4> weights;
+};
+
+// Skinned vertices, in the same space as the joint palette
+struct SkinnedVertices {
+	std::vector<glm::vec4> positions;
+	std::vector<glm::vec4> normals;
+};
+
+// Decode an accessor into vec4s, filling missing components from fill.
+// Integer components are converted to float, normalized if the accessor is.
+void readVec4Accessor(const tinygltf::Model &model, int accessorIndex,
+	const glm::vec4 &fill, std::vector<glm::vec4> &out);
+
+std::vector<glm::mat4> loadInverseBindMatrices(const tinygltf::Model &model, const tinygltf::Skin &skin);
+
+// Joint palette of skin skinIndex: global joint transform times inverse bind matrix
+void computeJointMatrices(const SkeletonHierarchy &hierarchy, int skinIndex,
+	const std::vector<glm::mat4> &globalTransforms,
+	const std::vector<glm::mat4> &inverseBindMatrices,
+	std::vector<glm::mat4> &jointMatrices);
+
+// How joint palettes are laid out for the GPU, as RGBA32F texels per joint
+enum PaletteEncoding {
+	PALETTE_MAT4,				// 4 texels, the full matrix by columns
+	PALETTE_MAT3X4,				// 3 texels, the rows of the affine part
+	PALETTE_DUAL_QUATERNION		// 2 texels, real then dual part; rigid joints only
+};
+
+int paletteTexelsPerJoint(PaletteEncoding encoding);
+
+const char *paletteEncodingName(PaletteEncoding encoding);
+
+// Global transform of the parent of the skin's root joint, identity if it
+// has none. Joint matrices conjugated by it, inverse(skinSpace) * M *
+// skinSpace, are rigid even when that parent (a glTF armature node) scales
+// non-uniformly, which makes them suitable for dual quaternions.
+glm::mat4 computeSkinSpace(const SkeletonHierarchy &hierarchy, int skinIndex,
+	const std::vector<glm::mat4> &globalTransforms);
+
+// Pack joint matrices as texels. For dual quaternions the matrices must be
+// rigid; any scale is dropped.
+void encodePalette(const std::vector<glm::mat4> &jointMatrices, PaletteEncoding encoding,
+	std::vector<glm::vec4> &texels);
+
+// Pack a single joint into paletteTexelsPerJoint(encoding) texels
+void encodePaletteJoint(const glm::mat4 &jointMatrix, PaletteEncoding encoding, glm::vec4 *texels);
+
+// Blend two encoded palettes of the same encoding, for a pose between two
+// sampled ones. Matrices are blended linearly, which is close enough for
+// poses a few frames apart; dual quaternions are brought into the same
+// hemisphere first and normalized by the shader.
+void blendPalette(const std::vector<glm::vec4> &from, const std::vector<glm::vec4> &to,
+	PaletteEncoding encoding, float factor, std::vector<glm::vec4> &out);
+
+// Returns false if the primitive is missing one of the skinning attributes
+bool loadSkinnedMesh(const tinygltf::Model &model, const tinygltf::Primitive &primitive, SkinnedMesh &mesh);
+
+// Linear blend skinning of vertices [begin, end) with plain glm math. Slow,
+// but straightforward enough to validate other implementations against.
+void skinVerticesReference(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, size_t begin, size_t end);
+
+// Linear or dual quaternion blend skinning from an encoded palette, with
+// the same math as bot.vert. For dual quaternions the palette holds the
+// conjugated joint matrices and skinSpace maps the result back; it is
+// ignored by the matrix encodings.
+void skinVerticesEncoded(const SkinnedMesh &mesh, const std::vector<glm::vec4> &texels,
+	PaletteEncoding encoding, const glm::mat4 &skinSpace,
+	SkinnedVertices &out, size_t begin, size_t end);
+
+// Same result using SSE: the four joint matrices of a vertex are blended
+// column by column before transforming the position and normal
+void skinVerticesSIMD(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, size_t begin, size_t end);
+
+// Size the output and skin the whole mesh. With a job system the vertices
+// are split into one range per thread, in multiples of 16 vertices so that
+// no two jobs write to the same cache line; without one, or for small
+// meshes, the calling thread skins them all.
+void skinMesh(const SkinnedMesh &mesh, const std::vector<glm::mat4> &jointMatrices,
+	SkinnedVertices &out, JobSystem *jobs = NULL);
+
+#endif
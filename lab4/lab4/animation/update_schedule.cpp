@@ -0,0 +1,39 @@
+#include "update_schedule.h"
+
+#include <math.h>
+
+float scheduleUpdates(const std::vector<float> &screenHeights, float fullRatePixels, float budget,
+	std::vector<int> &intervals)
+{
+	intervals.resize(screenHeights.size());
+
+	float threshold = fullRatePixels;
+	for (;;) {
+		float updates = 0.0f;
+		bool coarsest = true;
+		for (size_t i = 0; i < screenHeights.size(); ++i) {
+			if (screenHeights[i] <= 0.0f) {
+				intervals[i] = 0;
+				continue;
+			}
+
+			// A broken projection gives NaN or infinite heights; never let
+			// them hold up the schedule
+			int interval = isfinite(screenHeights[i]) ? 1 : MAX_UPDATE_INTERVAL;
+			while (interval < MAX_UPDATE_INTERVAL && screenHeights[i] * interval < threshold) {
+				interval *= 2;
+			}
+			intervals[i] = interval;
+			updates += 1.0f / interval;
+			if (interval < MAX_UPDATE_INTERVAL) {
+				coarsest = false;
+			}
+		}
+
+		// Past a finite threshold no height can get coarser
+		if (updates <= budget || coarsest || !isfinite(threshold)) {
+			return updates;
+		}
+		threshold *= 2.0f;
+	}
+}
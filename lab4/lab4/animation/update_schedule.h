@@ -0,0 +1,37 @@
+#ifndef _UPDATE_SCHEDULE_H_
+#define _UPDATE_SCHEDULE_H_
+
+#include <stddef.h>
+#include <vector>
+
+// Animation level of detail: small characters have their pose sampled
+// every 2, 4 or 8 frames instead of every frame, and blend between the
+// two latest samples in between
+static const int MAX_UPDATE_INTERVAL = 8;
+
+// Pick the update interval of each character from its height on screen in
+// pixels: every frame from fullRatePixels up, and half as often each time
+// the height halves. While the updates per frame exceed budget, the full
+// rate height is doubled, down to every character at the lowest rate.
+// Characters of height 0, the culled ones, get interval 0 and cost
+// nothing; NaN or infinite heights get the lowest rate. Returns the
+// average number of updates per frame.
+float scheduleUpdates(const std::vector<float> &screenHeights, float fullRatePixels, float budget,
+	std::vector<int> &intervals);
+
+// Characters are spread over the frames by a phase in
+// [0, MAX_UPDATE_INTERVAL), so those sharing an interval update on
+// different frames
+inline bool isUpdateDue(unsigned int frame, int phase, int interval)
+{
+	return (frame + phase) % interval == 0;
+}
+
+// Frames from this one to the next one the character updates on, at
+// least 1
+inline int framesToUpdate(unsigned int frame, int phase, int interval)
+{
+	return interval - (int)((frame + phase) % interval);
+}
+
+#endif
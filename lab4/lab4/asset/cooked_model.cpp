@@ -0,0 +1,398 @@
+#include "cooked_model.h"
+
+#include <animation/skinning.h>
+
+#include <tiny_gltf.h>
+
+#include <fstream>
+#include <iostream>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char COOKED_MAGIC[4] = { 'C', 'O', 'O', 'K' };
+static const uint32_t COOKED_VERSION = 4;
+static const size_t BLOB_ALIGNMENT = 16;
+
+// Serialization helpers: every table is a count followed by raw elements
+
+struct CookedWriter {
+	std::vector<unsigned char> bytes;
+
+	void write(const void *data, size_t size) {
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		bytes.insert(bytes.end(), p, p + size);
+	}
+
+	template <typename T>
+	void writeValue(const T &value) {
+		write(&value, sizeof(T));
+	}
+
+	template <typename T>
+	void writeVector(const std::vector<T> &values) {
+		writeValue((uint32_t)values.size());
+		if (!values.empty()) {
+			write(&values[0], values.size() * sizeof(T));
+		}
+	}
+};
+
+struct CookedReader {
+	const unsigned char *cursor;
+	const unsigned char *end;
+	bool failed;
+
+	bool read(void *data, size_t size) {
+		if (failed || (size_t)(end - cursor) < size) {
+			failed = true;
+			return false;
+		}
+		memcpy(data, cursor, size);
+		cursor += size;
+		return true;
+	}
+
+	template <typename T>
+	bool readValue(T &value) {
+		return read(&value, sizeof(T));
+	}
+
+	template <typename T>
+	bool readVector(std::vector<T> &values) {
+		uint32_t count = 0;
+		if (!readValue(count) || (size_t)(end - cursor) / sizeof(T) < count) {
+			failed = true;
+			return false;
+		}
+		values.resize(count);
+		return count == 0 || read(&values[0], count * sizeof(T));
+	}
+};
+
+bool cookModel(const tinygltf::Model &model, const char *filename, int packingFlags)
+{
+	PackedMesh mesh = packModelMeshes(model, packingFlags);
+
+	CookedWriter tables;
+	tables.writeValue(mesh.flags);
+	tables.writeVector(mesh.attributes);
+	tables.writeVector(mesh.primitives);
+	tables.writeVector(mesh.lods);
+	tables.writeValue(mesh.vertexStride);
+	tables.writeValue(mesh.vertexCount);
+	tables.writeValue(mesh.indexType);
+
+	// Skeleton, skins and animation, decoded exactly as the glTF path does
+	const SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	tables.writeVector(hierarchy.nodes);
+	tables.writeVector(hierarchy.parents);
+	tables.writeVector(hierarchy.jointOfNode);
+	tables.writeVector(hierarchy.restTransforms);
+	tables.writeVector(hierarchy.restTranslations);
+	tables.writeVector(hierarchy.restRotations);
+	tables.writeVector(hierarchy.restScales);
+	tables.writeValue((uint32_t)hierarchy.skinJoints.size());
+	for (size_t i = 0; i < hierarchy.skinJoints.size(); ++i) {
+		tables.writeVector(hierarchy.skinJoints[i]);
+	}
+	std::vector<unsigned char> isSkinJoint(hierarchy.isSkinJoint.begin(), hierarchy.isSkinJoint.end());
+	tables.writeVector(isSkinJoint);
+
+	tables.writeValue((uint32_t)model.skins.size());
+	for (size_t i = 0; i < model.skins.size(); ++i) {
+		tables.writeVector(loadInverseBindMatrices(model, model.skins[i]));
+	}
+
+	tables.writeValue((uint32_t)model.animations.size());
+	for (size_t i = 0; i < model.animations.size(); ++i) {
+		AnimationClip clip = compileAnimation(model, model.animations[i], hierarchy);
+		tables.writeVector(clip.tracks);
+		tables.writeVector(clip.times);
+		tables.writeVector(clip.values);
+		tables.writeValue(clip.duration);
+	}
+
+	// The blob table goes first; its size is known, so blob offsets can be
+	// made absolute before anything is written
+	size_t headerSize = sizeof(COOKED_MAGIC) + sizeof(COOKED_VERSION) + 2 * sizeof(CookedBlob);
+	CookedBlob blobs[2];
+	const std::vector<unsigned char> *blobData[2] = { &mesh.vertices, &mesh.indices };
+	uint64_t offset = headerSize + tables.bytes.size();
+	for (int i = 0; i < 2; ++i) {
+		blobs[i].offset = (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+		blobs[i].size = blobData[i]->size();
+		offset = blobs[i].offset + blobs[i].size;
+	}
+
+	CookedWriter header;
+	header.write(COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	header.writeValue(COOKED_VERSION);
+	header.write(blobs, sizeof(blobs));
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Failed to write cooked model: " << filename << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(&header.bytes[0]), header.bytes.size());
+	file.write(reinterpret_cast<const char *>(&tables.bytes[0]), tables.bytes.size());
+
+	const char zeros[BLOB_ALIGNMENT] = { 0 };
+	size_t written = header.bytes.size() + tables.bytes.size();
+	for (int i = 0; i < 2; ++i) {
+		file.write(zeros, blobs[i].offset - written);
+		if (!blobData[i]->empty()) {
+			file.write(reinterpret_cast<const char *>(&(*blobData[i])[0]), blobData[i]->size());
+		}
+		written = (size_t)(blobs[i].offset + blobs[i].size);
+	}
+
+	return file.good();
+}
+
+static bool mapFile(const char *filename, CookedModel &cooked)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
+	if (mapping == NULL) {
+		return false;
+	}
+
+	cooked.data = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (cooked.data == NULL) {
+		CloseHandle(mapping);
+		return false;
+	}
+	cooked.size = (size_t)fileSize.QuadPart;
+	cooked.mapping = mapping;
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0) {
+		close(file);
+		return false;
+	}
+
+	void *data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	cooked.data = static_cast<const unsigned char *>(data);
+	cooked.size = (size_t)status.st_size;
+	cooked.mapping = data;
+#endif
+	return true;
+}
+
+// The skeleton and clip tables are indexed without checks by the hierarchy,
+// sampling and skinning code, so every index they hold must be in range
+static bool validateTables(const CookedModel &cooked)
+{
+	const SkeletonHierarchy &hierarchy = cooked.hierarchy;
+	size_t jointCount = hierarchy.nodes.size();
+	if (hierarchy.parents.size() != jointCount || hierarchy.restTransforms.size() != jointCount ||
+		hierarchy.restTranslations.size() != jointCount || hierarchy.restRotations.size() != jointCount ||
+		hierarchy.restScales.size() != jointCount || hierarchy.isSkinJoint.size() != jointCount) {
+		return false;
+	}
+
+	// Parents come before their children, as computeGlobalTransforms expects
+	for (size_t i = 0; i < jointCount; ++i) {
+		if (hierarchy.parents[i] < -1 || hierarchy.parents[i] >= (int)i ||
+			hierarchy.nodes[i] < 0 || hierarchy.nodes[i] >= (int)hierarchy.jointOfNode.size()) {
+			return false;
+		}
+	}
+	for (size_t n = 0; n < hierarchy.jointOfNode.size(); ++n) {
+		if (hierarchy.jointOfNode[n] < -1 || hierarchy.jointOfNode[n] >= (int)jointCount) {
+			return false;
+		}
+	}
+
+	if (cooked.inverseBindMatrices.size() != hierarchy.skinJoints.size()) {
+		return false;
+	}
+	for (size_t s = 0; s < hierarchy.skinJoints.size(); ++s) {
+		const std::vector<int> &joints = hierarchy.skinJoints[s];
+		if (cooked.inverseBindMatrices[s].size() != joints.size()) {
+			return false;
+		}
+		for (size_t j = 0; j < joints.size(); ++j) {
+			if (joints[j] < 0 || joints[j] >= (int)jointCount) {
+				return false;
+			}
+		}
+	}
+
+	// One vec4 value per key
+	for (size_t c = 0; c < cooked.animationClips.size(); ++c) {
+		const AnimationClip &clip = cooked.animationClips[c];
+		if (clip.values.size() != clip.times.size() || !isfinite(clip.duration)) {
+			return false;
+		}
+		for (size_t t = 0; t < clip.tracks.size(); ++t) {
+			const AnimationTrack &track = clip.tracks[t];
+			if (track.target < 0 || track.target >= (int)jointCount ||
+				track.firstKey < 0 || track.keyCount < 1 ||
+				(uint64_t)track.firstKey + track.keyCount > clip.times.size()) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool loadCookedModel(const char *filename, CookedModel &cooked)
+{
+	if (!mapFile(filename, cooked)) {
+		return false;
+	}
+
+	CookedReader reader;
+	reader.cursor = cooked.data;
+	reader.end = cooked.data + cooked.size;
+	reader.failed = false;
+
+	char magic[4];
+	uint32_t version = 0;
+	reader.read(magic, sizeof(magic));
+	reader.readValue(version);
+	if (reader.failed || memcmp(magic, COOKED_MAGIC, sizeof(magic)) != 0 || version != COOKED_VERSION) {
+		std::cout << "Not a cooked model or wrong version: " << filename << std::endl;
+		unloadCookedModel(cooked);
+		return false;
+	}
+
+	reader.readValue(cooked.vertices);
+	reader.readValue(cooked.indices);
+	reader.readValue(cooked.packingFlags);
+	reader.readVector(cooked.attributes);
+	reader.readVector(cooked.primitives);
+	reader.readVector(cooked.lods);
+	reader.readValue(cooked.vertexStride);
+	reader.readValue(cooked.vertexCount);
+	reader.readValue(cooked.indexType);
+
+	SkeletonHierarchy &hierarchy = cooked.hierarchy;
+	reader.readVector(hierarchy.nodes);
+	reader.readVector(hierarchy.parents);
+	reader.readVector(hierarchy.jointOfNode);
+	reader.readVector(hierarchy.restTransforms);
+	reader.readVector(hierarchy.restTranslations);
+	reader.readVector(hierarchy.restRotations);
+	reader.readVector(hierarchy.restScales);
+	uint32_t skinCount = 0;
+	reader.readValue(skinCount);
+	hierarchy.skinJoints.resize(reader.failed ? 0 : skinCount);
+	for (size_t i = 0; i < hierarchy.skinJoints.size(); ++i) {
+		reader.readVector(hierarchy.skinJoints[i]);
+	}
+	std::vector<unsigned char> isSkinJoint;
+	reader.readVector(isSkinJoint);
+	hierarchy.isSkinJoint.assign(isSkinJoint.begin(), isSkinJoint.end());
+
+	reader.readValue(skinCount);
+	cooked.inverseBindMatrices.resize(reader.failed ? 0 : skinCount);
+	for (size_t i = 0; i < cooked.inverseBindMatrices.size(); ++i) {
+		reader.readVector(cooked.inverseBindMatrices[i]);
+	}
+
+	uint32_t clipCount = 0;
+	reader.readValue(clipCount);
+	cooked.animationClips.resize(reader.failed ? 0 : clipCount);
+	for (size_t i = 0; i < cooked.animationClips.size(); ++i) {
+		AnimationClip &clip = cooked.animationClips[i];
+		reader.readVector(clip.tracks);
+		reader.readVector(clip.times);
+		reader.readVector(clip.values);
+		reader.readValue(clip.duration);
+	}
+
+	// Both blobs must lie inside the file and every draw inside the blobs
+	const CookedBlob *blobs[2] = { &cooked.vertices, &cooked.indices };
+	for (int i = 0; i < 2 && !reader.failed; ++i) {
+		if (blobs[i]->offset > cooked.size || blobs[i]->size > cooked.size - blobs[i]->offset) {
+			reader.failed = true;
+		}
+	}
+	if (!reader.failed && (cooked.vertexStride <= 0 ||
+		(uint64_t)cooked.vertexCount * cooked.vertexStride > cooked.vertices.size)) {
+		reader.failed = true;
+	}
+	if (!reader.failed && (cooked.lods.empty() || cooked.primitives.size() % cooked.lods.size() != 0)) {
+		reader.failed = true;
+	}
+	for (size_t i = 0; i < cooked.lods.size() && !reader.failed; ++i) {
+		if (cooked.lods[i].firstPrimitive != (int)(i * cooked.primitives.size() / cooked.lods.size())) {
+			reader.failed = true;
+		}
+	}
+	for (size_t i = 0; i < cooked.attributes.size() && !reader.failed; ++i) {
+		if (cooked.attributes[i].offset < 0 || cooked.attributes[i].offset >= cooked.vertexStride) {
+			reader.failed = true;
+		}
+	}
+	uint64_t indexSize = cooked.indexType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? 2 : 4;
+	for (size_t i = 0; i < cooked.primitives.size() && !reader.failed; ++i) {
+		const PackedPrimitive &primitive = cooked.primitives[i];
+		if (primitive.indexOffset < 0 || primitive.indexCount < 0 ||
+			primitive.baseVertex < 0 || primitive.baseVertex > cooked.vertexCount ||
+			(uint64_t)primitive.indexOffset + primitive.indexCount * indexSize > cooked.indices.size) {
+			reader.failed = true;
+		}
+	}
+
+	if (!reader.failed && !validateTables(cooked)) {
+		reader.failed = true;
+	}
+
+	if (reader.failed) {
+		std::cout << "Cooked model is truncated or corrupt: " << filename << std::endl;
+		unloadCookedModel(cooked);
+		return false;
+	}
+	return true;
+}
+
+void unloadCookedModel(CookedModel &cooked)
+{
+	if (cooked.mapping == NULL) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(cooked.data);
+	CloseHandle((HANDLE)cooked.mapping);
+#else
+	munmap(cooked.mapping, cooked.size);
+#endif
+	cooked.data = NULL;
+	cooked.size = 0;
+	cooked.mapping = NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef _COOKED_MODEL_H_
+#define _COOKED_MODEL_H_
+
+#include <animation/animation.h>
+#include <animation/skeleton.h>
+#include <asset/mesh_packing.h>
+
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace tinygltf {
+	class Model;
+}
+
+// A skinned glTF model cooked offline into one binary file that loads
+// without any parsing. The small tables (vertex layout, primitives,
+// skeleton, inverse bind matrices, animation tracks) are copied out of the
+// file; the interleaved vertex and index data stay in the memory-mapped
+// file and are handed to OpenGL as is.
+
+// One GPU buffer's worth of bytes
+struct CookedBlob {
+	uint64_t offset;			// From the start of the file, 16-byte aligned
+	uint64_t size;
+};
+
+struct CookedModel {
+	// The packed mesh of the default scene, see packModelMeshes()
+	int packingFlags;
+	std::vector<PackedAttribute> attributes;
+	std::vector<PackedPrimitive> primitives;	// In scene traversal order, per LOD
+	std::vector<PackedLod> lods;
+	int vertexStride;
+	int vertexCount;
+	int indexType;
+	CookedBlob vertices;
+	CookedBlob indices;
+
+	SkeletonHierarchy hierarchy;
+	std::vector<std::vector<glm::mat4> > inverseBindMatrices;	// Per skin
+	std::vector<AnimationClip> animationClips;
+
+	// The mapped file
+	const unsigned char *data;
+	size_t size;
+	void *mapping;
+
+	CookedModel() : packingFlags(0), vertexStride(0), vertexCount(0), indexType(0), data(NULL), size(0), mapping(NULL) {}
+
+	const void *vertexData() const {
+		return data + vertices.offset;
+	}
+
+	const void *indexData() const {
+		return data + indices.offset;
+	}
+};
+
+// Flatten the default scene of the model and write it to filename, with
+// the mesh packed using packingFlags
+bool cookModel(const tinygltf::Model &model, const char *filename, int packingFlags = 0);
+
+// Map the file and read its tables. Returns false if the file is missing,
+// truncated or from another version of the cooker.
+bool loadCookedModel(const char *filename, CookedModel &cooked);
+
+// Unmap the file; vertex and index data are invalid afterwards
+void unloadCookedModel(CookedModel &cooked);
+
+#endif
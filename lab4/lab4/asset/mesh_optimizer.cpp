@@ -0,0 +1,265 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <math.h>
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize)
+{
+	if (indices.size() < 3) {
+		return 0.0f;
+	}
+
+	// A vertex is in the FIFO if fewer than cacheSize misses happened since
+	// it was loaded
+	std::vector<unsigned> loadedAt(vertexCount, 0);
+	unsigned misses = 0;
+	unsigned clock = (unsigned)cacheSize + 1;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		uint32_t v = indices[i];
+		if (clock - loadedAt[v] > (unsigned)cacheSize) {
+			loadedAt[v] = clock++;
+			misses++;
+		}
+	}
+	return (float)misses / (indices.size() / 3);
+}
+
+// Forsyth's scoring uses a larger LRU cache than the FIFO it optimizes
+// for; the result works well for any cache size
+static const int SCORING_CACHE_SIZE = 32;
+
+static float vertexScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		// The last triangle's vertices get a fixed score so the next
+		// triangle does not simply reuse the same edge
+		if (cachePosition < 3) {
+			score = 0.75f;
+		} else {
+			score = powf(1.0f - (cachePosition - 3) / (float)(SCORING_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+
+	// Prefer finishing vertices with few triangles left
+	return score + 2.0f / sqrtf((float)remainingTriangles);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles of each vertex; the first remaining[v] entries are the
+	// ones not emitted yet
+	std::vector<int> remaining(vertexCount, 0), firstTriangle(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		remaining[indices[i]]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	}
+	std::vector<int> adjacency(triangleCount * 3);
+	std::vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		adjacency[filled[indices[i]]++] = (int)(i / 3);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> scores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		scores[v] = vertexScore(-1, remaining[v]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned char> emitted(triangleCount, 0);
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	std::vector<uint32_t> cache, nextCache;
+	size_t scanCursor = 0;
+	int best = -1;
+
+	for (size_t n = 0; n < triangleCount; ++n) {
+		if (best < 0) {
+			// Nothing left around the cache, start over from the first
+			// triangle not emitted yet
+			while (emitted[scanCursor]) {
+				scanCursor++;
+			}
+			best = (int)scanCursor;
+		}
+
+		emitted[best] = 1;
+		const uint32_t *triangle = &indices[best * 3];
+		result.insert(result.end(), triangle, triangle + 3);
+
+		// Remove the triangle from its vertices' lists
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			int *list = &adjacency[firstTriangle[v]];
+			for (int i = 0; i < remaining[v]; ++i) {
+				if (list[i] == best) {
+					std::swap(list[i], list[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// Its vertices move to the front of the LRU cache
+		nextCache.assign(triangle, triangle + 3);
+		for (size_t i = 0; i < cache.size(); ++i) {
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				nextCache.push_back(v);
+			}
+		}
+		for (size_t i = SCORING_CACHE_SIZE; i < nextCache.size(); ++i) {
+			cachePosition[nextCache[i]] = -1;
+		}
+
+		// Rescore every vertex that was or is in the cache and pick the best
+		// triangle among their remaining ones
+		float bestScore = -1.0f;
+		best = -1;
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			uint32_t v = nextCache[i];
+			if (i < (size_t)SCORING_CACHE_SIZE) {
+				cachePosition[v] = (int)i;
+			}
+
+			float score = vertexScore(cachePosition[v], remaining[v]);
+			float delta = score - scores[v];
+			scores[v] = score;
+
+			const int *list = &adjacency[firstTriangle[v]];
+			for (int j = 0; j < remaining[v]; ++j) {
+				int t = list[j];
+				triangleScores[t] += delta;
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+
+		if (nextCache.size() > (size_t)SCORING_CACHE_SIZE) {
+			nextCache.resize(SCORING_CACHE_SIZE);
+		}
+		cache.swap(nextCache);
+	}
+
+	indices.swap(result);
+}
+
+struct TriangleCluster {
+	size_t first;				// First triangle
+	size_t count;
+	float sortKey;
+};
+
+static bool drawFirst(const TriangleCluster &a, const TriangleCluster &b)
+{
+	return a.sortKey > b.sortKey;
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec4> &positions,
+	float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+	float acmr = computeACMR(indices, positions.size());
+
+	// Split where a triangle misses the cache on all three vertices; the
+	// cache holds nothing useful there, so clusters can move freely
+	std::vector<TriangleCluster> clusters;
+	std::vector<unsigned> loadedAt(positions.size(), 0);
+	unsigned clock = VERTEX_CACHE_SIZE + 1;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		int misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[t * 3 + k];
+			if (clock - loadedAt[v] > (unsigned)VERTEX_CACHE_SIZE) {
+				loadedAt[v] = clock++;
+				misses++;
+			}
+		}
+		if (misses == 3 || clusters.empty()) {
+			TriangleCluster cluster = { t, 0, 0.0f };
+			clusters.push_back(cluster);
+		}
+		clusters.back().count++;
+	}
+	if (clusters.size() < 2) {
+		return;
+	}
+
+	// Area weighted centroid of the mesh
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroids(clusters.size()), clusterNormals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+			glm::vec3 p0(positions[indices[t * 3]]);
+			glm::vec3 p1(positions[indices[t * 3 + 1]]);
+			glm::vec3 p2(positions[indices[t * 3 + 2]]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		clusterCentroids[c] = area > 0.0f ? centroid / area : glm::vec3(positions[indices[clusters[c].first * 3]]);
+		clusterNormals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters far out and facing away from the centre occlude the rest
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), drawFirst);
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		result.insert(result.end(), indices.begin() + clusters[c].first * 3,
+			indices.begin() + (clusters[c].first + clusters[c].count) * 3);
+	}
+
+	if (computeACMR(result, positions.size()) <= acmr * threshold) {
+		indices.swap(result);
+	}
+}
+
+size_t optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount, std::vector<int> &remap)
+{
+	remap.assign(vertexCount, -1);
+	size_t next = 0;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		uint32_t v = indices[i];
+		if (remap[v] < 0) {
+			remap[v] = (int)next++;
+		}
+		indices[i] = (uint32_t)remap[v];
+	}
+	return next;
+}
@@ -0,0 +1,393 @@
+#include "mesh_packing.h"
+
+#include <animation/skinning.h>
+#include <asset/mesh_optimizer.h>
+#include <asset/mesh_simplifier.h>
+
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+static void collectPrimitives(const tinygltf::Model &model, int nodeIndex,
+	std::vector<const tinygltf::Primitive *> &primitives)
+{
+	const tinygltf::Node &node = model.nodes[nodeIndex];
+	if (node.mesh >= 0 && node.mesh < (int)model.meshes.size()) {
+		const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+		for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+			primitives.push_back(&mesh.primitives[i]);
+		}
+	}
+	for (size_t i = 0; i < node.children.size(); ++i) {
+		collectPrimitives(model, node.children[i], primitives);
+	}
+}
+
+std::vector<const tinygltf::Primitive *> collectScenePrimitives(const tinygltf::Model &model)
+{
+	std::vector<const tinygltf::Primitive *> primitives;
+	if (model.scenes.empty()) {
+		return primitives;
+	}
+
+	const tinygltf::Scene &scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
+	for (size_t i = 0; i < scene.nodes.size(); ++i) {
+		collectPrimitives(model, scene.nodes[i], primitives);
+	}
+	return primitives;
+}
+
+// Indices of a primitive as 32-bit values; non-indexed primitives get 0..n-1
+static void readIndices(const tinygltf::Model &model, const tinygltf::Primitive &primitive,
+	size_t vertexCount, std::vector<uint32_t> &out)
+{
+	if (primitive.indices < 0) {
+		out.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; ++i) {
+			out[i] = (uint32_t)i;
+		}
+		return;
+	}
+
+	const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+	int stride = accessor.ByteStride(bufferView);
+	const unsigned char *ptr = &buffer.data[bufferView.byteOffset + accessor.byteOffset];
+
+	out.resize(accessor.count);
+	for (size_t i = 0; i < accessor.count; ++i) {
+		const unsigned char *p = ptr + i * stride;
+		if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+			out[i] = *p;
+		} else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+			uint16_t v;
+			memcpy(&v, p, sizeof(v));
+			out[i] = v;
+		} else {
+			memcpy(&out[i], p, sizeof(uint32_t));
+		}
+	}
+}
+
+// Decoded attributes of one primitive before interleaving
+struct SourcePrimitive {
+	std::vector<glm::vec4> positions, normals, texcoords, joints, weights;
+	std::vector<uint32_t> indices;
+};
+
+static void readAttribute(const tinygltf::Model &model, const tinygltf::Primitive &primitive,
+	const char *name, const glm::vec4 &fill, size_t count, std::vector<glm::vec4> &out)
+{
+	auto it = primitive.attributes.find(name);
+	if (it != primitive.attributes.end()) {
+		readVec4Accessor(model, it->second, fill, out);
+	}
+	if (out.size() != count) {
+		out.assign(count, fill);
+	}
+}
+
+static void addAttribute(PackedMesh &packed, int location, int size, int componentType, bool normalized)
+{
+	PackedAttribute attribute;
+	attribute.location = location;
+	attribute.size = size;
+	attribute.componentType = componentType;
+	attribute.normalized = normalized ? 1 : 0;
+	attribute.offset = packed.vertexStride;
+	packed.attributes.push_back(attribute);
+
+	packed.vertexStride += size * tinygltf::GetComponentSizeInBytes(componentType);
+}
+
+// Store the first components of value as the attribute's type, the way GL
+// will read them back
+static void writeAttribute(unsigned char *vertex, const PackedAttribute &attribute, const glm::vec4 &value)
+{
+	unsigned char *dst = vertex + attribute.offset;
+	for (int c = 0; c < attribute.size; ++c) {
+		float v = value[c];
+		switch (attribute.componentType) {
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			dst[c] = (unsigned char)(attribute.normalized ? floorf(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f) : v);
+			break;
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+			uint16_t u = (uint16_t)(attribute.normalized ? floorf(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f) : v);
+			memcpy(dst + c * 2, &u, 2);
+			break;
+		}
+		case TINYGLTF_COMPONENT_TYPE_SHORT: {
+			int16_t i = (int16_t)floorf(glm::clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f);
+			memcpy(dst + c * 2, &i, 2);
+			break;
+		}
+		default:
+			memcpy(dst + c * 4, &v, 4);
+			break;
+		}
+	}
+}
+
+// Octahedral encoding of a unit vector into [-1, 1]^2, decoded in bot.vert
+static glm::vec4 octEncode(const glm::vec4 &normal)
+{
+	glm::vec3 n(normal);
+	float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (sum == 0.0f) {
+		return glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+	n /= sum;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) *
+			glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::vec4(e, 0.0f, 0.0f);
+}
+
+// Weights rounded to multiples of 1/255 that still sum to exactly one
+static glm::vec4 quantizeWeights(const glm::vec4 &weights)
+{
+	float sum = weights.x + weights.y + weights.z + weights.w;
+	if (sum <= 0.0f) {
+		return glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	int q[4], total = 0, largest = 0;
+	for (int c = 0; c < 4; ++c) {
+		q[c] = (int)floorf(weights[c] / sum * 255.0f + 0.5f);
+		total += q[c];
+		if (q[c] > q[largest]) {
+			largest = c;
+		}
+	}
+	q[largest] += 255 - total;
+	return glm::vec4(q[0], q[1], q[2], q[3]) / 255.0f;
+}
+
+static void optimizePrimitive(SourcePrimitive &source)
+{
+	optimizeVertexCache(source.indices, source.positions.size());
+	optimizeOverdraw(source.indices, source.positions, 1.05f);
+
+	std::vector<int> remap;
+	size_t count = optimizeVertexFetch(source.indices, source.positions.size(), remap);
+
+	std::vector<glm::vec4> *streams[5] = {
+		&source.positions, &source.normals, &source.texcoords, &source.joints, &source.weights
+	};
+	for (int s = 0; s < 5; ++s) {
+		std::vector<glm::vec4> reordered(count);
+		for (size_t v = 0; v < remap.size(); ++v) {
+			if (remap[v] >= 0) {
+				reordered[remap[v]] = (*streams[s])[v];
+			}
+		}
+		streams[s]->swap(reordered);
+	}
+}
+
+// Append indices in the mesh's index type, returns their byte offset
+static int appendIndices(PackedMesh &packed, const std::vector<uint32_t> &indices)
+{
+	int indexSize = packed.indexType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? 2 : 4;
+	size_t start = packed.indices.size();
+	packed.indices.resize(start + indices.size() * indexSize);
+	for (size_t k = 0; k < indices.size(); ++k) {
+		if (indexSize == 2) {
+			uint16_t index = (uint16_t)indices[k];
+			memcpy(&packed.indices[start + k * 2], &index, 2);
+		} else {
+			memcpy(&packed.indices[start + k * 4], &indices[k], 4);
+		}
+	}
+	return (int)start;
+}
+
+// Largest simplification error allowed, relative to the size of the mesh
+static const float LOD_MAX_ERROR = 0.05f;
+static const int LOD_COUNT = 4;
+
+// Simplify each primitive from the full mesh to successively halved
+// triangle counts. A primitive that cannot get coarser reuses the index
+// range of the previous level.
+static void buildLods(PackedMesh &packed, const std::vector<SourcePrimitive> &sources,
+	const std::vector<int> &packedSources)
+{
+	glm::vec3 lower(1e30f), upper(-1e30f);
+	size_t fullTriangles = 0;
+	for (size_t i = 0; i < packedSources.size(); ++i) {
+		const SourcePrimitive &source = sources[packedSources[i]];
+		for (size_t v = 0; v < source.positions.size(); ++v) {
+			lower = glm::min(lower, glm::vec3(source.positions[v]));
+			upper = glm::max(upper, glm::vec3(source.positions[v]));
+		}
+		fullTriangles += source.indices.size() / 3;
+	}
+	float maxError = LOD_MAX_ERROR * glm::length(upper - lower);
+
+	size_t previousTriangles = fullTriangles;
+	for (int level = 1; level < LOD_COUNT; ++level) {
+		PackedLod lod = { (int)packed.primitives.size(), 0.0f };
+		size_t indexBytes = packed.indices.size();
+		size_t triangles = 0;
+
+		for (size_t i = 0; i < packedSources.size(); ++i) {
+			const SourcePrimitive &source = sources[packedSources[i]];
+			PackedPrimitive primitive = packed.primitives[packed.lods.back().firstPrimitive + i];
+
+			if (primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+				float error = 0.0f;
+				size_t target = source.indices.size() / 3 >> level;
+				std::vector<uint32_t> indices = simplifyMesh(source.indices, source.positions,
+					source.joints, source.weights, target * 3, maxError, error);
+
+				if ((int)indices.size() < primitive.indexCount) {
+					optimizeVertexCache(indices, source.positions.size());
+					primitive.indexCount = (int)indices.size();
+					primitive.indexOffset = appendIndices(packed, indices);
+					lod.error = std::max(lod.error, error);
+				}
+			}
+			packed.primitives.push_back(primitive);
+			triangles += primitive.indexCount / 3;
+		}
+
+		// Keep the level only if it saves at least a tenth of the triangles
+		if (triangles * 10 > previousTriangles * 9) {
+			packed.primitives.resize(lod.firstPrimitive);
+			packed.indices.resize(indexBytes);
+			break;
+		}
+		lod.error = std::max(lod.error, packed.lods.back().error);
+		packed.lods.push_back(lod);
+		previousTriangles = triangles;
+	}
+}
+
+PackedMesh packModelMeshes(const tinygltf::Model &model, int flags)
+{
+	PackedMesh packed;
+	packed.flags = flags;
+	packed.vertexStride = 0;
+	packed.vertexCount = 0;
+	packed.indexType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+
+	std::vector<const tinygltf::Primitive *> primitives = collectScenePrimitives(model);
+	std::vector<SourcePrimitive> sources(primitives.size());
+
+	// Decode everything first; the layout depends on the largest joint
+	// index and texture coordinate, the index type on the largest primitive
+	float maxJoint = 0.0f;
+	bool unitTexcoords = true;
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		const tinygltf::Primitive &primitive = *primitives[i];
+		SourcePrimitive &source = sources[i];
+
+		auto position = primitive.attributes.find("POSITION");
+		if (position == primitive.attributes.end()) {
+			continue;
+		}
+		readVec4Accessor(model, position->second, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), source.positions);
+		size_t count = source.positions.size();
+
+		readAttribute(model, primitive, "NORMAL", glm::vec4(0.0f, 0.0f, 1.0f, 0.0f), count, source.normals);
+		readAttribute(model, primitive, "TEXCOORD_0", glm::vec4(0.0f), count, source.texcoords);
+		readAttribute(model, primitive, "JOINTS_0", glm::vec4(0.0f), count, source.joints);
+		readAttribute(model, primitive, "WEIGHTS_0", glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), count, source.weights);
+		readIndices(model, primitive, count, source.indices);
+
+		if ((flags & PACK_OPTIMIZE) && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+			optimizePrimitive(source);
+			count = source.positions.size();
+		}
+
+		for (size_t v = 0; v < count; ++v) {
+			const glm::vec4 &j = source.joints[v];
+			const glm::vec4 &t = source.texcoords[v];
+			maxJoint = std::max(maxJoint, std::max(std::max(j.x, j.y), std::max(j.z, j.w)));
+			unitTexcoords = unitTexcoords && t.x >= 0.0f && t.x <= 1.0f && t.y >= 0.0f && t.y <= 1.0f;
+		}
+		if (count > 65535) {
+			packed.indexType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+		}
+	}
+
+	// Full precision is the same attribute types the glTF exporter used for
+	// the bot. Joints widen to 16 bits only when a skin has more than 256
+	// joints; quantized texture coordinates stay float outside [0, 1].
+	bool quantize = (flags & PACK_QUANTIZE) != 0;
+	bool wideJoints = maxJoint > 255.0f;
+	addAttribute(packed, 0, 3, TINYGLTF_COMPONENT_TYPE_FLOAT, false);
+	if (quantize) {
+		addAttribute(packed, 1, 2, TINYGLTF_COMPONENT_TYPE_SHORT, true);
+	} else {
+		addAttribute(packed, 1, 3, TINYGLTF_COMPONENT_TYPE_FLOAT, false);
+	}
+	if (quantize && unitTexcoords) {
+		addAttribute(packed, 2, 2, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, true);
+	} else {
+		addAttribute(packed, 2, 2, TINYGLTF_COMPONENT_TYPE_FLOAT, false);
+	}
+	addAttribute(packed, 3, 4, wideJoints ? TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT : TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, false);
+	if (quantize) {
+		addAttribute(packed, 4, 4, TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, true);
+	} else {
+		addAttribute(packed, 4, 4, TINYGLTF_COMPONENT_TYPE_FLOAT, false);
+	}
+
+	std::vector<int> packedSources;
+	for (size_t i = 0; i < primitives.size(); ++i) {
+		const SourcePrimitive &source = sources[i];
+		if (source.positions.empty()) {
+			continue;
+		}
+
+		PackedPrimitive primitive;
+		primitive.mode = primitives[i]->mode;
+		primitive.indexCount = (int)source.indices.size();
+		primitive.indexOffset = appendIndices(packed, source.indices);
+		primitive.baseVertex = packed.vertexCount;
+		packed.primitives.push_back(primitive);
+		packedSources.push_back((int)i);
+
+		size_t vertexStart = packed.vertices.size();
+		packed.vertices.resize(vertexStart + source.positions.size() * packed.vertexStride);
+		for (size_t v = 0; v < source.positions.size(); ++v) {
+			unsigned char *vertex = &packed.vertices[vertexStart + v * packed.vertexStride];
+			writeAttribute(vertex, packed.attributes[0], source.positions[v]);
+			writeAttribute(vertex, packed.attributes[1], quantize ? octEncode(source.normals[v]) : source.normals[v]);
+			writeAttribute(vertex, packed.attributes[2], source.texcoords[v]);
+			writeAttribute(vertex, packed.attributes[3], source.joints[v]);
+			writeAttribute(vertex, packed.attributes[4], quantize ? quantizeWeights(source.weights[v]) : source.weights[v]);
+		}
+		packed.vertexCount += (int)source.positions.size();
+	}
+
+	PackedLod full = { 0, 0.0f };
+	packed.lods.push_back(full);
+	if (flags & PACK_LODS) {
+		buildLods(packed, sources, packedSources);
+	}
+
+	return packed;
+}
+
+std::vector<uint32_t> unpackIndices(const PackedMesh &packed, const PackedPrimitive &primitive)
+{
+	std::vector<uint32_t> indices(primitive.indexCount);
+	for (int k = 0; k < primitive.indexCount; ++k) {
+		if (packed.indexType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+			uint16_t index;
+			memcpy(&index, &packed.indices[primitive.indexOffset + k * 2], 2);
+			indices[k] = index;
+		} else {
+			memcpy(&indices[k], &packed.indices[primitive.indexOffset + k * 4], 4);
+		}
+	}
+	return indices;
+}
@@ -0,0 +1,76 @@
+#ifndef _MESH_PACKING_H_
+#define _MESH_PACKING_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace tinygltf {
+	class Model;
+	struct Primitive;
+}
+
+// All mesh primitives of a model repacked into one interleaved vertex
+// buffer and one index buffer, so the model needs a single VAO. Each
+// primitive keeps its own indices, offset by baseVertex when drawn.
+// GL enums are stored as plain ints so packing needs no GL context.
+
+struct PackedAttribute {
+	int location;				// Vertex attribute index in bot.vert
+	int size;					// Components
+	int componentType;
+	int normalized;
+	int offset;					// Within a vertex
+};
+
+struct PackedPrimitive {
+	int mode;
+	int indexCount;
+	int indexOffset;			// In bytes, within the index buffer
+	int baseVertex;
+};
+
+// One level of detail: a simplified index range for every primitive, all
+// over the vertices of the full mesh
+struct PackedLod {
+	int firstPrimitive;
+	float error;				// Largest distance to the full mesh, in model units
+};
+
+// Optional load-time processing
+enum PackingFlags {
+	// Reorder triangles for the post-transform vertex cache and overdraw,
+	// and vertices for fetch locality (see mesh_optimizer.h)
+	PACK_OPTIMIZE = 1,
+	// Octahedral 16-bit normals, 16-bit texture coordinates and 8-bit
+	// weights; bot.vert decodes the normals when octNormals is set
+	PACK_QUANTIZE = 2,
+	// Simplified index lists at about 1/2, 1/4 and 1/8 of the triangles
+	// (see mesh_simplifier.h); levels that save little are dropped
+	PACK_LODS = 4
+};
+
+struct PackedMesh {
+	int flags;					// PackingFlags the mesh was packed with
+	std::vector<PackedAttribute> attributes;
+	int vertexStride;
+	int vertexCount;
+	int indexType;				// GL_UNSIGNED_SHORT when every primitive fits, else GL_UNSIGNED_INT
+
+	std::vector<unsigned char> vertices;
+	std::vector<unsigned char> indices;
+	std::vector<PackedPrimitive> primitives;	// Of every LOD, finest first
+	std::vector<PackedLod> lods;				// At least the full mesh
+};
+
+// The mesh primitives of the default scene, in node traversal order
+std::vector<const tinygltf::Primitive *> collectScenePrimitives(const tinygltf::Model &model);
+
+// Interleave POSITION, NORMAL, TEXCOORD_0, JOINTS_0 and WEIGHTS_0 of every
+// primitive of the default scene. Missing attributes are filled with
+// defaults (a missing skin binds the vertex fully to joint 0).
+PackedMesh packModelMeshes(const tinygltf::Model &model, int flags = 0);
+
+// Indices of one primitive as 32-bit values, relative to its base vertex
+std::vector<uint32_t> unpackIndices(const PackedMesh &packed, const PackedPrimitive &primitive);
+
+#endif
@@ -0,0 +1,502 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+
+	void clear() {
+		a00 = a01 = a02 = a03 = a11 = a12 = a13 = a22 = a23 = a33 = 0.0;
+	}
+
+	void addPlane(const glm::dvec3 &n, double d) {
+		a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z; a03 += n.x * d;
+		a11 += n.y * n.y; a12 += n.y * n.z; a13 += n.y * d;
+		a22 += n.z * n.z; a23 += n.z * d;
+		a33 += d * d;
+	}
+
+	void add(const Quadric &q) {
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+	}
+
+	double evaluate(const glm::dvec3 &p) const {
+		return a00 * p.x * p.x + 2.0 * a01 * p.x * p.y + 2.0 * a02 * p.x * p.z + 2.0 * a03 * p.x
+			+ a11 * p.y * p.y + 2.0 * a12 * p.y * p.z + 2.0 * a13 * p.y
+			+ a22 * p.z * p.z + 2.0 * a23 * p.z
+			+ a33;
+	}
+};
+
+enum VertexKind {
+	VERTEX_MANIFOLD,
+	VERTEX_BORDER,
+	VERTEX_SEAM,
+	VERTEX_LOCKED
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static bool cheaper(const Collapse &a, const Collapse &b)
+{
+	return a.cost < b.cost;
+}
+
+// Sum of absolute weight differences over the joints of both vertices, 0
+// for identical skinning and 2 for disjoint joints
+static float skinDifference(const glm::vec4 &jointsA, const glm::vec4 &weightsA,
+	const glm::vec4 &jointsB, const glm::vec4 &weightsB)
+{
+	float difference = 0.0f;
+	for (int i = 0; i < 4; ++i) {
+		float other = 0.0f;
+		for (int j = 0; j < 4; ++j) {
+			if (jointsB[j] == jointsA[i]) {
+				other += weightsB[j];
+			}
+		}
+		difference += fabsf(weightsA[i] - other);
+	}
+	for (int j = 0; j < 4; ++j) {
+		bool shared = false;
+		for (int i = 0; i < 4; ++i) {
+			shared = shared || jointsA[i] == jointsB[j];
+		}
+		if (!shared) {
+			difference += weightsB[j];
+		}
+	}
+	return difference;
+}
+
+static glm::dvec3 triangleNormal(const glm::dvec3 &p0, const glm::dvec3 &p1, const glm::dvec3 &p2)
+{
+	return glm::cross(p1 - p0, p2 - p0);
+}
+
+// Closest point on a triangle (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::dvec3 closestPointOnTriangle(const glm::dvec3 &p, const glm::dvec3 &a, const glm::dvec3 &b,
+	const glm::dvec3 &c)
+{
+	glm::dvec3 ab = b - a, ac = c - a, ap = p - a;
+	double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0 && d2 <= 0.0) {
+		return a;
+	}
+	glm::dvec3 bp = p - b;
+	double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0 && d4 <= d3) {
+		return b;
+	}
+	double vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+		return a + ab * (d1 / (d1 - d3));
+	}
+	glm::dvec3 cp = p - c;
+	double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0 && d5 <= d6) {
+		return c;
+	}
+	double vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+		return a + ac * (d2 / (d2 - d6));
+	}
+	double va = d3 * d6 - d5 * d4;
+	if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+	double denominator = 1.0 / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t> &indices,
+	const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &joints,
+	const std::vector<glm::vec4> &weights, size_t targetIndexCount, float maxError, float &error)
+{
+	error = 0.0f;
+	size_t vertexCount = positions.size();
+	std::vector<uint32_t> result(indices.begin(), indices.end() - indices.size() % 3);
+
+	// Vertices sharing a position are the wedges of a seam; all of them map
+	// to the first one for topology and error
+	std::vector<uint32_t> canonical(vertexCount);
+	std::vector<int> wedgeCount(vertexCount, 0);
+	{
+		std::map<std::pair<std::pair<float, float>, float>, uint32_t> firstAt;
+		for (size_t v = 0; v < vertexCount; ++v) {
+			std::pair<std::pair<float, float>, float> key(std::make_pair(positions[v].x, positions[v].y), positions[v].z);
+			canonical[v] = firstAt.insert(std::make_pair(key, (uint32_t)v)).first->second;
+			wedgeCount[canonical[v]]++;
+		}
+	}
+
+	// Classify edges by their triangles: one for a border, two with
+	// different wedges for a seam, more for a non-manifold fan
+	struct EdgeUse {
+		int count;
+		uint32_t wedgeA, wedgeB;	// In the first triangle
+		bool seam;
+	};
+	std::map<std::pair<uint32_t, uint32_t>, EdgeUse> edges;
+	for (size_t i = 0; i < result.size(); i += 3) {
+		for (int k = 0; k < 3; ++k) {
+			uint32_t wa = result[i + k], wb = result[i + (k + 1) % 3];
+			uint32_t a = canonical[wa], b = canonical[wb];
+			if (a > b) {
+				std::swap(a, b);
+				std::swap(wa, wb);
+			}
+			EdgeUse &use = edges[std::make_pair(a, b)];
+			if (use.count == 0) {
+				use.wedgeA = wa;
+				use.wedgeB = wb;
+				use.seam = false;
+			} else if (use.wedgeA != wa || use.wedgeB != wb) {
+				use.seam = true;
+			}
+			use.count++;
+		}
+	}
+
+	// Interior vertices with one wedge move freely. Vertices on a single
+	// border or seam line only slide along it; corners and anything
+	// non-manifold stay in place.
+	std::vector<int> borderEdges(vertexCount, 0), seamEdges(vertexCount, 0);
+	std::vector<unsigned char> locked(vertexCount, 0);
+	for (auto it = edges.begin(); it != edges.end(); ++it) {
+		uint32_t a = it->first.first, b = it->first.second;
+		if (it->second.count == 1) {
+			borderEdges[a]++;
+			borderEdges[b]++;
+		} else if (it->second.count > 2) {
+			locked[a] = locked[b] = 1;
+		} else if (it->second.seam) {
+			seamEdges[a]++;
+			seamEdges[b]++;
+		}
+	}
+	std::vector<int> kind(vertexCount, VERTEX_LOCKED);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		if (canonical[v] != v || locked[v]) {
+			continue;
+		}
+		if (wedgeCount[v] == 1 && borderEdges[v] == 0 && seamEdges[v] == 0) {
+			kind[v] = VERTEX_MANIFOLD;
+		} else if (wedgeCount[v] == 1 && borderEdges[v] == 2 && seamEdges[v] == 0) {
+			kind[v] = VERTEX_BORDER;
+		} else if (wedgeCount[v] == 2 && borderEdges[v] == 0 && seamEdges[v] == 2) {
+			kind[v] = VERTEX_SEAM;
+		}
+	}
+
+	// Planes of the original triangles around each position, plus planes
+	// through border and seam edges perpendicular to their triangle, which
+	// keep those lines in place as their vertices slide along them
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		quadrics[v].clear();
+	}
+	for (size_t i = 0; i < result.size(); i += 3) {
+		glm::dvec3 p[3] = {
+			glm::dvec3(positions[result[i]]), glm::dvec3(positions[result[i + 1]]), glm::dvec3(positions[result[i + 2]])
+		};
+		glm::dvec3 n = triangleNormal(p[0], p[1], p[2]);
+		double length = glm::length(n);
+		if (length == 0.0) {
+			continue;
+		}
+		n /= length;
+		for (int k = 0; k < 3; ++k) {
+			quadrics[canonical[result[i + k]]].addPlane(n, -glm::dot(n, p[0]));
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			uint32_t a = canonical[result[i + k]], b = canonical[result[i + (k + 1) % 3]];
+			const EdgeUse &use = edges[std::make_pair(std::min(a, b), std::max(a, b))];
+			if (use.count != 1 && !use.seam) {
+				continue;
+			}
+			glm::dvec3 edge = p[(k + 1) % 3] - p[k];
+			glm::dvec3 side = glm::cross(edge, n);
+			if (glm::length(side) == 0.0) {
+				continue;
+			}
+			side = glm::normalize(side);
+			quadrics[a].addPlane(side, -glm::dot(side, p[k]));
+			quadrics[b].addPlane(side, -glm::dot(side, p[k]));
+		}
+	}
+
+	// Wedges of each canonical vertex
+	std::vector<int> firstWedge(vertexCount + 1, 0), wedges(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		firstWedge[canonical[v] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		firstWedge[v + 1] += firstWedge[v];
+	}
+	{
+		std::vector<int> filled(firstWedge.begin(), firstWedge.end() - 1);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			wedges[filled[canonical[v]]++] = (int)v;
+		}
+	}
+
+	double maxCost = (double)maxError * maxError;
+	std::vector<int> firstTriangle(vertexCount + 1), adjacency;
+	std::vector<unsigned char> touched(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> neighboursFrom, neighboursTo;
+	std::vector<uint32_t> collapsedInto(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		collapsedInto[v] = (uint32_t)v;
+	}
+
+	// Each pass collapses the cheapest edges whose neighbourhoods do not
+	// overlap, then rebuilds the adjacency
+	while (result.size() > targetIndexCount) {
+		size_t triangleCount = result.size() / 3;
+
+		// Triangles around each canonical vertex
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+		for (size_t i = 0; i < result.size(); ++i) {
+			firstTriangle[canonical[result[i]] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			firstTriangle[v + 1] += firstTriangle[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t i = 0; i < result.size(); ++i) {
+			adjacency[filled[canonical[result[i]]]++] = (int)(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				for (int direction = 0; direction < 2; ++direction) {
+					uint32_t from = canonical[result[i + k]];
+					uint32_t to = canonical[result[i + (k + 1) % 3]];
+					if (direction == 1) {
+						std::swap(from, to);
+					}
+					if (kind[from] == VERTEX_LOCKED || from == to) {
+						continue;
+					}
+
+					glm::dvec3 pFrom(positions[from]), pTo(positions[to]);
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					double skin = skinDifference(joints[from], weights[from], joints[to], weights[to])
+						* 0.5 * glm::length(pTo - pFrom);
+
+					Collapse collapse;
+					collapse.from = from;
+					collapse.to = to;
+					collapse.cost = std::max(q.evaluate(pTo), 0.0) + skin * skin;
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), cheaper);
+
+		for (size_t v = 0; v < vertexCount; ++v) {
+			remap[v] = (uint32_t)v;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t remainingTriangles = triangleCount;
+		size_t targetTriangles = targetIndexCount / 3;
+		int applied = 0;
+
+		for (size_t c = 0; c < collapses.size() && remainingTriangles > targetTriangles; ++c) {
+			const Collapse &collapse = collapses[c];
+			if (collapse.cost > maxCost) {
+				break;
+			}
+
+			uint32_t from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[to]) {
+				continue;
+			}
+
+			// Triangles on the edge decide where each wedge of the vertex
+			// goes: a seam vertex must find the target's wedge on both sides
+			int edgeTriangles = 0;
+			int mapped = 0;
+			for (int t = firstTriangle[from]; t < firstTriangle[from + 1]; ++t) {
+				const uint32_t *triangle = &result[adjacency[t] * 3];
+				int fromCorner = -1, toCorner = -1;
+				for (int k = 0; k < 3; ++k) {
+					if (canonical[triangle[k]] == from) {
+						fromCorner = k;
+					} else if (canonical[triangle[k]] == to) {
+						toCorner = k;
+					}
+				}
+				if (fromCorner < 0 || toCorner < 0) {
+					continue;
+				}
+				edgeTriangles++;
+				for (int w = firstWedge[from]; w < firstWedge[from + 1]; ++w) {
+					if ((uint32_t)wedges[w] == triangle[fromCorner] && remap[wedges[w]] == (uint32_t)wedges[w]) {
+						remap[wedges[w]] = triangle[toCorner];
+						mapped++;
+					}
+				}
+			}
+			bool valid = mapped == wedgeCount[from] &&
+				edgeTriangles == (kind[from] == VERTEX_BORDER ? 1 : 2);
+
+			// Link condition: the edge's vertices may only share the
+			// vertices opposite the edge, or the collapse pinches the surface
+			if (valid) {
+				neighboursFrom.clear();
+				neighboursTo.clear();
+				for (int t = firstTriangle[from]; t < firstTriangle[from + 1]; ++t) {
+					for (int k = 0; k < 3; ++k) {
+						neighboursFrom.push_back(canonical[result[adjacency[t] * 3 + k]]);
+					}
+				}
+				for (int t = firstTriangle[to]; t < firstTriangle[to + 1]; ++t) {
+					for (int k = 0; k < 3; ++k) {
+						neighboursTo.push_back(canonical[result[adjacency[t] * 3 + k]]);
+					}
+				}
+				std::sort(neighboursFrom.begin(), neighboursFrom.end());
+				neighboursFrom.erase(std::unique(neighboursFrom.begin(), neighboursFrom.end()), neighboursFrom.end());
+				std::sort(neighboursTo.begin(), neighboursTo.end());
+				neighboursTo.erase(std::unique(neighboursTo.begin(), neighboursTo.end()), neighboursTo.end());
+				int shared = 0;
+				for (size_t i = 0, j = 0; i < neighboursFrom.size() && j < neighboursTo.size();) {
+					if (neighboursFrom[i] < neighboursTo[j]) {
+						i++;
+					} else if (neighboursFrom[i] > neighboursTo[j]) {
+						j++;
+					} else {
+						if (neighboursFrom[i] != from && neighboursFrom[i] != to) {
+							shared++;
+						}
+						i++;
+						j++;
+					}
+				}
+				valid = shared == edgeTriangles;
+			}
+
+			// The surviving triangles must not flip
+			glm::dvec3 pTo(positions[to]);
+			for (int t = firstTriangle[from]; t < firstTriangle[from + 1] && valid; ++t) {
+				const uint32_t *triangle = &result[adjacency[t] * 3];
+				int corner = -1;
+				bool hasTo = false;
+				for (int k = 0; k < 3; ++k) {
+					if (canonical[triangle[k]] == from) {
+						corner = k;
+					}
+					hasTo = hasTo || canonical[triangle[k]] == to;
+				}
+				if (hasTo || corner < 0) {
+					continue;
+				}
+
+				glm::dvec3 p[3] = {
+					glm::dvec3(positions[triangle[0]]), glm::dvec3(positions[triangle[1]]), glm::dvec3(positions[triangle[2]])
+				};
+				glm::dvec3 before = triangleNormal(p[0], p[1], p[2]);
+				p[corner] = pTo;
+				glm::dvec3 after = triangleNormal(p[0], p[1], p[2]);
+				valid = glm::dot(before, after) > 0.0;
+			}
+
+			if (!valid) {
+				for (int w = firstWedge[from]; w < firstWedge[from + 1]; ++w) {
+					remap[wedges[w]] = (uint32_t)wedges[w];
+				}
+				continue;
+			}
+
+			quadrics[to].add(quadrics[from]);
+			collapsedInto[from] = to;
+			remainingTriangles -= edgeTriangles;
+			applied++;
+
+			// Freeze the neighbourhood until the adjacency is rebuilt
+			for (size_t i = 0; i < neighboursFrom.size(); ++i) {
+				touched[neighboursFrom[i]] = 1;
+			}
+			touched[to] = 1;
+		}
+
+		if (applied == 0) {
+			break;
+		}
+
+		// Apply the collapses and drop the triangles that degenerated
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) {
+				continue;
+			}
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	// The quadric cost sums squared distances over every merged plane and
+	// overestimates the deviation several times, so measure it instead: the
+	// distance from each removed vertex to the triangles now around the
+	// vertex it ended up in
+	std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+	for (size_t i = 0; i < result.size(); ++i) {
+		firstTriangle[canonical[result[i]] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		firstTriangle[v + 1] += firstTriangle[v];
+	}
+	adjacency.resize(result.size());
+	std::vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (size_t i = 0; i < result.size(); ++i) {
+		adjacency[filled[canonical[result[i]]]++] = (int)(i / 3);
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		if (collapsedInto[v] == v) {
+			continue;
+		}
+		uint32_t survivor = collapsedInto[v];
+		while (collapsedInto[survivor] != survivor) {
+			survivor = collapsedInto[survivor];
+		}
+
+		glm::dvec3 p(positions[v]);
+		double closest = HUGE_VAL;
+		for (int t = firstTriangle[survivor]; t < firstTriangle[survivor + 1]; ++t) {
+			const uint32_t *triangle = &result[adjacency[t] * 3];
+			glm::dvec3 q = closestPointOnTriangle(p, glm::dvec3(positions[triangle[0]]),
+				glm::dvec3(positions[triangle[1]]), glm::dvec3(positions[triangle[2]]));
+			closest = std::min(closest, glm::length(p - q));
+		}
+		if (closest != HUGE_VAL) {
+			error = std::max(error, (float)closest);
+		}
+	}
+
+	return result;
+}
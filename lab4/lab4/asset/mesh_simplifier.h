@@ -0,0 +1,27 @@
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Reduce an indexed triangle list to about targetIndexCount indices by
+// collapsing edges in order of quadric error (Garland and Heckbert). Each
+// collapse moves a vertex onto one of its neighbours, so the result only
+// references the existing vertices and keeps their normals, texture
+// coordinates and skin weights exactly; lower detail levels can share the
+// vertex buffer of the full mesh.
+//
+// Vertices on open borders and attribute seams only slide along them, and
+// where such lines meet they stay in place. A collapse between vertices
+// bound to different joints costs extra in proportion to the weight
+// difference, so detail is kept where the mesh bends.
+//
+// Stops early rather than make a collapse with a quadric error above
+// maxError. Returns the new indices and sets error to the largest distance
+// from a removed vertex to the simplified surface around it, in model units.
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t> &indices,
+	const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &joints,
+	const std::vector<glm::vec4> &weights, size_t targetIndexCount, float maxError, float &error);
+
+#endif
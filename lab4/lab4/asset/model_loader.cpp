@@ -0,0 +1,163 @@
+#include "model_loader.h"
+
+#include <animation/skinning.h>
+#include <asset/cooked_model.h>
+
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+
+static bool loadGltf(tinygltf::Model &model, const char *filename)
+{
+	tinygltf::TinyGLTF loader;
+	std::string err;
+	std::string warn;
+
+	bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+	if (!warn.empty()) {
+		std::cout << "WARN: " << warn << std::endl;
+	}
+
+	if (!err.empty()) {
+		std::cout << "ERR: " << err << std::endl;
+	}
+
+	if (!res)
+		std::cout << "Failed to load glTF: " << filename << std::endl;
+
+	return res;
+}
+
+// Last modification time, 0 if the file cannot be read
+static time_t fileModifiedTime(const char *filename)
+{
+	struct stat info;
+	if (stat(filename, &info) != 0) {
+		return 0;
+	}
+	return info.st_mtime;
+}
+
+// Copy the tables of the mesh out of the mapped file; the vertex and index
+// data are uploaded straight from the mapping
+static void copyCookedMesh(const CookedModel &cooked, PackedMesh &mesh)
+{
+	mesh.flags = cooked.packingFlags;
+	mesh.attributes = cooked.attributes;
+	mesh.vertexStride = cooked.vertexStride;
+	mesh.vertexCount = cooked.vertexCount;
+	mesh.indexType = cooked.indexType;
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.primitives = cooked.primitives;
+	mesh.lods = cooked.lods;
+}
+
+bool loadModelData(const char *gltfFile, const char *cookedFile, const char *bakedFile,
+	int packingFlags, float compressionTolerance, LoadedModel &loaded)
+{
+	// Prefer the cooked model, which is mapped without parsing. On the first
+	// run the glTF is cooked for the next start; the glTF data is only used
+	// directly if the cooked file cannot be written.
+	std::vector<AnimationClip> clips;
+	CookedModel &cooked = loaded.cooked;
+	bool cookedLoaded = loadCookedModel(cookedFile, cooked);
+
+	// Cooked with other flags, or older than the glTF: cook it again. Without
+	// the glTF, as when only the cooked file is shipped, it is used as is.
+	if (cookedLoaded && (cooked.packingFlags != packingFlags
+		|| fileModifiedTime(gltfFile) > fileModifiedTime(cookedFile))) {
+		std::cout << "Cooked model is stale: " << cookedFile << std::endl;
+		unloadCookedModel(cooked);
+		cookedLoaded = false;
+	}
+
+	tinygltf::Model model;
+	if (!cookedLoaded) {
+		if (!loadGltf(model, gltfFile)) {
+			return false;
+		}
+		if (cookModel(model, cookedFile, packingFlags)) {
+			std::cout << "Cooked model: " << cookedFile << std::endl;
+			cookedLoaded = loadCookedModel(cookedFile, cooked);
+		}
+	}
+
+	if (cookedLoaded) {
+		loaded.source = cookedFile;
+		copyCookedMesh(cooked, loaded.mesh);
+		std::swap(loaded.hierarchy, cooked.hierarchy);
+		loaded.inverseBindMatrices.swap(cooked.inverseBindMatrices);
+		clips.swap(cooked.animationClips);
+	} else {
+		loaded.source = gltfFile;
+		loaded.mesh = packModelMeshes(model, packingFlags);
+		loaded.hierarchy = buildSkeletonHierarchy(model);
+		for (size_t i = 0; i < model.skins.size(); ++i) {
+			loaded.inverseBindMatrices.push_back(loadInverseBindMatrices(model, model.skins[i]));
+		}
+		for (const auto &anim : model.animations) {
+			clips.push_back(compileAnimation(model, anim, loaded.hierarchy));
+		}
+	}
+
+	loaded.rawClipBytes = 0;
+	loaded.compressedClipBytes = 0;
+	loaded.compressedClips.clear();
+	for (size_t i = 0; i < clips.size(); ++i) {
+		loaded.compressedClips.push_back(compressAnimation(clips[i], loaded.hierarchy, compressionTolerance));
+		loaded.rawClipBytes += animationClipBytes(clips[i]);
+		loaded.compressedClipBytes += compressedClipBytes(loaded.compressedClips[i]);
+	}
+
+	// Baked poses of the first clip
+	BakedAnimation &animation = loaded.bakedAnimation;
+	animation.jointCount = 0;
+	animation.frameCount = 0;
+	if (!clips.empty() && !loaded.inverseBindMatrices.empty()) {
+		int jointCount = (int)loaded.inverseBindMatrices[0].size();
+		if (fileModifiedTime(gltfFile) > fileModifiedTime(bakedFile)
+			|| !loadBakedAnimation(bakedFile, animation) || animation.jointCount != jointCount) {
+			animation = bakeAnimation(clips[0], loaded.hierarchy, 0, loaded.inverseBindMatrices[0], 30.0f);
+			if (saveBakedAnimation(bakedFile, animation)) {
+				std::cout << "Baked animation: " << bakedFile << std::endl;
+			}
+		}
+	}
+
+	loaded.keyframedClips.swap(clips);
+	return true;
+}
+
+void releaseModelData(LoadedModel &loaded)
+{
+	unloadCookedModel(loaded.cooked);
+}
+
+void ModelLoader::start(const char *gltfFile, const char *cookedFile, const char *bakedFile,
+	int packingFlags, float compressionTolerance)
+{
+	state = LOAD_PENDING;
+
+	// The thread keeps its own copies of the file names
+	std::string gltf(gltfFile), cooked(cookedFile), baked(bakedFile);
+	thread = std::thread([this, gltf, cooked, baked, packingFlags, compressionTolerance]() {
+		std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+		bool ok = loadModelData(gltf.c_str(), cooked.c_str(), baked.c_str(), packingFlags,
+			compressionTolerance, model);
+		loadTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		// Publishes the model and loadTime to the thread that polls
+		state = ok ? LOAD_READY : LOAD_FAILED;
+	});
+}
+
+void ModelLoader::cleanup()
+{
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
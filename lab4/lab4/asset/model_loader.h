@@ -0,0 +1,104 @@
+#ifndef _MODEL_LOADER_H_
+#define _MODEL_LOADER_H_
+
+#include <animation/animation.h>
+#include <animation/bake.h>
+#include <animation/compression.h>
+#include <animation/skeleton.h>
+#include <asset/cooked_model.h>
+#include <asset/mesh_packing.h>
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything lab4_character needs from disk, decoded on the CPU and ready
+// to be uploaded
+struct LoadedModel {
+	std::string source;			// The file the model was read from
+
+	// Layout and draw tables of the mesh. Its vertex and index data are only
+	// filled for a model packed from the glTF; a cooked model's stay in the
+	// mapped file until releaseModelData().
+	PackedMesh mesh;
+	CookedModel cooked;
+	SkeletonHierarchy hierarchy;
+	std::vector<std::vector<glm::mat4> > inverseBindMatrices;	// Per skin
+
+	// Compressed for playback. The keyframed clips are kept to be resampled
+	// onto a uniform grid on demand, see resampleAnimation().
+	std::vector<CompressedClip> compressedClips;
+	std::vector<AnimationClip> keyframedClips;
+	size_t rawClipBytes;
+	size_t compressedClipBytes;
+
+	// Poses of the first clip, frameCount 0 if the model has no skinned clip
+	BakedAnimation bakedAnimation;
+
+	const void *vertexData() const {
+		if (cooked.data != NULL) {
+			return cooked.vertexData();
+		}
+		return mesh.vertices.empty() ? NULL : &mesh.vertices[0];
+	}
+
+	size_t vertexBytes() const {
+		return cooked.data != NULL ? (size_t)cooked.vertices.size : mesh.vertices.size();
+	}
+
+	const void *indexData() const {
+		if (cooked.data != NULL) {
+			return cooked.indexData();
+		}
+		return mesh.indices.empty() ? NULL : &mesh.indices[0];
+	}
+
+	size_t indexBytes() const {
+		return cooked.data != NULL ? (size_t)cooked.indices.size : mesh.indices.size();
+	}
+};
+
+// The whole CPU side of loading: map the cooked model, cooking the glTF
+// first if the cooked file is missing, from another cooker version, packed
+// with other flags or older than the .gltf file (its .bin buffers are not
+// checked). Then compress the clips with the given tolerance and load the
+// baked poses, baking and saving them if they are missing, older than the
+// .gltf file or do not match the skin.
+bool loadModelData(const char *gltfFile, const char *cookedFile, const char *bakedFile,
+	int packingFlags, float compressionTolerance, LoadedModel &loaded);
+
+// Unmap the cooked file once its vertex and index data are uploaded
+void releaseModelData(LoadedModel &loaded);
+
+enum LoadState {
+	LOAD_PENDING,
+	LOAD_READY,
+	LOAD_FAILED
+};
+
+// Runs loadModelData() on a thread of its own so the caller keeps drawing
+// frames. It is not a job of the job system: the main thread runs queued
+// jobs while it waits for the animation update, and would end up running
+// the whole load inside a frame.
+struct ModelLoader {
+	std::thread thread;
+	std::atomic<int> state;
+	LoadedModel model;			// Valid once the state is LOAD_READY
+	double loadTime;			// Seconds spent on the loading thread
+
+	ModelLoader() : state(LOAD_FAILED), loadTime(0.0) {}
+
+	void start(const char *gltfFile, const char *cookedFile, const char *bakedFile,
+		int packingFlags, float compressionTolerance);
+
+	LoadState poll() const {
+		return (LoadState)state.load();
+	}
+
+	// Wait for the loading thread
+	void cleanup();
+};
+
+#endif
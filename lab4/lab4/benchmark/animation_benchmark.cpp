@@ -0,0 +1,419 @@
+// Runs the per-frame animation work of lab4_character for a crowd of bots
+// without a window or GL context, for regression runs on machines without
+// a GPU. Each frame goes through the same stages as MyBot::update and
+// writePalette, one stage at a time over all characters so that each can
+// be timed on its own:
+//
+//   sample     decode the compressed clip into local joint transforms
+//   hierarchy  propagate the changed joints to their global transforms
+//   palette    multiply by the inverse bind matrices and encode the palette
+//   blend      blend the palettes of time sliced characters
+//   gather     append every palette into the frame's palette buffer
+//
+// Every character is treated as visible. With animation LOD on, each is
+// time sliced by its height on screen from lab4_character's initial camera,
+// with the same full rate height and budget, as in
+// MyBot::scheduleAnimation. Prints mean, median and 99th percentile time
+// per frame of each stage and of the whole frame, the poses sampled and
+// heap allocations made per frame, as JSON on stdout. Fails if any frame
+// after the first allocates.
+//
+// Usage: lab4_animation_benchmark [model.gltf] [characters] [frames] [encoding] [lod]
+// where encoding is 0 for mat4, 1 for mat3x4 or 2 for dual quaternions, and
+// lod is 1 to enable animation LOD.
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/skinning.h>
+#include <animation/compression.h>
+#include <animation/update_schedule.h>
+#include <render/joint_palette.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <new>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <math.h>
+
+// Every heap allocation of the process goes through these counters
+static size_t allocationCount = 0;
+static size_t allocationBytes = 0;
+
+void *operator new(size_t size)
+{
+	allocationCount++;
+	allocationBytes += size;
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+// The per-instance state of MyBot::InstanceObject used by the update
+struct Character {
+	glm::mat4 modelMatrix;
+	float time;
+	float speed;
+	std::vector<KeyframeCursor> keyframeCursors;
+	std::vector<glm::mat4> localTransforms;
+	std::vector<glm::mat4> globalTransforms;
+	std::vector<unsigned char> dirtyJoints;
+	std::vector<glm::vec4> paletteTexels;
+
+	// Time slicing
+	int updateInterval;
+	int phase;
+	bool sampled;				// On this frame
+	float sampledTime;
+	float previousTime;
+	std::vector<glm::vec4> previousTexels;
+	std::vector<glm::vec4> blendedTexels;
+};
+
+enum Stage {
+	STAGE_SAMPLE,
+	STAGE_HIERARCHY,
+	STAGE_PALETTE,
+	STAGE_BLEND,
+	STAGE_GATHER,
+	STAGE_FRAME,				// All of the above
+	STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] = { "sample", "hierarchy", "palette", "blend", "gather", "frame" };
+
+// Per frame samples of one stage
+struct StageSamples {
+	std::vector<double> times;	// Microseconds
+	std::vector<size_t> allocations;
+	std::vector<size_t> bytes;
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double elapsedUs(Clock::time_point start, Clock::time_point end)
+{
+	return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p)
+{
+	size_t rank = (size_t)ceil(p * sorted.size());
+	return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+template <typename T>
+static double mean(const std::vector<T> &values)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < values.size(); ++i) {
+		sum += (double)values[i];
+	}
+	return sum / values.size();
+}
+
+static std::string jsonString(const std::string &text)
+{
+	std::string quoted = "\"";
+	for (size_t i = 0; i < text.size(); ++i) {
+		if (text[i] == '"' || text[i] == '\\') {
+			quoted += '\\';
+		}
+		quoted += text[i];
+	}
+	return quoted + "\"";
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int characterCount = std::max(argc > 2 ? atoi(argv[2]) : 1000, 1);
+	int frames = std::max(argc > 3 ? atoi(argv[3]) : 300, 1);
+	PaletteEncoding encoding = (PaletteEncoding)glm::clamp(argc > 4 ? atoi(argv[4]) : 0, 0, 2);
+	bool animationLod = argc > 5 && atoi(argv[5]) != 0;
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+	if (model.animations.empty() || model.skins.empty()) {
+		std::cerr << "Model has no skinned animation." << std::endl;
+		return 1;
+	}
+
+	// Same setup as MyBot::initialize
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	CompressedClip clip = compressAnimation(compileAnimation(model, model.animations[0], hierarchy),
+		hierarchy, 0.5f);
+	std::vector<glm::mat4> inverseBindMatrices = loadInverseBindMatrices(model, model.skins[0]);
+	const std::vector<int> &joints = hierarchy.skinJoints[0];
+	int texelsPerJoint = paletteTexelsPerJoint(encoding);
+
+	std::vector<glm::mat4> restGlobalTransforms;
+	computeGlobalTransforms(hierarchy, hierarchy.restTransforms, restGlobalTransforms);
+	glm::mat4 skinSpace = computeSkinSpace(hierarchy, 0, restGlobalTransforms);
+	glm::mat4 skinSpaceInverse = glm::inverse(skinSpace);
+
+	// Grid, start times and speeds as in MyBot::setCrowdSize
+	std::vector<Character> characters(characterCount);
+	int columns = (int)ceil(sqrt((float)characterCount));
+	for (int i = 0; i < characterCount; ++i) {
+		Character &character = characters[i];
+		float x = (i % columns - (columns - 1) * 0.5f) * 250.0f;
+		character.modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, -(i / columns) * 250.0f));
+		character.time = i == 0 ? 0.0f : (i * 7919 % 1000) / 100.0f;
+		character.speed = i == 0 ? 1.0f : 0.8f + (i * 104729 % 400) / 1000.0f;
+		character.keyframeCursors.resize(clip.tracks.size());
+		character.localTransforms = hierarchy.restTransforms;
+		character.globalTransforms.resize(hierarchy.nodes.size());
+		character.dirtyJoints.assign(hierarchy.nodes.size(), 1);
+		character.paletteTexels.resize(joints.size() * texelsPerJoint);
+		character.updateInterval = 1;
+		character.phase = i % MAX_UPDATE_INTERVAL;
+	}
+
+	// Heights on screen from the initial camera of lab4_character, with the
+	// bounds of MyBot::beginUpload
+	float scheduledUpdates = (float)characterCount;
+	if (animationLod) {
+		glm::vec3 boundsCenter(0.0f);
+		for (size_t j = 0; j < joints.size(); ++j) {
+			boundsCenter += glm::vec3(restGlobalTransforms[joints[j]][3]) / (float)joints.size();
+		}
+		float boundsRadius = 0.0f;
+		for (size_t j = 0; j < joints.size(); ++j) {
+			boundsRadius = std::max(boundsRadius, glm::length(glm::vec3(restGlobalTransforms[joints[j]][3]) - boundsCenter));
+		}
+		boundsRadius *= 1.5f;
+
+		const glm::vec3 eye(0.0f, 100.0f, 800.0f);
+		const float viewportHeight = 768.0f;
+		float pixelScale = viewportHeight * 0.5f / tan(glm::radians(45.0f) * 0.5f);
+
+		std::vector<float> screenHeights(characterCount);
+		for (int i = 0; i < characterCount; ++i) {
+			glm::vec3 center(characters[i].modelMatrix * glm::vec4(boundsCenter, 1.0f));
+			float distance = std::max(glm::length(center - eye) - boundsRadius, 1.0f);
+			screenHeights[i] = 2.0f * boundsRadius * pixelScale / distance;
+		}
+
+		std::vector<int> intervals;
+		scheduledUpdates = scheduleUpdates(screenHeights, 300.0f, 250.0f, intervals);
+		for (int i = 0; i < characterCount; ++i) {
+			characters[i].updateInterval = intervals[i];
+		}
+	}
+
+	// Pose every character at its start time, so the time sliced ones have
+	// a sample to blend from
+	for (size_t i = 0; i < characters.size(); ++i) {
+		Character &character = characters[i];
+		sampleAnimation(clip, hierarchy, character.time, character.keyframeCursors,
+			character.localTransforms, &character.dirtyJoints);
+		updateGlobalTransforms(hierarchy, character.localTransforms, character.globalTransforms,
+			character.dirtyJoints);
+		for (size_t j = 0; j < joints.size(); ++j) {
+			glm::mat4 jointMatrix = character.globalTransforms[joints[j]] * inverseBindMatrices[j];
+			if (encoding == PALETTE_DUAL_QUATERNION) {
+				jointMatrix = skinSpaceInverse * jointMatrix * skinSpace;
+			} else {
+				jointMatrix = character.modelMatrix * jointMatrix;
+			}
+			encodePaletteJoint(jointMatrix, encoding, &character.paletteTexels[j * texelsPerJoint]);
+		}
+		std::fill(character.dirtyJoints.begin(), character.dirtyJoints.end(), 0);
+		character.sampledTime = character.time;
+		character.previousTime = character.time;
+		character.previousTexels = character.paletteTexels;
+		character.blendedTexels = character.paletteTexels;
+	}
+
+	JointPaletteBuffer palettes;
+	palettes.texels.reserve((size_t)characterCount * joints.size() * texelsPerJoint);
+
+	// 60 Hz at the default playback speed of lab4_character
+	const float deltaTime = 2.0f / 60.0f;
+
+	// Recorded outside the stages, but sized up front so that nothing in the
+	// timed loop allocates
+	StageSamples samples[STAGE_COUNT];
+	for (int s = 0; s < STAGE_COUNT; ++s) {
+		samples[s].times.reserve(frames);
+		samples[s].allocations.reserve(frames);
+		samples[s].bytes.reserve(frames);
+	}
+	std::vector<double> sampledPoses;
+	sampledPoses.reserve(frames);
+	for (int f = 0; f < frames; ++f) {
+		// Counters and clock at the start of each stage, and at the end
+		Clock::time_point stageStart[STAGE_FRAME + 1];
+		size_t countAt[STAGE_FRAME + 1], bytesAt[STAGE_FRAME + 1];
+		int stage = 0;
+		auto beginStage = [&]() {
+			countAt[stage] = allocationCount;
+			bytesAt[stage] = allocationBytes;
+			stageStart[stage++] = Clock::now();
+		};
+
+		// Time sliced characters sample ahead on their update frames, as in
+		// MyBot::updateInstance
+		beginStage();
+		int poses = 0;
+		for (size_t i = 0; i < characters.size(); ++i) {
+			Character &character = characters[i];
+			character.time += deltaTime * character.speed;
+			int interval = character.updateInterval;
+			float sampleTime = character.time;
+			character.sampled = interval == 1 || isUpdateDue(f, character.phase, interval);
+			if (!character.sampled) {
+				continue;
+			}
+			if (interval > 1) {
+				character.previousTexels = character.paletteTexels;
+				character.previousTime = character.sampledTime;
+				sampleTime += framesToUpdate(f, character.phase, interval) * deltaTime * character.speed;
+			}
+			sampleAnimation(clip, hierarchy, sampleTime, character.keyframeCursors,
+				character.localTransforms, &character.dirtyJoints);
+			character.sampledTime = sampleTime;
+			poses++;
+		}
+		sampledPoses.push_back(poses);
+
+		beginStage();
+		for (size_t i = 0; i < characters.size(); ++i) {
+			Character &character = characters[i];
+			if (!character.sampled) {
+				continue;
+			}
+			updateGlobalTransforms(hierarchy, character.localTransforms, character.globalTransforms,
+				character.dirtyJoints);
+		}
+
+		beginStage();
+		for (size_t i = 0; i < characters.size(); ++i) {
+			Character &character = characters[i];
+			if (!character.sampled) {
+				continue;
+			}
+			for (size_t j = 0; j < joints.size(); ++j) {
+				if (!character.dirtyJoints[joints[j]]) {
+					continue;
+				}
+				glm::mat4 jointMatrix = character.globalTransforms[joints[j]] * inverseBindMatrices[j];
+				if (encoding == PALETTE_DUAL_QUATERNION) {
+					jointMatrix = skinSpaceInverse * jointMatrix * skinSpace;
+				} else {
+					jointMatrix = character.modelMatrix * jointMatrix;
+				}
+				encodePaletteJoint(jointMatrix, encoding, &character.paletteTexels[j * texelsPerJoint]);
+			}
+			std::fill(character.dirtyJoints.begin(), character.dirtyJoints.end(), 0);
+		}
+
+		beginStage();
+		for (size_t i = 0; i < characters.size(); ++i) {
+			Character &character = characters[i];
+			if (character.updateInterval > 1) {
+				float span = character.sampledTime - character.previousTime;
+				float factor = span > 0.0f ? glm::clamp((character.time - character.previousTime) / span, 0.0f, 1.0f) : 1.0f;
+				blendPalette(character.previousTexels, character.paletteTexels, encoding, factor,
+					character.blendedTexels);
+			}
+		}
+
+		beginStage();
+		palettes.clear();
+		for (size_t i = 0; i < characters.size(); ++i) {
+			const Character &character = characters[i];
+			palettes.add(character.updateInterval > 1 ? character.blendedTexels : character.paletteTexels);
+		}
+
+		beginStage();
+
+		for (int s = 0; s < STAGE_FRAME; ++s) {
+			samples[s].times.push_back(elapsedUs(stageStart[s], stageStart[s + 1]));
+			samples[s].allocations.push_back(countAt[s + 1] - countAt[s]);
+			samples[s].bytes.push_back(bytesAt[s + 1] - bytesAt[s]);
+		}
+		samples[STAGE_FRAME].times.push_back(elapsedUs(stageStart[0], stageStart[STAGE_FRAME]));
+		samples[STAGE_FRAME].allocations.push_back(countAt[STAGE_FRAME] - countAt[0]);
+		samples[STAGE_FRAME].bytes.push_back(bytesAt[STAGE_FRAME] - bytesAt[0]);
+	}
+
+	// The per-character state is sized at setup, so after the first frame
+	// warmed up the update must not touch the heap
+	size_t steadyAllocations = 0;
+	for (int f = 1; f < frames; ++f) {
+		steadyAllocations += samples[STAGE_FRAME].allocations[f];
+	}
+	if (steadyAllocations > 0) {
+		std::cerr << steadyAllocations << " heap allocations after the first frame." << std::endl;
+		return 1;
+	}
+
+	// A value derived from the palettes, so the work cannot be optimized away
+	double checksum = 0.0;
+	for (size_t i = 0; i < palettes.texels.size(); i += texelsPerJoint) {
+		checksum += palettes.texels[i].x;
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "{" << std::endl;
+	std::cout << "  \"model\": " << jsonString(filename) << "," << std::endl;
+	std::cout << "  \"characters\": " << characterCount << "," << std::endl;
+	std::cout << "  \"frames\": " << frames << "," << std::endl;
+	std::cout << "  \"joints\": " << joints.size() << "," << std::endl;
+	std::cout << "  \"encoding\": " << jsonString(paletteEncodingName(encoding)) << "," << std::endl;
+	std::cout << "  \"animation_lod\": " << (animationLod ? "true" : "false") << "," << std::endl;
+	std::cout << "  \"scheduled_poses_per_frame\": " << scheduledUpdates << "," << std::endl;
+	std::cout << "  \"poses_per_frame\": {\"mean\": " << mean(sampledPoses)
+		<< ", \"max\": " << *std::max_element(sampledPoses.begin(), sampledPoses.end()) << "}," << std::endl;
+	std::cout << "  \"checksum\": " << checksum << "," << std::endl;
+	std::cout << "  \"stages\": {" << std::endl;
+	for (int s = 0; s < STAGE_COUNT; ++s) {
+		std::vector<double> sorted = samples[s].times;
+		std::sort(sorted.begin(), sorted.end());
+		std::cout << "    " << jsonString(stageNames[s]) << ": {"
+			<< "\"mean_us\": " << mean(sorted)
+			<< ", \"p50_us\": " << percentile(sorted, 0.5)
+			<< ", \"p99_us\": " << percentile(sorted, 0.99)
+			<< ", \"allocations_per_frame\": " << mean(samples[s].allocations)
+			<< ", \"allocated_bytes_per_frame\": " << mean(samples[s].bytes)
+			<< "}" << (s + 1 < STAGE_COUNT ? "," : "") << std::endl;
+	}
+	std::cout << "  }" << std::endl;
+	std::cout << "}" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+// Compresses the animations of a glTF model at several tolerances and
+// reports the size reduction, the joint position error against the
+// uncompressed clip, and the sampling cost of both.
+//
+// Usage: lab4_compression_benchmark [model.gltf] [samples]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/compression.h>
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+template <typename Clip>
+static double measureSampling(const Clip &clip, const SkeletonHierarchy &hierarchy, int samples)
+{
+	std::vector<KeyframeCursor> cursors(clip.tracks.size());
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int s = 0; s < samples; ++s) {
+		sampleAnimation(clip, hierarchy, s / 60.0f, cursors, localTransforms);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / samples;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int samples = argc > 2 ? atoi(argv[2]) : 2000;
+	if (samples < 1) {
+		samples = 1;
+	}
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	std::vector<AnimationClip> clips;
+	size_t rawBytes = 0;
+	for (const auto &anim : model.animations) {
+		clips.push_back(compileAnimation(model, anim, hierarchy));
+		rawBytes += animationClipBytes(clips.back());
+	}
+	if (clips.empty()) {
+		std::cerr << "Model has no animation." << std::endl;
+		return 1;
+	}
+
+	double rawSampleUs = measureSampling(clips[0], hierarchy, samples);
+
+	std::cout << clips.size() << " clips, " << rawBytes / 1024 << " KB uncompressed, "
+		<< std::fixed << std::setprecision(2) << rawSampleUs << " us per sample" << std::endl;
+	std::cout << std::setw(10) << "tolerance" << std::setw(10) << "keys"
+		<< std::setw(10) << "KB" << std::setw(8) << "ratio"
+		<< std::setw(12) << "max err" << std::setw(12) << "mean err"
+		<< std::setw(12) << "sample us" << std::setw(12) << "compress ms" << std::endl;
+
+	const float tolerances[] = { 0.01f, 0.05f, 0.1f, 0.5f, 1.0f };
+	for (float tolerance : tolerances) {
+		std::vector<CompressedClip> compressed;
+		size_t bytes = 0, keys = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const auto &clip : clips) {
+			compressed.push_back(compressAnimation(clip, hierarchy, tolerance));
+			bytes += compressedClipBytes(compressed.back());
+			keys += compressed.back().times.size();
+		}
+		double compressMs = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+		// Joint positions in model space against the uncompressed clips
+		double maxError = 0.0, sumError = 0.0;
+		size_t count = 0;
+		for (size_t c = 0; c < clips.size(); ++c) {
+			std::vector<KeyframeCursor> rawCursors(clips[c].tracks.size());
+			std::vector<KeyframeCursor> cursors(compressed[c].tracks.size());
+			std::vector<glm::mat4> rawLocal = hierarchy.restTransforms, local = hierarchy.restTransforms;
+			std::vector<glm::mat4> rawGlobal, global;
+
+			for (int s = 0; s < samples; ++s) {
+				float time = clips[c].duration * s / samples;
+				sampleAnimation(clips[c], hierarchy, time, rawCursors, rawLocal);
+				sampleAnimation(compressed[c], hierarchy, time, cursors, local);
+				computeGlobalTransforms(hierarchy, rawLocal, rawGlobal);
+				computeGlobalTransforms(hierarchy, local, global);
+
+				for (size_t j = 0; j < global.size(); ++j) {
+					double error = glm::length(glm::vec3(global[j][3] - rawGlobal[j][3]));
+					maxError = std::max(maxError, error);
+					sumError += error;
+					count++;
+				}
+			}
+		}
+
+		std::cout << std::setw(10) << tolerance << std::setw(10) << keys
+			<< std::setw(10) << bytes / 1024 << std::setw(7) << std::setprecision(1) << (double)rawBytes / bytes << "x"
+			<< std::setw(12) << std::setprecision(4) << maxError << std::setw(12) << sumError / count
+			<< std::setw(12) << std::setprecision(2) << measureSampling(compressed[0], hierarchy, samples)
+			<< std::setw(12) << compressMs << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+// Measures the CPU cost of submitting the bot's draws, per frame, for the
+// original scene traversal and for the precompiled draw list. The GL entry
+// points are replaced by stubs that only count calls, so the numbers are
+// the application side of submission without any driver work and the
+// benchmark runs without a window or GL context.
+//
+// Usage: lab4_draw_submission_benchmark [model.gltf] [frames]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <asset/mesh_packing.h>
+#include <render/draw_list.h>
+
+#include <map>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+static unsigned long glCalls = 0;
+
+static void GLAD_API_PTR stubBindVertexArray(GLuint) { glCalls++; }
+static void GLAD_API_PTR stubBindBuffer(GLenum, GLuint) { glCalls++; }
+static void GLAD_API_PTR stubDrawElements(GLenum, GLsizei, GLenum, const void *) { glCalls++; }
+static void GLAD_API_PTR stubDrawElementsInstancedBaseVertex(GLenum, GLsizei, GLenum, const void *, GLsizei, GLint) { glCalls++; }
+
+// The per-frame traversal lab4_character started with: recurse the nodes
+// and copy the buffer map, primitive and accessor for every draw
+struct TraversalPrimitive {
+	GLuint vao;
+	std::map<int, GLuint> vbos;
+};
+
+static void drawMesh(const std::vector<TraversalPrimitive> &primitiveObjects,
+	const tinygltf::Model &model, const tinygltf::Mesh &mesh)
+{
+	for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+		GLuint vao = primitiveObjects[i].vao;
+		std::map<int, GLuint> vbos = primitiveObjects[i].vbos;
+
+		glBindVertexArray(vao);
+
+		tinygltf::Primitive primitive = mesh.primitives[i];
+		tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
+
+		glDrawElements(primitive.mode, (GLsizei)indexAccessor.count,
+			indexAccessor.componentType, BUFFER_OFFSET(indexAccessor.byteOffset));
+
+		glBindVertexArray(0);
+	}
+}
+
+static void drawModelNodes(const std::vector<TraversalPrimitive> &primitiveObjects,
+	const tinygltf::Model &model, const tinygltf::Node &node)
+{
+	if (node.mesh >= 0 && node.mesh < (int)model.meshes.size()) {
+		drawMesh(primitiveObjects, model, model.meshes[node.mesh]);
+	}
+	for (size_t i = 0; i < node.children.size(); ++i) {
+		drawModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+	}
+}
+
+template <typename Submit>
+static double measure(int frames, Submit submit, unsigned long &callsPerFrame)
+{
+	glCalls = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int f = 0; f < frames; ++f) {
+		submit();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	callsPerFrame = glCalls / frames;
+	return std::chrono::duration<double, std::micro>(end - start).count() / frames;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int frames = argc > 2 ? atoi(argv[2]) : 100000;
+	if (frames < 1) {
+		frames = 1;
+	}
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+
+	glad_glBindVertexArray = stubBindVertexArray;
+	glad_glBindBuffer = stubBindBuffer;
+	glad_glDrawElements = stubDrawElements;
+	glad_glDrawElementsInstancedBaseVertex = stubDrawElementsInstancedBaseVertex;
+
+	// Fake object names, laid out as the original upload created them
+	std::map<int, GLuint> vbos;
+	for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+		vbos[(int)i] = (GLuint)i + 1;
+	}
+	std::vector<TraversalPrimitive> primitiveObjects;
+	for (size_t m = 0; m < model.meshes.size(); ++m) {
+		for (size_t i = 0; i < model.meshes[m].primitives.size(); ++i) {
+			TraversalPrimitive primitiveObject;
+			primitiveObject.vao = (GLuint)primitiveObjects.size() + 1;
+			primitiveObject.vbos = vbos;
+			primitiveObjects.push_back(primitiveObject);
+		}
+	}
+
+	PackedMesh mesh = packModelMeshes(model);
+	DrawList drawList;
+	for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+		const PackedPrimitive &primitive = mesh.primitives[i];
+		drawList.add(1, primitive.mode, primitive.indexCount, mesh.indexType,
+			primitive.indexOffset, primitive.baseVertex);
+	}
+
+	const tinygltf::Scene &scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
+	unsigned long traversalCalls = 0, drawListCalls = 0;
+	double traversalUs = measure(frames, [&]() {
+		for (size_t i = 0; i < scene.nodes.size(); ++i) {
+			drawModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+		}
+	}, traversalCalls);
+	double drawListUs = measure(frames, [&]() {
+		drawList.submit(1);
+	}, drawListCalls);
+
+	std::cout << std::fixed << std::setprecision(3)
+		<< drawList.commands.size() << " draws per frame, " << frames << " frames" << std::endl
+		<< "Scene traversal: " << traversalUs << " us, " << traversalCalls << " GL calls per frame" << std::endl
+		<< "Draw list:       " << drawListUs << " us, " << drawListCalls << " GL calls per frame" << std::endl;
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Compares keyframe lookup by bisection against the cached playback cursor
+// on long synthetic clips. Channels play back at different speeds and wrap
+// around the end of the clip, like MyBot::updateAnimation does.
+
+#include <animation/animation.h>
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <math.h>
+
+static const int numChannels = 256;
+static const int numFrames = 2000;
+static const float frameTime = 1.0f / 60.0f;
+
+// Irregularly spaced keyframe times, starting at 0 like glTF exports do
+static std::vector<float> makeKeyTimes(int count)
+{
+	std::vector<float> times(count);
+	float t = 0.0f;
+	for (int i = 0; i < count; ++i) {
+		times[i] = t;
+		t += (1.0f + (rand() % 100) / 100.0f) / 30.0f;
+	}
+	return times;
+}
+
+int main()
+{
+	srand(1);
+
+	const int keyCounts[] = { 16, 256, 4096, 65536 };
+
+	std::cout << std::setw(8) << "keys"
+		<< std::setw(18) << "bisection (ns)"
+		<< std::setw(18) << "cursor (ns)"
+		<< std::setw(10) << "speedup" << std::endl;
+
+	for (int keyCount : keyCounts) {
+		std::vector<float> times = makeKeyTimes(keyCount);
+		float duration = times.back();
+
+		std::vector<float> speeds(numChannels);
+		for (int c = 0; c < numChannels; ++c) {
+			speeds[c] = 1.0f + (c % 10);
+		}
+
+		// Bisection from scratch on every sample
+		long checksum0 = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < numFrames; ++f) {
+			for (int c = 0; c < numChannels; ++c) {
+				float animationTime = fmod(f * frameTime * speeds[c], duration);
+				checksum0 += findKeyframeIndex(times, animationTime);
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double bisectionNs = std::chrono::duration<double, std::nano>(end - start).count();
+
+		// Cursor stepping forward from the previous frame
+		std::vector<KeyframeCursor> cursors(numChannels);
+		long checksum1 = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < numFrames; ++f) {
+			for (int c = 0; c < numChannels; ++c) {
+				float animationTime = fmod(f * frameTime * speeds[c], duration);
+				checksum1 += findKeyframeIndex(times, animationTime, cursors[c]);
+			}
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double cursorNs = std::chrono::duration<double, std::nano>(end - start).count();
+
+		if (checksum0 != checksum1) {
+			std::cerr << "Mismatch between bisection and cursor for " << keyCount << " keys" << std::endl;
+			return 1;
+		}
+
+		double samples = double(numFrames) * numChannels;
+		std::cout << std::fixed << std::setprecision(2)
+			<< std::setw(8) << keyCount
+			<< std::setw(18) << bisectionNs / samples
+			<< std::setw(18) << cursorNs / samples
+			<< std::setw(9) << bisectionNs / cursorNs << "x" << std::endl;
+	}
+
+	return 0;
+}
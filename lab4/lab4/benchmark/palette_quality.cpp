@@ -0,0 +1,144 @@
+// Compares the compact joint palette encodings against the full mat4 path
+// on the bot animation: the mesh is skinned on the CPU with the same math
+// as bot.vert at evenly spaced times over the first clip, and the position
+// and normal differences to mat4 linear blend skinning are reported along
+// with the palette size of each encoding.
+//
+// Usage: lab4_palette_quality [model.gltf] [samples]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/skinning.h>
+
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+struct Error {
+	double maxPosition;
+	double sumPosition;
+	double maxNormalDegrees;
+	size_t vertices;
+};
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int samples = argc > 2 ? atoi(argv[2]) : 50;
+	if (samples < 1) {
+		samples = 1;
+	}
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+	if (model.skins.empty() || model.animations.empty()) {
+		std::cerr << "Model has no skin or no animation." << std::endl;
+		return 1;
+	}
+
+	std::vector<SkinnedMesh> meshes;
+	for (const auto &mesh : model.meshes) {
+		for (const auto &primitive : mesh.primitives) {
+			SkinnedMesh skinnedMesh;
+			if (loadSkinnedMesh(model, primitive, skinnedMesh)) {
+				meshes.push_back(skinnedMesh);
+			}
+		}
+	}
+
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	AnimationClip clip = compileAnimation(model, model.animations[0], hierarchy);
+	std::vector<glm::mat4> inverseBindMatrices = loadInverseBindMatrices(model, model.skins[0]);
+
+	const PaletteEncoding encodings[] = { PALETTE_MAT3X4, PALETTE_DUAL_QUATERNION };
+	const int encodingCount = sizeof(encodings) / sizeof(encodings[0]);
+	Error errors[encodingCount] = {};
+
+	std::vector<KeyframeCursor> cursors(clip.tracks.size());
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+	std::vector<glm::mat4> globalTransforms, jointMatrices, rigidMatrices;
+	std::vector<glm::vec4> texels;
+	SkinnedVertices reference, encoded;
+
+	for (int s = 0; s < samples; ++s) {
+		float time = clip.duration * s / samples;
+		sampleAnimation(clip, hierarchy, time, cursors, localTransforms);
+		computeGlobalTransforms(hierarchy, localTransforms, globalTransforms);
+		computeJointMatrices(hierarchy, 0, globalTransforms, inverseBindMatrices, jointMatrices);
+
+		glm::mat4 skinSpace = computeSkinSpace(hierarchy, 0, globalTransforms);
+		glm::mat4 skinSpaceInverse = glm::inverse(skinSpace);
+		rigidMatrices.resize(jointMatrices.size());
+		for (size_t j = 0; j < jointMatrices.size(); ++j) {
+			rigidMatrices[j] = skinSpaceInverse * jointMatrices[j] * skinSpace;
+		}
+
+		for (size_t m = 0; m < meshes.size(); ++m) {
+			const SkinnedMesh &mesh = meshes[m];
+			size_t count = mesh.positions.size();
+			reference.positions.resize(count);
+			reference.normals.resize(count);
+			encoded.positions.resize(count);
+			encoded.normals.resize(count);
+			skinVerticesReference(mesh, jointMatrices, reference, 0, count);
+
+			for (int e = 0; e < encodingCount; ++e) {
+				bool rigid = encodings[e] == PALETTE_DUAL_QUATERNION;
+				encodePalette(rigid ? rigidMatrices : jointMatrices, encodings[e], texels);
+				skinVerticesEncoded(mesh, texels, encodings[e], skinSpace, encoded, 0, count);
+
+				Error &error = errors[e];
+				for (size_t i = 0; i < count; ++i) {
+					double distance = glm::length(glm::vec3(encoded.positions[i] - reference.positions[i]));
+					float cosine = glm::clamp(glm::dot(encoded.normals[i], reference.normals[i]), -1.0f, 1.0f);
+					double degrees = glm::degrees(acos(cosine));
+					error.maxPosition = std::max(error.maxPosition, distance);
+					error.sumPosition += distance;
+					error.maxNormalDegrees = std::max(error.maxNormalDegrees, degrees);
+					error.vertices++;
+				}
+			}
+		}
+	}
+
+	// Model extent, to put position errors in proportion
+	glm::vec3 minimum(1e30f), maximum(-1e30f);
+	for (const auto &mesh : meshes) {
+		for (const auto &p : mesh.positions) {
+			minimum = glm::min(minimum, glm::vec3(p));
+			maximum = glm::max(maximum, glm::vec3(p));
+		}
+	}
+	double extent = glm::length(maximum - minimum);
+
+	size_t jointCount = inverseBindMatrices.size();
+	std::cout << "Palette quality against mat4, " << samples << " poses, "
+		<< jointCount << " joints, model extent " << std::fixed << std::setprecision(1) << extent << std::endl;
+	std::cout << std::left << std::setw(18) << "encoding" << std::right
+		<< std::setw(14) << "bytes/joint" << std::setw(14) << "vs mat4"
+		<< std::setw(14) << "max pos" << std::setw(14) << "mean pos" << std::setw(16) << "max normal deg" << std::endl;
+	std::cout << std::left << std::setw(18) << paletteEncodingName(PALETTE_MAT4) << std::right
+		<< std::setw(14) << paletteTexelsPerJoint(PALETTE_MAT4) * 16 << std::setw(13) << 100.0 << "%"
+		<< std::setw(14) << "-" << std::setw(14) << "-" << std::setw(16) << "-" << std::endl;
+	for (int e = 0; e < encodingCount; ++e) {
+		int bytes = paletteTexelsPerJoint(encodings[e]) * 16;
+		std::cout << std::left << std::setw(18) << paletteEncodingName(encodings[e]) << std::right
+			<< std::setw(14) << bytes << std::setw(13) << std::setprecision(1) << 100.0 * bytes / 64 << "%"
+			<< std::setprecision(4)
+			<< std::setw(14) << errors[e].maxPosition
+			<< std::setw(14) << errors[e].sumPosition / errors[e].vertices
+			<< std::setw(16) << std::setprecision(2) << errors[e].maxNormalDegrees << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+// Resamples the animations of a glTF model onto uniform grids at several
+// rates and reports the memory against the keyframed and compressed clips,
+// the joint position error against the keyframed clip, and the sampling
+// cost of all three.
+//
+// Usage: lab4_resample_benchmark [model.gltf] [samples]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/compression.h>
+#include <animation/resample.h>
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+// Microseconds per sample, stepping at 60 Hz as lab4_character does
+template <typename Clip>
+static double measureSampling(const Clip &clip, const SkeletonHierarchy &hierarchy, int samples)
+{
+	std::vector<KeyframeCursor> cursors(clip.tracks.size());
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int s = 0; s < samples; ++s) {
+		sampleAnimation(clip, hierarchy, s / 60.0f, cursors, localTransforms);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / samples;
+}
+
+static double measureSampling(const UniformClip &clip, const SkeletonHierarchy &hierarchy, int samples)
+{
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int s = 0; s < samples; ++s) {
+		sampleAnimation(clip, hierarchy, s / 60.0f, localTransforms);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / samples;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int samples = argc > 2 ? atoi(argv[2]) : 2000;
+	if (samples < 1) {
+		samples = 1;
+	}
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	std::vector<AnimationClip> clips;
+	size_t rawBytes = 0, compressedBytes = 0;
+	for (const auto &anim : model.animations) {
+		clips.push_back(compileAnimation(model, anim, hierarchy));
+		rawBytes += animationClipBytes(clips.back());
+	}
+	if (clips.empty()) {
+		std::cerr << "Model has no animation." << std::endl;
+		return 1;
+	}
+
+	// The tolerance lab4_character plays back with
+	CompressedClip compressed = compressAnimation(clips[0], hierarchy, 0.5f);
+	for (size_t c = 0; c < clips.size(); ++c) {
+		compressedBytes += compressedClipBytes(compressAnimation(clips[c], hierarchy, 0.5f));
+	}
+
+	std::cout << clips.size() << " clips" << std::fixed << std::setprecision(2) << std::endl;
+	std::cout << "  keyframed:  " << std::setw(6) << rawBytes / 1024 << " KB, "
+		<< measureSampling(clips[0], hierarchy, samples) << " us per sample" << std::endl;
+	std::cout << "  compressed: " << std::setw(6) << compressedBytes / 1024 << " KB, "
+		<< measureSampling(compressed, hierarchy, samples) << " us per sample" << std::endl;
+	std::cout << std::setw(10) << "rate" << std::setw(10) << "frames"
+		<< std::setw(10) << "KB" << std::setw(12) << "max err"
+		<< std::setw(12) << "sample us" << std::setw(12) << "resample ms" << std::endl;
+
+	const float rates[] = { 10.0f, 15.0f, 30.0f, 60.0f, 120.0f };
+	for (float rate : rates) {
+		std::vector<UniformClip> uniform;
+		size_t bytes = 0, frames = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const auto &clip : clips) {
+			uniform.push_back(resampleAnimation(clip, rate));
+			bytes += uniformClipBytes(uniform.back());
+			frames += uniform.back().frameCount;
+		}
+		double resampleMs = std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+		// Eight samples per grid interval catch the peaks between frames
+		float maxError = 0.0f;
+		for (size_t c = 0; c < clips.size(); ++c) {
+			maxError = std::max(maxError, resampleError(uniform[c], clips[c], hierarchy, 8));
+		}
+
+		std::cout << std::setw(10) << std::setprecision(0) << rate << std::setw(10) << frames
+			<< std::setw(10) << bytes / 1024
+			<< std::setw(12) << std::setprecision(4) << maxError
+			<< std::setw(12) << std::setprecision(2) << measureSampling(uniform[0], hierarchy, samples)
+			<< std::setw(12) << resampleMs << std::endl;
+	}
+
+	return 0;
+}
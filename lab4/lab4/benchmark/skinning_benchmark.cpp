@@ -0,0 +1,149 @@
+// Measures CPU linear blend skinning throughput on the bot model without a
+// window or GL context: the glm reference path, the SSE path on one thread
+// and the SSE path split over all hardware threads by a JobSystem. The
+// pool is started before timing, so thread creation is not measured. The
+// SSE results are checked against the reference before timing.
+//
+// Usage: lab4_skinning_benchmark [model.gltf] [iterations]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/skinning.h>
+#include <jobs/job_system.h>
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+// Single-threaded on purpose: this is the baseline the SSE path is
+// checked and measured against
+static void skinReference(const std::vector<SkinnedMesh> &meshes,
+	const std::vector<glm::mat4> &jointMatrices,
+	std::vector<SkinnedVertices> &out)
+{
+	for (size_t m = 0; m < meshes.size(); ++m) {
+		out[m].positions.resize(meshes[m].positions.size());
+		out[m].normals.resize(meshes[m].normals.size());
+		skinVerticesReference(meshes[m], jointMatrices, out[m], 0, meshes[m].positions.size());
+	}
+}
+
+static void skinSIMD(const std::vector<SkinnedMesh> &meshes,
+	const std::vector<glm::mat4> &jointMatrices,
+	std::vector<SkinnedVertices> &out)
+{
+	for (size_t m = 0; m < meshes.size(); ++m) {
+		skinMesh(meshes[m], jointMatrices, out[m]);
+	}
+}
+
+static void skinSIMDJobs(const std::vector<SkinnedMesh> &meshes,
+	const std::vector<glm::mat4> &jointMatrices,
+	std::vector<SkinnedVertices> &out, JobSystem &jobSystem)
+{
+	for (size_t m = 0; m < meshes.size(); ++m) {
+		skinMesh(meshes[m], jointMatrices, out[m], &jobSystem);
+	}
+}
+
+static double measure(const std::function<void()> &skin, int iterations)
+{
+	skin();	// Warm up
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		skin();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	int iterations = argc > 2 ? atoi(argv[2]) : 200;
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+
+	// Pose the skeleton somewhere in the middle of the first animation
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	std::vector<glm::mat4> localTransforms = hierarchy.restTransforms;
+	std::vector<glm::mat4> globalTransforms;
+	if (!model.animations.empty()) {
+		AnimationClip clip = compileAnimation(model, model.animations[0], hierarchy);
+		std::vector<KeyframeCursor> cursors(clip.tracks.size());
+		sampleAnimation(clip, hierarchy, clip.duration * 0.5f, cursors, localTransforms);
+	}
+	computeGlobalTransforms(hierarchy, localTransforms, globalTransforms);
+
+	std::vector<glm::mat4> jointMatrices;
+	computeJointMatrices(hierarchy, 0, globalTransforms,
+		loadInverseBindMatrices(model, model.skins[0]), jointMatrices);
+
+	std::vector<SkinnedMesh> meshes;
+	size_t vertexCount = 0;
+	for (const auto &mesh : model.meshes) {
+		for (const auto &primitive : mesh.primitives) {
+			SkinnedMesh skinnedMesh;
+			if (loadSkinnedMesh(model, primitive, skinnedMesh)) {
+				vertexCount += skinnedMesh.positions.size();
+				meshes.push_back(skinnedMesh);
+			}
+		}
+	}
+
+	// Validate the SSE path against the reference
+	std::vector<SkinnedVertices> reference(meshes.size()), result(meshes.size());
+	skinReference(meshes, jointMatrices, reference);
+	skinSIMD(meshes, jointMatrices, result);
+	float maxPositionError = 0.0f, maxNormalError = 0.0f;
+	for (size_t m = 0; m < meshes.size(); ++m) {
+		for (size_t i = 0; i < meshes[m].positions.size(); ++i) {
+			maxPositionError = glm::max(maxPositionError, glm::length(reference[m].positions[i] - result[m].positions[i]));
+			maxNormalError = glm::max(maxNormalError, glm::length(reference[m].normals[i] - result[m].normals[i]));
+		}
+	}
+
+	// One worker per hardware thread besides this one
+	JobSystem jobSystem;
+	jobSystem.initialize(0);
+	int threadCount = jobSystem.threadCount();
+
+	std::cout << "Model: " << filename << ", " << meshes.size() << " skinned primitives, "
+		<< vertexCount << " vertices, " << jointMatrices.size() << " joints" << std::endl;
+	std::cout << "Max error vs reference: position " << maxPositionError
+		<< ", normal " << maxNormalError << std::endl;
+
+	struct Run { const char *name; std::function<void()> skin; int threads; };
+	std::vector<Run> runs;
+	runs.push_back({ "reference", [&]() { skinReference(meshes, jointMatrices, result); }, 1 });
+	runs.push_back({ "simd", [&]() { skinSIMD(meshes, jointMatrices, result); }, 1 });
+	if (threadCount > 1) {
+		runs.push_back({ "simd", [&]() { skinSIMDJobs(meshes, jointMatrices, result, jobSystem); }, threadCount });
+	}
+
+	for (const Run &run : runs) {
+		double seconds = measure(run.skin, iterations);
+		double verticesPerSecond = double(vertexCount) * iterations / seconds;
+		std::cout << std::setw(10) << run.name << std::setw(4) << run.threads << " thread(s): "
+			<< std::fixed << std::setprecision(1) << verticesPerSecond / 1e6 << " M vertices/s, "
+			<< std::setprecision(3) << seconds * 1e3 / iterations << " ms per skin" << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+
+	jobSystem.cleanup();
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include "job_system.h"
+
+// Deque of the thread running the current code; 0 for the owning thread
+// and any thread outside the pool
+static thread_local int currentQueue = 0;
+
+void JobSystem::initialize(int workerCount)
+{
+	if (workerCount <= 0) {
+		workerCount = (int)std::thread::hardware_concurrency() - 1;
+	}
+	if (workerCount < 0) {
+		workerCount = 0;
+	}
+
+	running = true;
+	queuedJobs = 0;
+	nextQueue = 0;
+
+	queues.resize(workerCount + 1);
+	for (size_t i = 0; i < queues.size(); ++i) {
+		queues[i] = new JobQueue();
+	}
+
+	currentQueue = 0;
+	for (int i = 1; i <= workerCount; ++i) {
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+}
+
+void JobSystem::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+	}
+	wakeCondition.notify_all();
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	for (size_t i = 0; i < queues.size(); ++i) {
+		delete queues[i];
+	}
+	queues.clear();
+}
+
+void JobSystem::submit(const std::function<void()> &function, JobCounter &counter)
+{
+	Job job;
+	job.function = function;
+	job.counter = &counter;
+	counter.pending.fetch_add(1);
+
+	int index = currentQueue;
+	if (index == 0) {
+		index = (int)(nextQueue.fetch_add(1) % queues.size());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->jobs.push_back(job);
+	}
+	queuedJobs.fetch_add(1);
+
+	// Taking the lock orders this against a worker about to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wakeCondition.notify_one();
+}
+
+void JobSystem::parallelFor(int count, int batchSize, const std::function<void(int, int)> &function,
+	JobCounter &counter)
+{
+	if (batchSize < 1) {
+		batchSize = 1;
+	}
+
+	for (int begin = 0; begin < count; begin += batchSize) {
+		int end = begin + batchSize < count ? begin + batchSize : count;
+		submit([&function, begin, end]() { function(begin, end); }, counter);
+	}
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+	while (counter.pending.load() > 0) {
+		Job job;
+		if (popJob(currentQueue, job)) {
+			runJob(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::workerLoop(int index)
+{
+	currentQueue = index;
+
+	while (running) {
+		Job job;
+		if (popJob(index, job)) {
+			runJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeCondition.wait(lock, [this]() { return !running || queuedJobs.load() > 0; });
+	}
+}
+
+bool JobSystem::popJob(int index, Job &job)
+{
+	if (queuedJobs.load() == 0) {
+		return false;
+	}
+
+	// Newest job of our own deque first, its data is most likely still cached
+	{
+		JobQueue &queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+			queuedJobs.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// Otherwise steal the oldest job of another deque
+	for (size_t i = 1; i < queues.size(); ++i) {
+		JobQueue &queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+			queuedJobs.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::runJob(Job &job)
+{
+	job.function();
+	job.counter->pending.fetch_sub(1);
+}
@@ -0,0 +1,72 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs of one batch; wait on it to join the batch
+struct JobCounter {
+	std::atomic<int> pending;
+
+	JobCounter() : pending(0) {}
+};
+
+struct Job {
+	std::function<void()> function;
+	JobCounter *counter;
+};
+
+// A fixed pool of worker threads, each with its own deque of jobs. A thread
+// takes work from the back of its own deque and, once that is empty, steals
+// from the front of the others, so uneven batches even out on their own.
+// The thread that created the pool owns deque 0 and runs jobs while it
+// waits instead of blocking.
+struct JobSystem {
+	struct JobQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<JobQueue *> queues;			// One per worker plus the owner's
+
+	std::atomic<bool> running;
+	std::atomic<int> queuedJobs;			// Jobs sitting in any deque
+	std::atomic<unsigned> nextQueue;		// Round-robin target for submit()
+
+	// Idle workers sleep here until new jobs are queued
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+
+	// workerCount <= 0 uses one worker per hardware thread besides the
+	// calling one
+	void initialize(int workerCount);
+	void cleanup();
+
+	int threadCount() const { return (int)queues.size(); }
+
+	// Queue a job, counted in counter. Jobs submitted from outside a job are
+	// spread over all deques; jobs submitted from a job go to the back of
+	// the current thread's deque.
+	void submit(const std::function<void()> &function, JobCounter &counter);
+
+	// Split [0, count) into ranges of at most batchSize and queue one job per
+	// range. The function is called by reference and must outlive wait().
+	void parallelFor(int count, int batchSize, const std::function<void(int, int)> &function,
+		JobCounter &counter);
+
+	// Run queued jobs until every job counted in counter has finished
+	void wait(JobCounter &counter);
+
+	// Internals
+	void workerLoop(int index);
+	bool popJob(int index, Job &job);
+	void runJob(Job &job);
+};
+
+#endif
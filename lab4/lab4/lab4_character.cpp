@@ -12,9 +12,24 @@
 #include <tiny_gltf.h>
 
 #include <render/shader.h>
+#include <render/joint_palette.h>
+#include <render/frustum.h>
+#include <render/draw_list.h>
+#include <render/staged_upload.h>
+#include <animation/animation.h>
+#include <animation/skinning.h>
+#include <animation/bake.h>
+#include <animation/compression.h>
+#include <animation/resample.h>
+#include <animation/update_schedule.h>
+#include <jobs/job_system.h>
+#include <asset/mesh_packing.h>
+#include <asset/model_loader.h>
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cstddef>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iomanip>
@@ -43,441 +58,739 @@ static glm::vec3 lightPosition(-275.0f, 500.0f, 800.0f);
 static bool playAnimation = true;
 static float playbackSpeed = 2.0f;
 
+// Crowd, resized with the +/- keys in steps of 10x
+static int crowdSize = 1;
+static const int maxCrowdSize = 10000;
+
+// Play the offline baked poses on the GPU instead of animating on the CPU,
+// toggled with B
+static bool bakedPlayback = false;
+
+// Sample the clips resampled onto a uniform grid at this rate instead of
+// the compressed keys, toggled with U. The grid costs more memory but
+// needs no key search; it is built the first time it is enabled.
+static bool gridSampling = false;
+static const float animationResampleRate = 30.0f;
+
+// Joint palette layout, cycled with P
+static PaletteEncoding selectedPaletteEncoding = PALETTE_MAT4;
+
+// Load-time mesh processing, applied when the model is cooked
+static const int meshPackingFlags = PACK_OPTIMIZE | PACK_QUANTIZE | PACK_LODS;
+
+// Bytes of mesh and baked pose data uploaded per frame once the model has
+// loaded, so finishing the load never stalls a frame for long
+static const size_t uploadBudget = 256 * 1024;
+
+// Pick each character's mesh detail from its size on screen, toggled with
+// L. A level is used while its deviation from the full mesh projects to at
+// most this many pixels.
+static bool lodSelection = true;
+static const float lodPixelError = 2.0f;
+
+// Sample small characters' poses less often, toggled with T: every frame
+// while a character is at least this many pixels tall, otherwise every 2,
+// 4 or 8 frames, and never more than the budget of updates per frame
+// while the crowd allows it
+static bool animationLod = true;
+static const float animationFullRatePixels = 300.0f;
+static const float animationUpdateBudget = 250.0f;
+
+// Characters are laid out on a grid growing away from the camera
+static glm::mat4 crowdPlacement(int index, int count)
+{
+	const float spacing = 250.0f;
+	int columns = (int)ceil(sqrt((float)count));
+	int row = index / columns;
+	int column = index % columns;
+	float x = (column - (columns - 1) * 0.5f) * spacing;
+	return glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, -row * spacing));
+}
+
 struct MyBot {
 	// Shader variable IDs
 	GLuint mvpMatrixID;
-	GLuint jointMatricesID;
+	GLuint jointPaletteID;
+	GLuint paletteOffsetID;
+	GLuint jointCountID;
+	GLuint paletteEncodingID;
+	GLuint octNormalsID;
+	GLuint skinSpaceID;
+	GLuint skinSpaceInverseID;
 	GLuint lightPositionID;
 	GLuint lightIntensityID;
 	GLuint programID;
 
-	tinygltf::Model model;
+	// The model is read and decoded on the loader's thread, then its GPU
+	// data is uploaded over several frames. Until it is ready the crowd is
+	// drawn as placeholder boxes.
+	enum ModelState {
+		MODEL_LOADING,
+		MODEL_UPLOADING,
+		MODEL_READY,
+		MODEL_FAILED
+	};
+	ModelLoader loader;
+	StagedUpload upload;
+	int modelState;
+	double loadStart;
+	int uploadFrames;
+
+	struct PlaceholderObject {
+		GLuint vao;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		GLuint offsetBuffer;		// Per-instance position
+		int count;					// Characters in offsetBuffer
+		GLuint programID;
+		GLuint mvpMatrixID;
+		GLuint pulseID;
+	};
+	PlaceholderObject placeholderObject;
 
-	// Each VAO corresponds to each mesh primitive in the GLTF model
-	struct PrimitiveObject {
+	// All primitives share one VAO over one interleaved vertex buffer and one
+	// index buffer (see packModelMeshes), so drawing the model binds a single
+	// VAO. glTF and cooked models are uploaded the same way.
+	struct MeshObject {
 		GLuint vao;
-		std::map<int, GLuint> vbos;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		GLenum indexType;
+		bool octNormals;			// Packed with PACK_QUANTIZE
 	};
-	std::vector<PrimitiveObject> primitiveObjects;
+	MeshObject meshObject;
+
+	// Detail levels of the mesh, finest first: one draw list per level with
+	// a command per primitive, the level's deviation from the full mesh in
+	// model units and its triangle count
+	std::vector<DrawList> lodDrawLists;
+	std::vector<float> lodErrors;
+	std::vector<int> lodTriangles;
 
 	// Skinning
 	struct SkinObject {
 		// Transforms the geometry into the space of the respective joint
 		std::vector<glm::mat4> inverseBindMatrices;
-
-		// Transforms the geometry following the movement of the joints
-		std::vector<glm::mat4> globalJointTransforms;
-
-		// Combined transforms
-		std::vector<glm::mat4> jointMatrices;
 	};
 	std::vector<SkinObject> skinObjects;
 
-	// Animation
-	struct SamplerObject {
-		std::vector<float> input;
-		std::vector<glm::vec4> output;
-		int interpolation;
+	// Animation, sampled from compressed clips or from the same clips on a
+	// uniform grid. The keyframed clips are only kept until they are
+	// resampled.
+	std::vector<CompressedClip> compressedClips;
+	std::vector<AnimationClip> keyframedClips;
+	std::vector<UniformClip> uniformClips;
+	bool uniformSampling;
+
+	// Node hierarchy in parent-first order, shared by animation and skinning
+	SkeletonHierarchy hierarchy;
+
+	// Each instance is one character of the crowd. The model data above is
+	// shared, only the pose and placement are per instance.
+	struct InstanceObject {
+		glm::mat4 modelMatrix;
+		float time;					// Animation time
+		float speed;				// Multiplies the global playback speed
+
+		// Off-screen characters only advance their clock
+		bool visible;
+
+		// Mesh detail level, see selectLods()
+		int lod;
+
+		// Animation detail, see scheduleAnimation(): the pose is sampled
+		// every updateInterval frames, on the frames given by the phase
+		int updateInterval;
+		int phase;
+
+		// The pose is only resampled when the clock moved since sampledTime
+		bool posed;
+		float sampledTime;
+
+		// Time sliced characters sample ahead, at their time on the next
+		// frame they update on, and draw a blend from the previous sample.
+		// blendInterval is the interval the two samples were taken for, 0
+		// when they need to be taken again.
+		int blendInterval;
+		float previousTime;
+		std::vector<glm::vec4> previousTexels;
+		std::vector<glm::vec4> blendedTexels;
+
+		// Last keyframe found for each track, so that sampling steps forward
+		// from the previous frame instead of searching from scratch
+		std::vector<KeyframeCursor> keyframeCursors;
+
+		// Local and global transforms of each joint in the hierarchy, and
+		// the joints whose local transform changed since the last update
+		std::vector<glm::mat4> localTransforms;
+		std::vector<glm::mat4> globalTransforms;
+		std::vector<unsigned char> dirtyJoints;
+
+		// Skin joint matrices, with the model matrix applied for the matrix
+		// encodings and conjugated into skin space for dual quaternions
+		std::vector<glm::mat4> jointMatrices;
+
+		// The same, encoded for upload
+		std::vector<glm::vec4> paletteTexels;
+
+		// The palette drawn this frame
+		const std::vector<glm::vec4> &drawnTexels() const {
+			return blendInterval > 1 ? blendedTexels : paletteTexels;
+		}
 	};
-	struct ChannelObject {
-		int sampler;
-		std::string targetPath;
-		int targetNode;
+	std::vector<InstanceObject> instanceObjects;
+
+	// Instances are updated in parallel by the job system; the counter
+	// tracks the update in flight until writePalette() waits for it
+	JobSystem *jobSystem;
+	JobCounter updateCounter;
+	std::function<void(int, int)> updateBatch;
+	float updateDeltaTime;
+
+	// Counts the updates for the time slicing of scheduleAnimation()
+	unsigned int animationFrame;
+	std::vector<float> screenHeights;
+	std::vector<int> updateIntervals;
+	float scheduledUpdates;			// Average poses sampled per frame
+
+	// Where the first instance's palette starts in the shared palette
+	// buffer; the other instances follow contiguously
+	int paletteOffset;
+	PaletteEncoding paletteEncoding;
+
+	// Bounding sphere of a character in model space, for culling
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	int visibleCount;
+
+	// Visible instances grouped by detail level. The instance buffer and the
+	// palettes follow this order, so each level draws a contiguous range.
+	std::vector<int> drawOrder;
+	std::vector<int> lodFirst;
+	std::vector<int> lodCount;
+	bool instancesDirty;			// Instance buffer out of date
+	int drawnTriangles;
+
+	// Space in which the joint matrices are rigid, see computeSkinSpace. The
+	// bot's armature node is not animated, so its rest transform is used.
+	glm::mat4 skinSpace;
+	glm::mat4 skinSpaceInverse;
+
+	// Placement and clock of each instance as vertex attributes, used by
+	// baked playback and dual quaternion skinning
+	struct InstanceData {
+		glm::mat4 modelMatrix;
+		glm::vec4 clock;			// Start time, speed
 	};
-	struct AnimationObject {
-		std::vector<SamplerObject> samplers;	// Animation data
+	GLuint instanceVBO;
+
+	// Baked playback: the first clip sampled offline into a texture of joint
+	// matrices. The vertex shader looks poses up by time, so the CPU cost per
+	// frame does not depend on the number of characters.
+	struct BakedObject {
+		BakedAnimation animation;
+		GLuint texture;
+		GLuint programID;
+		GLuint mvpMatrixID;
+		GLuint posesID;
+		GLuint frameRateID;
+		GLuint frameCountID;
+		GLuint timeID;
+		GLuint octNormalsID;
+		GLuint lightPositionID;
+		GLuint lightIntensityID;
 	};
-	std::vector<AnimationObject> animationObjects;
-
-	// Also take the global transformations
-	std::vector<glm::mat4> globalTransforms;
-
-	glm::mat4 getNodeTransform(const tinygltf::Node& node) {
-		glm::mat4 transform(1.0f);
-
-		if (node.matrix.size() == 16) {
-			transform = glm::make_mat4(node.matrix.data());
-		} else {
-			if (node.translation.size() == 3) {
-				transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
-			}
-			if (node.rotation.size() == 4) {
-				glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-				transform *= glm::mat4_cast(q);
+	BakedObject bakedObject;
+	bool baked;						// Currently playing the baked poses
+	float bakedTime;				// Playback time since the instance clocks were uploaded
+
+	// Recompute the palette entries of the joints whose global transform
+	// changed, then clear the dirty flags
+	void updateSkinning(InstanceObject &instance) {
+		// The bot has a single skin
+		const std::vector<int> &joints = hierarchy.skinJoints[0];
+		const std::vector<glm::mat4> &inverseBindMatrices = skinObjects[0].inverseBindMatrices;
+		int texelsPerJoint = paletteTexelsPerJoint(paletteEncoding);
+		instance.jointMatrices.resize(joints.size());
+		instance.paletteTexels.resize(joints.size() * texelsPerJoint);
+
+		for (size_t j = 0; j < joints.size(); ++j) {
+			if (!instance.dirtyJoints[joints[j]]) {
+				continue;
 			}
-			if (node.scale.size() == 3) {
-				transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+
+			glm::mat4 jointMatrix = instance.globalTransforms[joints[j]] * inverseBindMatrices[j];
+			if (paletteEncoding == PALETTE_DUAL_QUATERNION) {
+				// Rigid joints; the shader maps back and places the instance
+				jointMatrix = skinSpaceInverse * jointMatrix * skinSpace;
+			} else {
+				// Bake the placement into the palette so instances need no other data
+				jointMatrix = instance.modelMatrix * jointMatrix;
 			}
+			instance.jointMatrices[j] = jointMatrix;
+			encodePaletteJoint(jointMatrix, paletteEncoding, &instance.paletteTexels[j * texelsPerJoint]);
 		}
-		return transform;
+
+		std::fill(instance.dirtyJoints.begin(), instance.dirtyJoints.end(), 0);
 	}
 
-	void computeLocalNodeTransform(const tinygltf::Model& model,
-		int nodeIndex,
-		std::vector<glm::mat4> &localTransforms)
-	{
-		// ---------------------------------------
-		// TODO: your code here
-		// ---------------------------------------
-		const tinygltf::Node &node = model.nodes[nodeIndex];
+	// Recompute everything derived from the current local transforms, for
+	// changes that affect all joints (placement, palette encoding)
+	void refreshPose(InstanceObject &instance) {
+		std::fill(instance.dirtyJoints.begin(), instance.dirtyJoints.end(), 1);
+		updateGlobalTransforms(hierarchy, instance.localTransforms, instance.globalTransforms, instance.dirtyJoints);
+		updateSkinning(instance);
 
-		localTransforms[nodeIndex] = getNodeTransform(node);
+		// The cached samples are stale; draw the new pose until the next
+		// update takes them again
+		instance.blendInterval = 0;
 	}
 
-	void computeGlobalNodeTransform(const tinygltf::Model& model,
-		const std::vector<glm::mat4> &localTransforms,
-		int nodeIndex, const glm::mat4& parentTransform,
-		std::vector<glm::mat4> &globalTransforms)
-	{
-		// ----------------------------------------
-		// TODO: your code here
-		// ----------------------------------------
-
-		// Find the global transformations
-		globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
-
-		// Now going to the children node
-		const tinygltf::Node &node = model.nodes[nodeIndex];
-		if(!node.children.empty()){
-			for(int childNode: node.children){
-				computeGlobalNodeTransform(model, localTransforms, childNode, globalTransforms[nodeIndex], globalTransforms);
-			}
-		}
+	// Override the local transform of one joint, e.g. from a user edit. It
+	// takes effect on the next update, and animated joints are overwritten
+	// when their clip is sampled again.
+	void setJointTransform(InstanceObject &instance, int joint, const glm::mat4 &transform) {
+		instance.localTransforms[joint] = transform;
+		instance.dirtyJoints[joint] = 1;
 	}
 
-	std::vector<SkinObject> prepareSkinning(const tinygltf::Model &model) {
-		std::vector<SkinObject> skinObjects;
-
-		// In our Blender exporter, the default number of joints that may influence a vertex is set to 4, just for convenient implementation in shaders.
+	void setPaletteEncoding(PaletteEncoding encoding) {
+		if (encoding == paletteEncoding) {
+			return;
+		}
 
-		for (size_t i = 0; i < model.skins.size(); i++) {
-			SkinObject skinObject;
+		finishUpdate();
+		paletteEncoding = encoding;
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			refreshPose(instanceObjects[i]);
+		}
+	}
 
-			const tinygltf::Skin &skin = model.skins[i];
-
-			// Read inverseBindMatrices
-			const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
-			assert(accessor.type == TINYGLTF_TYPE_MAT4);
-			const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-			const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-			const float *ptr = reinterpret_cast<const float *>(
-            	buffer.data.data() + accessor.byteOffset + bufferView.byteOffset);
-
-			skinObject.inverseBindMatrices.resize(accessor.count);
-			for (size_t j = 0; j < accessor.count; j++) {
-				float m[16];
-				memcpy(m, ptr + j * 16, 16 * sizeof(float));
-				skinObject.inverseBindMatrices[j] = glm::make_mat4(m);
+	// Sample the pose at the given time and bring the palette up to date
+	void poseInstance(InstanceObject &instance, float time) {
+		// Sample only when the clock moved, a paused pose stays as it is
+		if (compressedClips.size() > 0 && (!instance.posed || time != instance.sampledTime)) {
+			if (uniformSampling) {
+				sampleAnimation(uniformClips[0], hierarchy, time, instance.localTransforms,
+					&instance.dirtyJoints);
+			} else {
+				sampleAnimation(compressedClips[0], hierarchy, time, instance.keyframeCursors,
+					instance.localTransforms, &instance.dirtyJoints);
 			}
+			instance.sampledTime = time;
+			instance.posed = true;
+		}
 
-			assert(skin.joints.size() == accessor.count);
-
-			skinObject.globalJointTransforms.resize(skin.joints.size());
-			skinObject.jointMatrices.resize(skin.joints.size());
+		// Only joints below a changed one are recomputed
+		if (updateGlobalTransforms(hierarchy, instance.localTransforms, instance.globalTransforms,
+				instance.dirtyJoints) > 0) {
+			updateSkinning(instance);
+		}
+	}
 
-			// ----------------------------------------------
-			// TODO: your code here to compute joint matrices
-			// ----------------------------------------------
+	void updateInstance(InstanceObject &instance, float deltaTime) {
+		instance.time += deltaTime * instance.speed;
 
-			// computing the joint matrices here
+		if (!instance.visible) {
+			// Sampled again from the current time once back in view
+			instance.blendInterval = 0;
+			return;
+		}
 
+		int interval = std::max(instance.updateInterval, 1);
+		if (interval == 1) {
+			poseInstance(instance, instance.time);
+			instance.blendInterval = 1;
+			return;
+		}
 
-			for(int i=0; i<skinObject.jointMatrices.size();i++){
-				skinObject.jointMatrices[i] = skinObject.globalJointTransforms[i] * skinObject.inverseBindMatrices[i];
+		// On its update frames the character samples where its clock will be
+		// on the next one, assuming the frame time stays the same. A new
+		// interval, dropped samples, or samples taken without the clock
+		// moving start over from a pose at the current time.
+		bool restart = instance.blendInterval != interval || !instance.posed ||
+			instance.sampledTime == instance.previousTime;
+		if (restart || isUpdateDue(animationFrame, instance.phase, interval)) {
+			if (restart) {
+				poseInstance(instance, instance.time);
 			}
+			instance.previousTexels = instance.paletteTexels;
+			instance.previousTime = instance.sampledTime;
 
-
-
-			// ----------------------------------------------
-
-			skinObjects.push_back(skinObject);
+			int frames = framesToUpdate(animationFrame, instance.phase, interval);
+			poseInstance(instance, instance.time + frames * deltaTime * instance.speed);
+			instance.blendInterval = interval;
 		}
-		return skinObjects;
-	}
-
-	int findKeyframeIndex(const std::vector<float>& times, float animationTime)
-	{
-		int left = 0;
-		int right = times.size() - 1;
 
-		while (left <= right) {
-			int mid = (left + right) / 2;
+		float span = instance.sampledTime - instance.previousTime;
+		float factor = span > 0.0f ? glm::clamp((instance.time - instance.previousTime) / span, 0.0f, 1.0f) : 1.0f;
+		blendPalette(instance.previousTexels, instance.paletteTexels, paletteEncoding, factor,
+			instance.blendedTexels);
+	}
 
-			if (mid + 1 < times.size() && times[mid] <= animationTime && animationTime < times[mid + 1]) {
-				return mid;
-			}
-			else if (times[mid] > animationTime) {
-				right = mid - 1;
-			}
-			else { // animationTime >= times[mid + 1]
-				left = mid + 1;
+	// Flag the characters whose bounding sphere is outside the view
+	void cull(const glm::mat4 &viewProjection) {
+		Frustum frustum;
+		frustum.extract(viewProjection);
+
+		visibleCount = 0;
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			InstanceObject &instance = instanceObjects[i];
+			glm::vec3 center(instance.modelMatrix * glm::vec4(boundsCenter, 1.0f));
+			instance.visible = frustum.intersectsSphere(center, boundsRadius);
+			if (instance.visible) {
+				visibleCount++;
 			}
 		}
-
-		// Target not found
-		return times.size() - 2;
 	}
 
-	std::vector<AnimationObject> prepareAnimation(const tinygltf::Model &model)
-	{
-		std::vector<AnimationObject> animationObjects;
-		for (const auto &anim : model.animations) {
-			AnimationObject animationObject;
-
-			for (const auto &sampler : anim.samplers) {
-				SamplerObject samplerObject;
-
-				const tinygltf::Accessor &inputAccessor = model.accessors[sampler.input];
-				const tinygltf::BufferView &inputBufferView = model.bufferViews[inputAccessor.bufferView];
-				const tinygltf::Buffer &inputBuffer = model.buffers[inputBufferView.buffer];
-
-				assert(inputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-				assert(inputAccessor.type == TINYGLTF_TYPE_SCALAR);
-
-				// Input (time) values
-				samplerObject.input.resize(inputAccessor.count);
-
-				const unsigned char *inputPtr = &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset];
-				const float *inputBuf = reinterpret_cast<const float*>(inputPtr);
-
-				// Read input (time) values
-				int stride = inputAccessor.ByteStride(inputBufferView);
-				for (size_t i = 0; i < inputAccessor.count; ++i) {
-					samplerObject.input[i] = *reinterpret_cast<const float*>(inputPtr + i * stride);
+	// Choose the coarsest detail level of each visible character whose
+	// error stays within lodPixelError once projected at the distance of
+	// the near side of its bounding sphere, then regroup the draw order
+	void selectLods(const glm::mat4 &projection, const glm::vec3 &eye, int viewportHeight, bool enable) {
+		// Pixels covered by one unit at distance 1
+		float pixelScale = viewportHeight * 0.5f * projection[1][1];
+
+		int levels = (int)lodDrawLists.size();
+		lodCount.assign(levels, 0);
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			InstanceObject &instance = instanceObjects[i];
+			instance.lod = 0;
+			if (!instance.visible) {
+				continue;
+			}
+			if (enable) {
+				glm::vec3 center(instance.modelMatrix * glm::vec4(boundsCenter, 1.0f));
+				float distance = std::max(glm::length(center - eye) - boundsRadius, 1.0f);
+				float pixelsPerUnit = pixelScale / distance;
+				while (instance.lod + 1 < levels &&
+						lodErrors[instance.lod + 1] * pixelsPerUnit <= lodPixelError) {
+					instance.lod++;
 				}
+			}
+			lodCount[instance.lod]++;
+		}
 
-				const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
-				const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-				const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
-
-				assert(outputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-				const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-				const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
-
-				int outputStride = outputAccessor.ByteStride(outputBufferView);
-
-				// Output values
-				samplerObject.output.resize(outputAccessor.count);
-
-				for (size_t i = 0; i < outputAccessor.count; ++i) {
-
-					if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
-						memcpy(&samplerObject.output[i], outputPtr + i * 3 * sizeof(float), 3 * sizeof(float));
-					} else if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
-						memcpy(&samplerObject.output[i], outputPtr + i * 4 * sizeof(float), 4 * sizeof(float));
-					} else {
-						std::cout << "Unsupport accessor type ..." << std::endl;
-					}
-
-				}
+		lodFirst.assign(levels, 0);
+		drawnTriangles = 0;
+		for (int l = 0; l < levels; ++l) {
+			if (l > 0) {
+				lodFirst[l] = lodFirst[l - 1] + lodCount[l - 1];
+			}
+			drawnTriangles += lodCount[l] * lodTriangles[l];
+		}
 
-				animationObject.samplers.push_back(samplerObject);
+		std::vector<int> order(visibleCount);
+		std::vector<int> filled(lodFirst);
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			if (instanceObjects[i].visible) {
+				order[filled[instanceObjects[i].lod]++] = (int)i;
 			}
+		}
+		if (order != drawOrder) {
+			drawOrder.swap(order);
+			instancesDirty = true;
+		}
 
-			animationObjects.push_back(animationObject);
+		if (instancesDirty) {
+			uploadInstances();
 		}
-		return animationObjects;
 	}
 
-	void updateAnimation(
-		const tinygltf::Model &model,
-		const tinygltf::Animation &anim,
-		const AnimationObject &animationObject,
-		float time,
-		std::vector<glm::mat4> &nodeTransforms)
-	{
-		// There are many channels so we have to accumulate the transforms
-		for (const auto &channel : anim.channels) {
-
-			int targetNodeIndex = channel.target_node;
-			const auto &sampler = anim.samplers[channel.sampler];
+	// Choose how often each visible character's pose is sampled from its
+	// height on screen, see scheduleUpdates(). Characters sharing an
+	// interval update on frames spread by their phase, so the updates per
+	// frame stay even.
+	void scheduleAnimation(const glm::mat4 &projection, const glm::vec3 &eye, int viewportHeight, bool enable) {
+		float pixelScale = viewportHeight * 0.5f * projection[1][1];
+
+		screenHeights.resize(instanceObjects.size());
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			const InstanceObject &instance = instanceObjects[i];
+			screenHeights[i] = 0.0f;
+			if (instance.visible) {
+				glm::vec3 center(instance.modelMatrix * glm::vec4(boundsCenter, 1.0f));
+				float distance = std::max(glm::length(center - eye) - boundsRadius, 1.0f);
+				screenHeights[i] = 2.0f * boundsRadius * pixelScale / distance;
+			}
+		}
 
-			// Access output (value) data for the channel
-			const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
-			const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-			const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
+		if (enable) {
+			scheduledUpdates = scheduleUpdates(screenHeights, animationFullRatePixels, animationUpdateBudget,
+				updateIntervals);
+		} else {
+			scheduledUpdates = (float)visibleCount;
+			updateIntervals.assign(instanceObjects.size(), 1);
+		}
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			instanceObjects[i].updateInterval = updateIntervals[i];
+		}
+	}
 
-			// Calculate current animation time (wrap if necessary)
-			const std::vector<float> &times = animationObject.samplers[channel.sampler].input;
-			float animationTime = fmod(time, times.back());
+	// Start updating every instance: sampling, hierarchy and palette of
+	// each character are independent, so batches of characters run as jobs
+	// on all cores. Returns immediately, writePalette() joins the jobs.
+	void update(float deltaTime) {
+		if (baked) {
+			bakedTime += deltaTime;
+			return;
+		}
 
-			// ----------------------------------------------------------
-			// TODO: Find a keyframe for getting animation data
-			// ----------------------------------------------------------
-			int keyframeIndex = this->findKeyframeIndex(times, animationTime);
+		animationFrame++;
+		if (jobSystem == NULL) {
+			for (size_t i = 0; i < instanceObjects.size(); ++i) {
+				updateInstance(instanceObjects[i], deltaTime);
+			}
+			return;
+		}
 
-			const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-			const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
+		updateDeltaTime = deltaTime;
+		jobSystem->parallelFor((int)instanceObjects.size(), 8, updateBatch, updateCounter);
+	}
 
-			// -----------------------------------------------------------
-			// TODO: Add interpolation for smooth animation
-			// -----------------------------------------------------------
+	// Wait for the jobs started by update()
+	void finishUpdate() {
+		if (jobSystem != NULL) {
+			jobSystem->wait(updateCounter);
+		}
+	}
 
-			float t0 = times[keyframeIndex];
-			float t1 = times[keyframeIndex+1];
+	// Grow or shrink the crowd, see crowdPlacement(). New characters get
+	// their own start time and playback speed.
+	void setCrowdSize(int count) {
+		finishUpdate();
 
-			float factor = (animationTime-t1)/(t0-t1);
+		syncBakedTime();
 
+		size_t first = instanceObjects.size();
+		instanceObjects.resize(count);
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			InstanceObject &instance = instanceObjects[i];
+			instance.modelMatrix = crowdPlacement((int)i, count);
 
-			if (channel.target_path == "translation") {
-				glm::vec3 translation0, translation1;
-				memcpy(&translation0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-				memcpy(&translation1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
+			if (i >= first) {
+				// Deterministic variation so runs are comparable
+				instance.time = i == 0 ? 0.0f : (i * 7919 % 1000) / 100.0f;
+				instance.speed = i == 0 ? 1.0f : 0.8f + (i * 104729 % 400) / 1000.0f;
 
-				// glm::vec3 translation = glm::mix(translation0,translation1,factor);
-				glm::vec3 translation;
-				if(sampler.interpolation=="STEP"){
-					translation = translation1;
-				} else if(sampler.interpolation=="LINEAR"){
-					translation = glm::mix(translation0,translation1,factor);
+				if (compressedClips.size() > 0) {
+					instance.keyframeCursors.resize(compressedClips[0].tracks.size());
 				}
-				nodeTransforms[targetNodeIndex] = glm::translate(nodeTransforms[targetNodeIndex], translation);
-			} else if (channel.target_path == "rotation") {
-				glm::quat rotation0, rotation1;
-				memcpy(&rotation0, outputPtr + keyframeIndex * 4 * sizeof(float), 4 * sizeof(float));
-				memcpy(&rotation1, outputPtr + (keyframeIndex+1) * 4 * sizeof(float), 4 * sizeof(float));
-
-				// glm::quat rotation = rotation0;
-				glm::quat rotation;
-				if(sampler.interpolation=="STEP"){
-					rotation = rotation1;
-				} else if(sampler.interpolation=="LINEAR"){
-					rotation = glm::slerp(rotation0,rotation1,factor);
-				}
-				nodeTransforms[targetNodeIndex] *= glm::mat4_cast(rotation);
-			} else if (channel.target_path == "scale") {
-				glm::vec3 scale0, scale1;
-				memcpy(&scale0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-				memcpy(&scale1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
-
-				// glm::vec3 scale = glm::mix(scale0,scale1,factor);
-				glm::vec3 scale;
-				if(sampler.interpolation=="STEP"){
-					scale = scale1;
-				} else if(sampler.interpolation=="LINEAR"){
-					scale = glm::mix(scale0,scale1,factor);
-				}
-				nodeTransforms[targetNodeIndex] = glm::scale(nodeTransforms[targetNodeIndex], scale);
+				instance.localTransforms = hierarchy.restTransforms;
+				instance.dirtyJoints.assign(hierarchy.nodes.size(), 1);
+				instance.visible = true;
+				instance.lod = 0;
+				instance.updateInterval = 1;
+				instance.phase = (int)(i % MAX_UPDATE_INTERVAL);
+				instance.blendInterval = 0;
+				instance.previousTime = 0.0f;
+				instance.posed = false;
+				instance.sampledTime = 0.0f;
+				updateInstance(instance, 0.0f);
+			} else {
+				refreshPose(instance);
 			}
 		}
-	}
-
-	void updateSkinning(const std::vector<glm::mat4> &nodeTransforms) {
-
-		// -------------------------------------------------
-		// TODO: Recompute joint matrices
-		// -------------------------------------------------
 
+		// Uploaded in draw order once the LODs are selected
+		drawOrder.clear();
+		instancesDirty = true;
 	}
 
-	void update(float time) {
-		// Keep the skeleton in T pose for now
-
-		// -------------------------------------------------
-		// TODO: your code here
-		// -------------------------------------------------
-		if (model.animations.size() > 0) {
-			const tinygltf::Animation &animation = model.animations[0];
-			const AnimationObject &animationObject = animationObjects[0];
-
-            const tinygltf::Skin &skin = model.skins[0];
-			std::vector<glm::mat4> nodeTransforms(skin.joints.size());
-			for (size_t i = 0; i < nodeTransforms.size(); ++i) {
-				nodeTransforms[i] = glm::mat4(1.0);
-			}
-
-			updateAnimation(model, animation, animationObject, time, nodeTransforms);
-
-			// ----------------------------------------------
-            // TODO: Recompute global transforms at each node
-			// using the updated node transforms above
-            // ----------------------------------------------
-			// Compute local transforms at each node
+	// Fold the time played on the GPU back into the instance clocks
+	void syncBakedTime() {
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			instanceObjects[i].time += bakedTime * instanceObjects[i].speed;
+		}
+		bakedTime = 0.0f;
+	}
 
-			std::vector<glm::mat4> localNodeTransforms(skin.joints.size());
+	// Placement and clock of the instances in draw order
+	void uploadInstances() {
+		std::vector<InstanceData> instances(drawOrder.size());
+		for (size_t i = 0; i < drawOrder.size(); ++i) {
+			const InstanceObject &instance = instanceObjects[drawOrder[i]];
+			instances[i].modelMatrix = instance.modelMatrix;
+			instances[i].clock = glm::vec4(instance.time, instance.speed, 0.0f, 0.0f);
+		}
 
-			glm::mat4 parentTransform(1.0f);
-			std::vector<glm::mat4> globalNodeTransforms(skin.joints.size());
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData),
+					instances.empty() ? NULL : &instances[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		instancesDirty = false;
+	}
 
-			// Compute local transforms at each node
-			for(int i=0;i<skin.joints.size();i++){
-				int rootNodeIndex = skin.joints[i];
-				computeLocalNodeTransform(model, i, localNodeTransforms);
+	// Switch the clips the CPU samples, and pose every character from them
+	void setUniformSampling(bool enable) {
+		if (enable && uniformClips.empty() && !keyframedClips.empty()) {
+			size_t bytes = 0;
+			for (size_t i = 0; i < keyframedClips.size(); ++i) {
+				uniformClips.push_back(resampleAnimation(keyframedClips[i], animationResampleRate));
+				bytes += uniformClipBytes(uniformClips[i]);
 			}
+			std::vector<AnimationClip>().swap(keyframedClips);
+			std::cout << "Resampled animation: " << bytes / 1024 << " KB at "
+				<< animationResampleRate << " Hz" << std::endl;
+		}
+		if (enable && uniformClips.empty()) {
+			enable = false;
+		}
+		if (enable == uniformSampling) {
+			return;
+		}
 
-			// Compute global transforms at each node
-			computeGlobalNodeTransform(model, localNodeTransforms, 24, parentTransform, globalNodeTransforms);
-			globalTransforms = globalNodeTransforms;
-
-			// std::vector<glm::mat4> globalNodeTransforms(skin.joints.size(), glm::mat4(1.0f));
-
-			// // Start from the first joint
-			// int rootNode = skin.joints[0];
-			// // this function is already recursive
-			// computeGlobalNodeTransform(model,nodeTransforms,rootNode,glm::mat4(1.0f),globalNodeTransforms);
-
-			// Update the value for global node transforms
-			globalTransforms = globalNodeTransforms;
-
+		finishUpdate();
+		uniformSampling = enable;
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			instanceObjects[i].posed = false;
+			updateInstance(instanceObjects[i], 0.0f);
 		}
 	}
 
-	bool loadModel(tinygltf::Model &model, const char *filename) {
-		tinygltf::TinyGLTF loader;
-		std::string err;
-		std::string warn;
-
-		bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-		if (!warn.empty()) {
-			std::cout << "WARN: " << warn << std::endl;
+	void setBakedPlayback(bool enable) {
+		if (enable && bakedObject.texture == 0) {
+			enable = false;
 		}
-
-		if (!err.empty()) {
-			std::cout << "ERR: " << err << std::endl;
+		if (enable == baked) {
+			return;
 		}
 
-		if (!res)
-			std::cout << "Failed to load glTF: " << filename << std::endl;
-		else
-			std::cout << "Loaded glTF: " << filename << std::endl;
-
-		return res;
+		finishUpdate();
+		syncBakedTime();
+		if (enable) {
+			instancesDirty = true;
+		} else {
+			// Resume CPU animation where the GPU left off
+			for (size_t i = 0; i < instanceObjects.size(); ++i) {
+				instanceObjects[i].blendInterval = 0;
+				updateInstance(instanceObjects[i], 0.0f);
+			}
+		}
+		baked = enable;
 	}
 
-	void initialize() {
-		// Modify your path if needed
-		if (!loadModel(model, "../lab4/model/bot/bot.gltf")) {
+	// Create the texture of baked poses and queue its contents
+	void bindBakedAnimation() {
+		const BakedAnimation &animation = bakedObject.animation;
+		if (animation.frameCount == 0) {
 			return;
 		}
 
-		// Prepare buffers for rendering
-		primitiveObjects = bindModel(model);
+		GLint maxTextureSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+		if (animation.frameCount > maxTextureSize || animation.jointCount * 4 > maxTextureSize) {
+			std::cout << "Baked animation does not fit in a texture, baked playback disabled." << std::endl;
+			return;
+		}
 
-		// Prepare joint matrices
-		skinObjects = prepareSkinning(model);
+		glGenTextures(1, &bakedObject.texture);
+		glBindTexture(GL_TEXTURE_2D, bakedObject.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		upload.addTexture(bakedObject.texture, animation.jointCount * 4, animation.frameCount,
+			&animation.matrices[0][0][0]);
 
-		// Prepare animation data
-		animationObjects = prepareAnimation(model);
+		bakedObject.programID = LoadShadersFromFile("../lab4/shader/bot_baked.vert", "../lab4/shader/bot.frag");
+		if (bakedObject.programID == 0)
+		{
+			std::cerr << "Failed to load shaders." << std::endl;
+		}
 
-		// Initialize the skin
-		const tinygltf::Skin &skin = model.skins[0];
+		bakedObject.mvpMatrixID = glGetUniformLocation(bakedObject.programID, "MVP");
+		bakedObject.posesID = glGetUniformLocation(bakedObject.programID, "bakedPoses");
+		bakedObject.frameRateID = glGetUniformLocation(bakedObject.programID, "frameRate");
+		bakedObject.frameCountID = glGetUniformLocation(bakedObject.programID, "frameCount");
+		bakedObject.timeID = glGetUniformLocation(bakedObject.programID, "time");
+		bakedObject.octNormalsID = glGetUniformLocation(bakedObject.programID, "octNormals");
+		bakedObject.lightPositionID = glGetUniformLocation(bakedObject.programID, "lightPosition");
+		bakedObject.lightIntensityID = glGetUniformLocation(bakedObject.programID, "lightIntensity");
+	}
 
-		std::vector<glm::mat4> localNodeTransforms(skin.joints.size());
+	void initialize() {
+		// Modify your path if needed. Animation drops keys within half a
+		// unit of joint movement (about 0.2% of the bot's height) and
+		// quantizes the rest.
+		loadStart = glfwGetTime();
+		loader.start("../lab4/model/bot/bot.gltf", "../lab4/model/bot/bot.cooked",
+			"../lab4/model/bot/bot.bake", meshPackingFlags, 0.5f);
+		modelState = MODEL_LOADING;
+		uploadFrames = 0;
+
+		// Instance updates run as jobs once a job system is attached
+		jobSystem = NULL;
+		updateBatch = [this](int begin, int end) {
+			for (int i = begin; i < end; ++i) {
+				updateInstance(instanceObjects[i], updateDeltaTime);
+			}
+		};
+
+		meshObject.vao = 0;
+		meshObject.vertexBuffer = 0;
+		meshObject.indexBuffer = 0;
+		bakedObject.texture = 0;
+		programID = 0;
+		glGenBuffers(1, &instanceVBO);
+		baked = false;
+		uniformSampling = false;
+		animationFrame = 0;
+		scheduledUpdates = 0.0f;
+		bakedTime = 0.0f;
+		paletteEncoding = PALETTE_MAT4;
+		paletteOffset = 0;
+		visibleCount = 0;
+		drawnTriangles = 0;
+		instancesDirty = true;
+
+		initializePlaceholder();
+	}
 
-		glm::mat4 parentTransform(1.0f);
-		std::vector<glm::mat4> globalNodeTransforms(skin.joints.size());
+	// Take over the model from the loader thread: create the GL objects
+	// and queue their contents, set up skinning, and compile the shaders
+	void beginUpload() {
+		LoadedModel &loaded = loader.model;
 
-        // Compute local transforms at each node
-		for(int i=0;i<skin.joints.size();i++){
-			int rootNodeIndex = skin.joints[i];
-			computeLocalNodeTransform(model, i, localNodeTransforms);
+		bindMesh(loaded);
+		bindInstanceAttributes();
+
+		hierarchy = loaded.hierarchy;
+		for (size_t i = 0; i < loaded.inverseBindMatrices.size(); ++i) {
+			SkinObject skinObject;
+			skinObject.inverseBindMatrices = loaded.inverseBindMatrices[i];
+			skinObjects.push_back(skinObject);
+		}
+		compressedClips.swap(loaded.compressedClips);
+		keyframedClips.swap(loaded.keyframedClips);
+		std::cout << "Compressed animation: " << loaded.rawClipBytes / 1024 << " KB -> "
+			<< loaded.compressedClipBytes / 1024 << " KB" << std::endl;
+
+		// Skin space from the rest pose
+		std::vector<glm::mat4> restGlobalTransforms;
+		computeGlobalTransforms(hierarchy, hierarchy.restTransforms, restGlobalTransforms);
+		skinSpace = computeSkinSpace(hierarchy, 0, restGlobalTransforms);
+		skinSpaceInverse = glm::inverse(skinSpace);
+
+		// Bound the skin joints generously; the mesh reaches past them and
+		// the animation moves them away from the rest pose
+		const std::vector<int> &skinJoints = hierarchy.skinJoints[0];
+		boundsCenter = glm::vec3(0.0f);
+		for (size_t j = 0; j < skinJoints.size(); ++j) {
+			boundsCenter += glm::vec3(restGlobalTransforms[skinJoints[j]][3]) / (float)skinJoints.size();
 		}
+		boundsRadius = 0.0f;
+		for (size_t j = 0; j < skinJoints.size(); ++j) {
+			boundsRadius = std::max(boundsRadius,
+				glm::length(glm::vec3(restGlobalTransforms[skinJoints[j]][3]) - boundsCenter));
+		}
+		boundsRadius *= 1.5f;
 
-		// Compute global transforms at each node
-		computeGlobalNodeTransform(model, localNodeTransforms, 24, parentTransform, globalNodeTransforms);
-		globalTransforms = globalNodeTransforms;
+		// A single character until the crowd is resized
+		setCrowdSize(1);
 
+		// Poses sampled offline for playback without CPU work
+		bakedObject.animation = loaded.bakedAnimation;
+		bindBakedAnimation();
 
 		// Create and compile our GLSL program from the shaders
 		programID = LoadShadersFromFile("../lab4/shader/bot.vert", "../lab4/shader/bot.frag");
@@ -490,205 +803,356 @@ struct MyBot {
 		mvpMatrixID = glGetUniformLocation(programID, "MVP");
 		lightPositionID = glGetUniformLocation(programID, "lightPosition");
 		lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+		jointPaletteID = glGetUniformLocation(programID, "jointPalette");
+		paletteOffsetID = glGetUniformLocation(programID, "paletteOffset");
+		jointCountID = glGetUniformLocation(programID, "jointCount");
+		paletteEncodingID = glGetUniformLocation(programID, "paletteEncoding");
+		octNormalsID = glGetUniformLocation(programID, "octNormals");
+		skinSpaceID = glGetUniformLocation(programID, "skinSpace");
+		skinSpaceInverseID = glGetUniformLocation(programID, "skinSpaceInverse");
 	}
 
-	void bindMesh(std::vector<PrimitiveObject> &primitiveObjects,
-				tinygltf::Model &model, tinygltf::Mesh &mesh) {
-
-		std::map<int, GLuint> vbos;
-		for (size_t i = 0; i < model.bufferViews.size(); ++i) {
-			const tinygltf::BufferView &bufferView = model.bufferViews[i];
-
-			int target = bufferView.target;
-
-			if (bufferView.target == 0) {
-				// The bufferView with target == 0 in our model refers to
-				// the skinning weights, for 25 joints, each 4x4 matrix (16 floats), totaling to 400 floats or 1600 bytes.
-				// So it is considered safe to skip the warning.
-				//std::cout << "WARN: bufferView.target is zero" << std::endl;
-				continue;
+	// Advance loading by one frame: take over the model once the loader
+	// thread is done, then upload up to budget bytes of it. Returns true once
+	// the model is ready to animate and draw.
+	bool updateLoading(size_t budget) {
+		if (modelState == MODEL_LOADING) {
+			LoadState state = loader.poll();
+			if (state == LOAD_PENDING) {
+				return false;
 			}
-
-			const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-			GLuint vbo;
-			glGenBuffers(1, &vbo);
-			glBindBuffer(target, vbo);
-			glBufferData(target, bufferView.byteLength,
-						&buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
-
-			vbos[i] = vbo;
+			loader.cleanup();
+			if (state == LOAD_FAILED) {
+				std::cerr << "Failed to load the model." << std::endl;
+				modelState = MODEL_FAILED;
+				return false;
+			}
+			beginUpload();
+			modelState = MODEL_UPLOADING;
 		}
 
-		// Each mesh can contain several primitives (or parts), each we need to
-		// bind to an OpenGL vertex array object
-		for (size_t i = 0; i < mesh.primitives.size(); ++i) {
-
-			tinygltf::Primitive primitive = mesh.primitives[i];
-			tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-
-			GLuint vao;
-			glGenVertexArrays(1, &vao);
-			glBindVertexArray(vao);
-
-			for (auto &attrib : primitive.attributes) {
-				tinygltf::Accessor accessor = model.accessors[attrib.second];
-				int byteStride =
-					accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-				glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
-
-				int size = 1;
-				if (accessor.type != TINYGLTF_TYPE_SCALAR) {
-					size = accessor.type;
-				}
-
-				int vaa = -1;
-				if (attrib.first.compare("POSITION") == 0) vaa = 0;
-				if (attrib.first.compare("NORMAL") == 0) vaa = 1;
-				if (attrib.first.compare("TEXCOORD_0") == 0) vaa = 2;
-				if (attrib.first.compare("JOINTS_0") == 0) vaa = 3;
-				if (attrib.first.compare("WEIGHTS_0") == 0) vaa = 4;
-				if (vaa > -1) {
-					glEnableVertexAttribArray(vaa);
-					glVertexAttribPointer(vaa, size, accessor.componentType,
-										accessor.normalized ? GL_TRUE : GL_FALSE,
-										byteStride, BUFFER_OFFSET(accessor.byteOffset));
-				} else {
-					std::cout << "vaa missing: " << attrib.first << std::endl;
-				}
+		if (modelState == MODEL_UPLOADING) {
+			upload.update(budget);
+			uploadFrames++;
+			if (!upload.done()) {
+				return false;
 			}
 
-			// Record VAO for later use
-			PrimitiveObject primitiveObject;
-			primitiveObject.vao = vao;
-			primitiveObject.vbos = vbos;
-			primitiveObjects.push_back(primitiveObject);
+			std::cout << "Loaded " << loader.model.source << " in " << (glfwGetTime() - loadStart) * 1000.0
+				<< " ms: " << loader.loadTime * 1000.0 << " ms on the loader thread, "
+				<< upload.totalBytes / 1024 << " KB uploaded over " << uploadFrames << " frames" << std::endl;
 
-			glBindVertexArray(0);
+			// The GPU has its copy now
+			releaseModelData(loader.model);
+			loader.model = LoadedModel();
+			std::vector<glm::mat4>().swap(bakedObject.animation.matrices);
+			upload = StagedUpload();
+			modelState = MODEL_READY;
 		}
+
+		return modelState == MODEL_READY;
 	}
 
-	void bindModelNodes(std::vector<PrimitiveObject> &primitiveObjects,
-						tinygltf::Model &model,
-						tinygltf::Node &node) {
-		// Bind buffers for the current mesh at the node
-		if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-			bindMesh(primitiveObjects, model, model.meshes[node.mesh]);
+	// Fraction of the model's data loaded, for display
+	float loadProgress() const {
+		if (modelState == MODEL_READY) {
+			return 1.0f;
 		}
-
-		// Recursive into children nodes
-		for (size_t i = 0; i < node.children.size(); i++) {
-			assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
-			bindModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+		if (modelState != MODEL_UPLOADING || upload.totalBytes == 0) {
+			return 0.0f;
 		}
+		return (float)upload.uploadedBytes / upload.totalBytes;
 	}
 
-	std::vector<PrimitiveObject> bindModel(tinygltf::Model &model) {
-		std::vector<PrimitiveObject> primitiveObjects;
+	// A box roughly the size of the bot, drawn at each character's place
+	// while the model loads
+	void initializePlaceholder() {
+		const std::string vertexShader = R"(
+		#version 330 core
 
-		const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-		for (size_t i = 0; i < scene.nodes.size(); ++i) {
-			assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-			bindModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
-		}
+		layout(location = 0) in vec3 vertexPosition;
+		layout(location = 1) in vec3 instanceOffset;
 
-		return primitiveObjects;
-	}
+		uniform mat4 MVP;
 
-	void drawMesh(const std::vector<PrimitiveObject> &primitiveObjects,
-				tinygltf::Model &model, tinygltf::Mesh &mesh) {
+		out float shade;
 
-		for (size_t i = 0; i < mesh.primitives.size(); ++i)
-		{
-			GLuint vao = primitiveObjects[i].vao;
-			std::map<int, GLuint> vbos = primitiveObjects[i].vbos;
+		void main() {
+			gl_Position = MVP * vec4(vertexPosition + instanceOffset, 1);
+			shade = 0.6 + 0.4 * vertexPosition.y / 180.0;
+		}
+		)";
 
-			glBindVertexArray(vao);
+		const std::string fragmentShader = R"(
+		#version 330 core
 
-			tinygltf::Primitive primitive = mesh.primitives[i];
-			tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+		in float shade;
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
+		uniform float pulse;
 
-			glDrawElements(primitive.mode, indexAccessor.count,
-						indexAccessor.componentType,
-						BUFFER_OFFSET(indexAccessor.byteOffset));
+		out vec3 finalColor;
+
+		void main()
+		{
+			finalColor = vec3(0.45, 0.45, 0.5) * shade * pulse;
+		}
+		)";
+
+		// Corners of a box 80 units wide and 180 high standing on the ground
+		GLfloat vertices[8 * 3];
+		for (int i = 0; i < 8; ++i) {
+			vertices[i * 3] = (i & 1) ? 40.0f : -40.0f;
+			vertices[i * 3 + 1] = (i & 2) ? 180.0f : 0.0f;
+			vertices[i * 3 + 2] = (i & 4) ? 40.0f : -40.0f;
+		}
+		const GLushort indices[] = {
+			0, 2, 3, 0, 3, 1,		// -z
+			4, 5, 7, 4, 7, 6,		// +z
+			0, 4, 6, 0, 6, 2,		// -x
+			1, 3, 7, 1, 7, 5,		// +x
+			0, 1, 5, 0, 5, 4,		// -y
+			2, 6, 7, 2, 7, 3		// +y
+		};
+
+		PlaceholderObject &placeholder = placeholderObject;
+		glGenVertexArrays(1, &placeholder.vao);
+		glBindVertexArray(placeholder.vao);
+
+		glGenBuffers(1, &placeholder.vertexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, placeholder.vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+
+		glGenBuffers(1, &placeholder.indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, placeholder.indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+		glGenBuffers(1, &placeholder.offsetBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, placeholder.offsetBuffer);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribDivisor(1, 1);
+		placeholder.count = 0;
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		placeholder.programID = LoadShadersFromString(vertexShader, fragmentShader);
+		if (placeholder.programID == 0)
+		{
+			std::cerr << "Failed to load shaders." << std::endl;
+		}
+		placeholder.mvpMatrixID = glGetUniformLocation(placeholder.programID, "MVP");
+		placeholder.pulseID = glGetUniformLocation(placeholder.programID, "pulse");
+	}
 
-			glBindVertexArray(0);
+	// One instanced draw of a box per character, pulsing to show progress
+	void renderPlaceholder(glm::mat4 cameraMatrix, int count, float time) {
+		PlaceholderObject &placeholder = placeholderObject;
+		if (placeholder.count != count) {
+			std::vector<glm::vec3> offsets(count);
+			for (int i = 0; i < count; ++i) {
+				offsets[i] = glm::vec3(crowdPlacement(i, count)[3]);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, placeholder.offsetBuffer);
+			glBufferData(GL_ARRAY_BUFFER, offsets.size() * sizeof(glm::vec3), &offsets[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			placeholder.count = count;
 		}
+
+		glUseProgram(placeholder.programID);
+		glUniformMatrix4fv(placeholder.mvpMatrixID, 1, GL_FALSE, &cameraMatrix[0][0]);
+		glUniform1f(placeholder.pulseID, 0.75f + 0.25f * sinf(time * 4.0f));
+
+		glBindVertexArray(placeholder.vao);
+		glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, count);
+		glBindVertexArray(0);
 	}
 
-	void drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects,
-						tinygltf::Model &model, tinygltf::Node &node) {
-		// Draw the mesh at the node, and recursively do so for children nodes
-		if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-			drawMesh(primitiveObjects, model, model.meshes[node.mesh]);
+	// Set up the loaded packed mesh: one vertex buffer, one index buffer, one
+	// VAO, and per detail level one draw command per primitive. The buffer
+	// contents are queued on the staged upload, straight from the cooked
+	// file if it is mapped; loaded must outlive the upload.
+	void bindMesh(const LoadedModel &loaded) {
+		const PackedMesh &mesh = loaded.mesh;
+		const std::vector<PackedPrimitive> &primitives = mesh.primitives;
+		const std::vector<PackedLod> &lods = mesh.lods;
+		GLenum indexType = mesh.indexType;
+
+		glGenVertexArrays(1, &meshObject.vao);
+		glBindVertexArray(meshObject.vao);
+
+		glGenBuffers(1, &meshObject.vertexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, meshObject.vertexBuffer);
+		glGenBuffers(1, &meshObject.indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshObject.indexBuffer);
+		meshObject.indexType = indexType;
+		meshObject.octNormals = (mesh.flags & PACK_QUANTIZE) != 0;
+
+		for (size_t i = 0; i < mesh.attributes.size(); ++i) {
+			const PackedAttribute &attribute = mesh.attributes[i];
+			glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.size, attribute.componentType,
+								attribute.normalized ? GL_TRUE : GL_FALSE,
+								mesh.vertexStride, BUFFER_OFFSET(attribute.offset));
 		}
-		for (size_t i = 0; i < node.children.size(); i++) {
-			drawModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		upload.addBuffer(meshObject.vertexBuffer, loaded.vertexData(), loaded.vertexBytes());
+		upload.addBuffer(meshObject.indexBuffer, loaded.indexData(), loaded.indexBytes());
+
+		// Levels are stored one after another with the same primitive count
+		lodDrawLists.assign(lods.size(), DrawList());
+		lodErrors.resize(lods.size());
+		lodTriangles.assign(lods.size(), 0);
+		for (size_t l = 0; l < lods.size(); ++l) {
+			size_t end = l + 1 < lods.size() ? (size_t)lods[l + 1].firstPrimitive : primitives.size();
+			for (size_t i = lods[l].firstPrimitive; i < end; ++i) {
+				const PackedPrimitive &primitive = primitives[i];
+				lodDrawLists[l].add(meshObject.vao, primitive.mode, primitive.indexCount, indexType,
+							primitive.indexOffset, primitive.baseVertex);
+				if (primitive.mode == GL_TRIANGLES) {
+					lodTriangles[l] += primitive.indexCount / 3;
+				}
+			}
+			lodErrors[l] = lods[l].error;
 		}
+		lodFirst.assign(lods.size(), 0);
+		lodCount.assign(lods.size(), 0);
+
+		std::cout << "Mesh: " << primitives.size() / lods.size() << " primitives, " << lods.size() << " LODs, "
+			<< loaded.vertexBytes() / 1024 << " KB vertices (" << mesh.vertexStride << " bytes each), "
+			<< loaded.indexBytes() / 1024 << " KB indices" << std::endl;
 	}
-	void drawModel(const std::vector<PrimitiveObject>& primitiveObjects,
-				tinygltf::Model &model) {
-		// Draw all nodes
-		const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-		for (size_t i = 0; i < scene.nodes.size(); ++i) {
-			drawModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+
+	// Attach the instance buffer to the model's VAO, one element per
+	// instance starting at the given one. Without base instance support in
+	// GL 3.3, each detail level's range is drawn by moving the pointers.
+	void bindInstanceAttributes(int first = 0) {
+		size_t offset = first * sizeof(InstanceData);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBindVertexArray(meshObject.vao);
+
+		// A mat4 attribute takes four consecutive locations
+		for (int column = 0; column < 4; ++column) {
+			glEnableVertexAttribArray(5 + column);
+			glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+								BUFFER_OFFSET(offset + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(5 + column, 1);
 		}
+		glEnableVertexAttribArray(9);
+		glVertexAttribPointer(9, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+							BUFFER_OFFSET(offset + offsetof(InstanceData, clock)));
+		glVertexAttribDivisor(9, 1);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	void render(glm::mat4 cameraMatrix) {
-		glUseProgram(programID);
+	// Append the joint matrices of every visible instance to this frame's
+	// palettes, in draw order
+	void writePalette(JointPaletteBuffer &palettes) {
+		// The single sync point with the update jobs
+		finishUpdate();
 
-		// Set camera
-		glm::mat4 mvp = cameraMatrix;
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+		for (size_t i = 0; i < drawOrder.size(); ++i) {
+			int offset = palettes.add(instanceObjects[drawOrder[i]].drawnTexels());
+			if (i == 0) {
+				paletteOffset = offset;
+			}
+		}
+	}
 
-		const tinygltf::Skin &skin = model.skins[0];
+	// Draw each detail level's range of instances. Instances pick their
+	// palette by gl_InstanceID, counted from the start of the range.
+	void submitLods(bool palettes) {
+		int texelsPerInstance = (int)skinObjects[0].inverseBindMatrices.size() * paletteTexelsPerJoint(paletteEncoding);
+		for (size_t l = 0; l < lodDrawLists.size(); ++l) {
+			if (lodCount[l] == 0) {
+				continue;
+			}
+			bindInstanceAttributes(lodFirst[l]);
+			if (palettes) {
+				glUniform1i(paletteOffsetID, paletteOffset + lodFirst[l] * texelsPerInstance);
+			}
+			lodDrawLists[l].submit((GLsizei)lodCount[l]);
+		}
+	}
 
-		std::vector<glm::mat4> localNodeTransforms(skin.joints.size());
+	void renderBaked(glm::mat4 cameraMatrix) {
+		glUseProgram(bakedObject.programID);
 
-		glm::mat4 parentTransform(1.0f);
-		std::vector<glm::mat4> globalNodeTransforms(skin.joints.size());
+		glUniformMatrix4fv(bakedObject.mvpMatrixID, 1, GL_FALSE, &cameraMatrix[0][0]);
 
-        // Compute local transforms at each node
-		for(int i=0;i<skin.joints.size();i++){
-			int rootNodeIndex = skin.joints[i];
-			computeLocalNodeTransform(model, i, localNodeTransforms);
-		}
+		// Baked poses and the shared playback time
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, bakedObject.texture);
+		glUniform1i(bakedObject.posesID, 0);
+		glUniform1f(bakedObject.frameRateID, bakedObject.animation.frameRate);
+		glUniform1i(bakedObject.frameCountID, bakedObject.animation.frameCount);
+		glUniform1f(bakedObject.timeID, bakedTime);
+		glUniform1i(bakedObject.octNormalsID, meshObject.octNormals ? 1 : 0);
 
-		// Compute global transforms at each node
-		computeGlobalNodeTransform(model, localNodeTransforms, 24, parentTransform, globalNodeTransforms);
-		globalTransforms = globalNodeTransforms;
+		// Set light data
+		glUniform3fv(bakedObject.lightPositionID, 1, &lightPosition[0]);
+		glUniform3fv(bakedObject.lightIntensityID, 1, &lightIntensity[0]);
 
-		// -----------------------------------------------------------------
-		// TODO: Set animation data for linear blend skinning in shader
-		// -----------------------------------------------------------------
+		submitLods(false);
+	}
 
-		// Implement Linear Skin Blending
-		for(int j=0; j<25; j++){
-			skinObjects[0].jointMatrices[j] = glm::inverse(globalTransforms[j]) * skinObjects[0].globalJointTransforms[j] * skinObjects[0].inverseBindMatrices[j];
+	void render(glm::mat4 cameraMatrix, const JointPaletteBuffer &palettes) {
+		if (baked) {
+			renderBaked(cameraMatrix);
+			return;
 		}
-		// for(int x = 0;x<skinObjects.size(); x++){
-		// }
 
-		// -----------------------------------------------------------------
+		glUseProgram(programID);
 
+		// Set camera
+		glm::mat4 mvp = cameraMatrix;
+		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
+		// Set joint matrices for linear blend skinning in the shader
+		palettes.bind(GL_TEXTURE0);
+		glUniform1i(jointPaletteID, 0);
+		glUniform1i(jointCountID, (GLint)skinObjects[0].inverseBindMatrices.size());
+		glUniform1i(paletteEncodingID, (GLint)paletteEncoding);
+		glUniform1i(octNormalsID, meshObject.octNormals ? 1 : 0);
+		glUniformMatrix4fv(skinSpaceID, 1, GL_FALSE, &skinSpace[0][0]);
+		glUniformMatrix4fv(skinSpaceInverseID, 1, GL_FALSE, &skinSpaceInverse[0][0]);
 
 		// Set light data
 		glUniform3fv(lightPositionID, 1, &lightPosition[0]);
 		glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
-		// Draw the GLTF model
-		drawModel(primitiveObjects, model);
+		// One draw per primitive and detail level for the whole crowd
+		submitLods(true);
 	}
 
 	void cleanup() {
+		loader.cleanup();
+		releaseModelData(loader.model);
+		finishUpdate();
+		glDeleteVertexArrays(1, &placeholderObject.vao);
+		glDeleteBuffers(1, &placeholderObject.vertexBuffer);
+		glDeleteBuffers(1, &placeholderObject.indexBuffer);
+		glDeleteBuffers(1, &placeholderObject.offsetBuffer);
+		glDeleteProgram(placeholderObject.programID);
 		glDeleteProgram(programID);
+		glDeleteBuffers(1, &instanceVBO);
+		glDeleteVertexArrays(1, &meshObject.vao);
+		glDeleteBuffers(1, &meshObject.vertexBuffer);
+		glDeleteBuffers(1, &meshObject.indexBuffer);
+		if (bakedObject.texture != 0) {
+			glDeleteTextures(1, &bakedObject.texture);
+			glDeleteProgram(bakedObject.programID);
+		}
 	}
 };
 
-int main(void)
+int main(int argc, char *argv[])
 {
 	// Initialise GLFW
 	if (!glfwInit())
@@ -730,9 +1194,26 @@ int main(void)
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 
-	// Our 3D character
+	// Worker threads for the animation update, one per extra core
+	JobSystem jobSystem;
+	jobSystem.initialize(0);
+	std::cout << "Animation update on " << jobSystem.threadCount() << " threads" << std::endl;
+
+	// Our 3D character, loading in the background
 	MyBot bot;
 	bot.initialize();
+	bot.jobSystem = &jobSystem;
+
+	// Optional initial crowd size on the command line
+	if (argc > 1) {
+		crowdSize = glm::clamp(atoi(argv[1]), 1, maxCrowdSize);
+	}
+
+	// Joint matrices of every character, uploaded once per frame. The joint
+	// count is not known before the model has loaded; the buffers grow as
+	// needed.
+	JointPaletteBuffer jointPalettes;
+	jointPalettes.initialize(64 * 4 * crowdSize);
 
 	// Camera setup
     glm::mat4 viewMatrix, projectionMatrix;
@@ -740,8 +1221,9 @@ int main(void)
 
 	// Time and frame rate tracking
 	static double lastTime = glfwGetTime();
-	float time = 0.0f;			// Animation time
 	float fTime = 0.0f;			// Time for measuring fps
+	double cpuTime = 0.0;		// Time spent updating and submitting the crowd
+	double submitTime = 0.0;	// Of which spent in draw submission
 	unsigned long frames = 0;
 
 	// Main loop
@@ -754,15 +1236,63 @@ int main(void)
         float deltaTime = float(currentTime - lastTime);
 		lastTime = currentTime;
 
+		viewMatrix = glm::lookAt(eye_center, lookat, up);
+		glm::mat4 vp = projectionMatrix * viewMatrix;
+
+		// Placeholders until the model has loaded and been uploaded
+		if (!bot.updateLoading(uploadBudget)) {
+			bot.renderPlaceholder(vp, crowdSize, (float)currentTime);
+
+			std::stringstream stream;
+			stream << "Lab 4 | Loading: " << (int)(bot.loadProgress() * 100.0f) << "%";
+			glfwSetWindowTitle(window, stream.str().c_str());
+
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+			continue;
+		}
+
+		// Every character's palette must fit in one texture buffer, in the
+		// widest encoding
+		int texelsPerCharacter = (int)bot.skinObjects[0].inverseBindMatrices.size() * paletteTexelsPerJoint(PALETTE_MAT4);
+		int maxPaletteCrowd = texelsPerCharacter > 0 ? (int)(jointPalettes.maxTexels / texelsPerCharacter) : maxCrowdSize;
+		if (crowdSize > maxPaletteCrowd) {
+			std::cerr << "Crowd limited to " << maxPaletteCrowd
+				<< " characters by GL_MAX_TEXTURE_BUFFER_SIZE." << std::endl;
+			crowdSize = std::max(maxPaletteCrowd, 1);
+		}
+		if ((int)bot.instanceObjects.size() != crowdSize) {
+			bot.setCrowdSize(crowdSize);
+		}
+		bot.setBakedPlayback(bakedPlayback);
+		bot.setPaletteEncoding(selectedPaletteEncoding);
+		bot.setUniformSampling(gridSampling);
+
+		double cpuStart = glfwGetTime();
+
+		// Characters out of view skip their pose update and are not drawn;
+		// distant ones use a coarser mesh
+		bot.cull(vp);
+		bot.selectLods(projectionMatrix, eye_center, windowHeight, lodSelection);
+		bot.scheduleAnimation(projectionMatrix, eye_center, windowHeight, animationLod);
 		if (playAnimation) {
-			time += deltaTime * playbackSpeed;
-			bot.update(time);
+			bot.update(deltaTime * playbackSpeed);
 		}
 
 		// Rendering
-		viewMatrix = glm::lookAt(eye_center, lookat, up);
-		glm::mat4 vp = projectionMatrix * viewMatrix;
-		bot.render(vp);
+
+		if (!bot.baked) {
+			jointPalettes.clear();
+			bot.writePalette(jointPalettes);
+			jointPalettes.upload();
+		}
+
+		double submitStart = glfwGetTime();
+		bot.render(vp, jointPalettes);
+		double cpuEnd = glfwGetTime();
+
+		submitTime += cpuEnd - submitStart;
+		cpuTime += cpuEnd - cpuStart;
 
 		// FPS tracking
 		// Count number of frames over a few seconds and take average
@@ -770,11 +1300,22 @@ int main(void)
 		fTime += deltaTime;
 		if (fTime > 2.0f) {
 			float fps = frames / fTime;
+			double cpuMs = cpuTime * 1000.0 / frames;
+			double submitMs = submitTime * 1000.0 / frames;
+			double frameMs = fTime * 1000.0 / frames;
 			frames = 0;
 			fTime = 0;
+			cpuTime = 0;
+			submitTime = 0;
 
 			std::stringstream stream;
-			stream << std::fixed << std::setprecision(2) << "Lab 4 | Frames per second (FPS): " << fps;
+			stream << std::fixed << std::setprecision(2) << "Lab 4 | Frames per second (FPS): " << fps
+				<< " | Characters: " << bot.visibleCount << "/" << bot.instanceObjects.size()
+				<< (bot.baked ? " (baked)" : bot.uniformSampling ? " (grid)" : "")
+				<< " | Palette: " << paletteEncodingName(bot.paletteEncoding)
+				<< " | Poses: " << (int)bot.scheduledUpdates << "/frame" << (animationLod ? "" : " (no LOD)")
+				<< " | Triangles: " << bot.drawnTriangles / 1000 << "K" << (lodSelection ? "" : " (no LOD)")
+				<< " | Frame: " << frameMs << " ms | CPU: " << cpuMs << " ms | Submit: " << submitMs << " ms";
 			glfwSetWindowTitle(window, stream.str().c_str());
 		}
 
@@ -787,6 +1328,8 @@ int main(void)
 
 	// Clean up
 	bot.cleanup();
+	jointPalettes.cleanup();
+	jobSystem.cleanup();
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -811,6 +1354,34 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 		}
 	}
 
+	if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && action == GLFW_PRESS) {
+		crowdSize = std::min(crowdSize * 10, maxCrowdSize);
+	}
+
+	if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) && action == GLFW_PRESS) {
+		crowdSize = std::max(crowdSize / 10, 1);
+	}
+
+	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		selectedPaletteEncoding = (PaletteEncoding)((selectedPaletteEncoding + 1) % 3);
+	}
+
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		bakedPlayback = !bakedPlayback;
+	}
+
+	if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+		gridSampling = !gridSampling;
+	}
+
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+		animationLod = !animationLod;
+	}
+
+	if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+		lodSelection = !lodSelection;
+	}
+
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
 		playAnimation = !playAnimation;
 	}
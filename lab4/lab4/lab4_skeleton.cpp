@@ -12,9 +12,11 @@
 #include <tiny_gltf.h>
 
 #include <render/shader.h>
+#include <animation/animation.h>
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iomanip>
@@ -43,7 +45,14 @@ static glm::vec3 lightPosition(-275.0f, 500.0f, 800.0f);
 static bool playAnimation = true;
 static float playbackSpeed = 2.0f;
 
-// Helper class to render skeleton based on given animation data
+// Crowd, resized with the +/- keys in steps of 10x
+static int crowdSize = 1;
+static const int maxCrowdSize = 1000;
+
+// Helper class to render skeletons based on given animation data. The
+// skeletons of a frame are gathered with addSkeleton() and drawn together:
+// every bone in one streamed line buffer, every joint sphere in one
+// instanced draw.
 struct Skeleton {
 
 	const std::string vertexShader = R"(
@@ -51,10 +60,14 @@ struct Skeleton {
 
 	layout(location = 0) in vec3 vertexPosition;
 
+	// Center and radius of a joint sphere, per instance. Lines leave it at
+	// (0, 0, 0, 1) so their vertices pass through unchanged.
+	layout(location = 1) in vec4 sphere;
+
 	uniform mat4 MVP;
 
 	void main() {
-		gl_Position =  MVP * vec4(vertexPosition, 1);
+		gl_Position =  MVP * vec4(vertexPosition * sphere.w + sphere.xyz, 1);
 	}
 	)";
 
@@ -73,10 +86,25 @@ struct Skeleton {
     GLuint mvpMatrixID;
 	GLuint sphereVAO, sphereVBO, sphereEBO;
 	int sphereIndexCount = 0;
+	GLuint sphereInstanceVBO;
+	GLuint lineVAO, lineVBO;
+
+	// Gathered for the current frame
+	std::vector<glm::vec3> lineVertices;	// Two per bone
+	std::vector<glm::vec4> spheres;			// Center and radius per joint
 
 	void initialize() {
 		createSphereMesh(1.0f, 8, 8);
 
+		// Bone lines, refilled every frame
+		glGenVertexArrays(1, &lineVAO);
+		glGenBuffers(1, &lineVBO);
+		glBindVertexArray(lineVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+
         programID = LoadShadersFromString(vertexShader, fragmentShader);
 		if (programID == 0)
 		{
@@ -147,71 +175,79 @@ struct Skeleton {
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
 		glEnableVertexAttribArray(0);
 
+		// One sphere per instance, refilled every frame
+		glGenBuffers(1, &sphereInstanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereInstanceVBO);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribDivisor(1, 1);
+
 		glBindVertexArray(0);
 	}
 
-	void renderSphere(const glm::vec3& position, float radius, const glm::mat4& viewProjMatrix) {
-		glm::mat4 modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, position);
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(radius));
+	// Orphan the buffer before refilling it, so the upload does not wait
+	// for draws still reading the previous frame's data
+	void streamBuffer(GLuint buffer, size_t bytes, const void *data) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)bytes, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Start gathering skeletons for a new frame
+	void clear() {
+		lineVertices.clear();
+		spheres.clear();
+	}
 
-        glm::mat4 mvp = viewProjMatrix * modelMatrix;
+	// A sphere at each skin joint and a line to its parent joint
+	void addSkeleton(const SkeletonHierarchy &hierarchy,
+		const std::vector<glm::mat4> &globalTransforms,
+		const glm::mat4 &modelMatrix, float radius = 2.0f)
+	{
+		for (size_t j = 0; j < hierarchy.nodes.size(); ++j) {
+			if (!hierarchy.isSkinJoint[j]) continue;
 
-		glUseProgram(programID);
-		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+			glm::vec3 jointPosition = glm::vec3(modelMatrix * globalTransforms[j][3]);
+			spheres.push_back(glm::vec4(jointPosition, radius));
 
-		glBindVertexArray(sphereVAO);
-		glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+			int parent = hierarchy.parents[j];
+			if (parent >= 0 && hierarchy.isSkinJoint[parent]) {
+				lineVertices.push_back(glm::vec3(modelMatrix * globalTransforms[parent][3]));
+				lineVertices.push_back(jointPosition);
+			}
+		}
 	}
 
-	void renderLine(const glm::vec3& start, const glm::vec3& end, const glm::mat4& viewProjMatrix) {
+	// Draw everything added since clear() with two draw calls
+	void render(const glm::mat4 &viewProjMatrix) {
+		glUseProgram(programID);
 		glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &viewProjMatrix[0][0]);
 
-		GLfloat vertices[] = { start.x, start.y, start.z, end.x, end.y, end.z };
-		GLuint VBO, VAO;
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
+		if (!spheres.empty()) {
+			streamBuffer(sphereInstanceVBO, spheres.size() * sizeof(glm::vec4), &spheres[0]);
+			glBindVertexArray(sphereVAO);
+			glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)spheres.size());
+		}
 
-		glUseProgram(programID);
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_LINES, 0, 2);
+		if (!lineVertices.empty()) {
+			streamBuffer(lineVBO, lineVertices.size() * sizeof(glm::vec3), &lineVertices[0]);
+			glBindVertexArray(lineVAO);
+			glVertexAttrib4f(1, 0.0f, 0.0f, 0.0f, 1.0f);
+			glDrawArrays(GL_LINES, 0, (GLsizei)lineVertices.size());
+		}
 
 		glBindVertexArray(0);
-		glDeleteBuffers(1, &VBO);
-		glDeleteVertexArrays(1, &VAO);
 	}
 
-	void renderSkeleton(const tinygltf::Model& model,
-        const tinygltf::Skin &skin,
-        const std::vector<glm::mat4> &globalTransforms,
-        const glm::mat4& viewProjMatrix)
-    {
-        if (skin.joints.size() <= 0) return;
-
-		for (size_t j = 0; j < skin.joints.size(); ++j) {
-            int nodeIndex = skin.joints[j];
-            const tinygltf::Node &node = model.nodes[nodeIndex];
-			if (node.translation.size() >= 0) {
-                glm::vec3 jointPosition =
-                    glm::vec3(globalTransforms[nodeIndex][3]);
-				renderSphere(jointPosition, 2.0f, viewProjMatrix);
-
-				for (const int childIndex : node.children) {
-					const auto& childNode = model.nodes[childIndex];
-					glm::vec3 childPosition =
-                        glm::vec3(globalTransforms[childIndex][3]);
-					renderLine(jointPosition, childPosition, viewProjMatrix);
-				}
-			}
-		}
+	void cleanup() {
+		glDeleteProgram(programID);
+		glDeleteVertexArrays(1, &sphereVAO);
+		glDeleteBuffers(1, &sphereVBO);
+		glDeleteBuffers(1, &sphereEBO);
+		glDeleteBuffers(1, &sphereInstanceVBO);
+		glDeleteVertexArrays(1, &lineVAO);
+		glDeleteBuffers(1, &lineVBO);
 	}
 };
 
@@ -220,285 +256,73 @@ struct MyBot {
 	tinygltf::Model model;
 
 	// Animation data
-	struct SamplerObject {
-		std::vector<float> input;
-		std::vector<glm::vec4> output;
-		int interpolation;
-	};
-	struct ChannelObject {
-		int sampler;
-		std::string targetPath;
-		int targetNode;
-	};
-	struct AnimationObject {
-		std::vector<SamplerObject> samplers;
-	};
-	std::vector<AnimationObject> animationObjects;
+	std::vector<AnimationClip> animationClips;
 
 	// The skeleton class for rendering the skeleton given the transforms
 	// obtained from the animation object
     Skeleton skeleton;
 
-	// The current global transforms for each joint
-	// Update this will result in skeleton in different poses
-    std::vector<glm::mat4> globalTransforms;
-
-	// Parse the transformation data at a node and turn into a 4x4 matrix
-	glm::mat4 getNodeTransform(const tinygltf::Node& node) {
-		glm::mat4 transform(1.0f);
-
-		if (node.matrix.size() == 16) {
-			transform = glm::make_mat4(node.matrix.data());
-		} else {
-			if (node.translation.size() == 3) {
-				transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
-			}
-			if (node.rotation.size() == 4) {
-				glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-				transform *= glm::mat4_cast(q);
-			}
-			if (node.scale.size() == 3) {
-				transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
-			}
-		}
-		return transform;
-	}
-
-	void computeLocalNodeTransform(const tinygltf::Model& model,
-		int nodeIndex,
-		std::vector<glm::mat4> &localTransforms)
-	{
-		// TODO: your code here
-		const tinygltf::Node &node = model.nodes[nodeIndex];
-
-		localTransforms[nodeIndex] = getNodeTransform(node);
-	}
-
-	void computeGlobalNodeTransform(const tinygltf::Model& model,
-		const std::vector<glm::mat4> &localTransforms,
-		int nodeIndex, const glm::mat4& parentTransform,
-		std::vector<glm::mat4> &globalTransforms)
-	{
-		// std::cout << "Processing Node:" << nodeIndex << std::endl;
-
-		// TODO: your code here
-		globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
-
-		// Now go to the children nodes if the nodes are not empty
-		const tinygltf::Node &node = model.nodes[nodeIndex];
-		if(!node.children.empty()){
-			for(int childNode: node.children){
-				computeGlobalNodeTransform(model,localTransforms,childNode,globalTransforms[nodeIndex],globalTransforms);
-			}
-		}
-	}
-
-	int findKeyframeIndex(const std::vector<float>& times, float animationTime)
-	{
-		int left = 0;
-		int right = times.size() - 1;
-
-		while (left <= right) {
-			int mid = (left + right) / 2;
-
-			if (mid + 1 < times.size() && times[mid] <= animationTime && animationTime < times[mid + 1]) {
-				return mid;
-			}
-			else if (times[mid] > animationTime) {
-				right = mid - 1;
-			}
-			else { // animationTime >= times[mid + 1]
-				left = mid + 1;
-			}
-		}
-
-		// Target not found
-		return times.size() - 2;
-	}
-
-	std::vector<AnimationObject> prepareAnimation(const tinygltf::Model &model)
-	{
-		std::vector<AnimationObject> animationObjects;
-		for (const auto &anim : model.animations) {
-			AnimationObject animationObject;
-
-			for (const auto &sampler : anim.samplers) {
-				SamplerObject samplerObject;
-
-				const tinygltf::Accessor &inputAccessor = model.accessors[sampler.input];
-				const tinygltf::BufferView &inputBufferView = model.bufferViews[inputAccessor.bufferView];
-				const tinygltf::Buffer &inputBuffer = model.buffers[inputBufferView.buffer];
-
-				assert(inputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-				assert(inputAccessor.type == TINYGLTF_TYPE_SCALAR);
-
-				// Input (time) values
-				samplerObject.input.resize(inputAccessor.count);
-
-				const unsigned char *inputPtr = &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset];
-				const float *inputBuf = reinterpret_cast<const float*>(inputPtr);
-
-				// Read input (time) values
-				int stride = inputAccessor.ByteStride(inputBufferView);
-				for (size_t i = 0; i < inputAccessor.count; ++i) {
-					samplerObject.input[i] = *reinterpret_cast<const float*>(inputPtr + i * stride);
-				}
-
-				const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];
-				const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-				const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];
+	// Joint hierarchy below the skin root, in parent-first order
+	SkeletonHierarchy hierarchy;
 
-				assert(outputAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+	// Each instance is one skeleton of the crowd, with its own placement
+	// and clock offset
+	struct InstanceObject {
+		glm::mat4 modelMatrix;
+		float timeOffset;
 
-				const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-				const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
-
-				int outputStride = outputAccessor.ByteStride(outputBufferView);
-
-				// Output values
-				samplerObject.output.resize(outputAccessor.count);
-
-				for (size_t i = 0; i < outputAccessor.count; ++i) {
-
-					if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
-						memcpy(&samplerObject.output[i], outputPtr + i * 3 * sizeof(float), 3 * sizeof(float));
-					} else if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
-						memcpy(&samplerObject.output[i], outputPtr + i * 4 * sizeof(float), 4 * sizeof(float));
-					} else {
-						std::cout << "Unsupport accessor type ..." << std::endl;
-					}
-
-				}
-
-				animationObject.samplers.push_back(samplerObject);
-			}
+		// Last keyframe found for each track, so that sampling steps forward
+		// from the previous frame instead of searching from scratch
+		std::vector<KeyframeCursor> keyframeCursors;
 
-			animationObjects.push_back(animationObject);
-		}
-		return animationObjects;
-	}
-
-	void updateAnimation(
-		const tinygltf::Model &model,
-		const tinygltf::Animation &anim,
-		const AnimationObject &animationObject,
-		float time,
-		std::vector<glm::mat4> &nodeTransforms)
-	{
-		// There are many channels so we have to accumulate the transforms
-		for (const auto &channel : anim.channels) {
-
-			int targetNodeIndex = channel.target_node;
-			const auto &sampler = anim.samplers[channel.sampler];
-
-			// Access output (value) data for the channel
-			const tinygltf::Accessor &outputAccessor = model.accessors[sampler.output];		// points to the values that need to be applied to the targetNode
-			const tinygltf::BufferView &outputBufferView = model.bufferViews[outputAccessor.bufferView];
-			const tinygltf::Buffer &outputBuffer = model.buffers[outputBufferView.buffer];		// contain the actual buffer
-
-			// Calculate current animation time (wrap if necessary)
-			const std::vector<float> &times = animationObject.samplers[channel.sampler].input;	// this is the upper row
-			float animationTime = fmod(time, times.back());
-
-			// ----------------------------------------------------------
-			// TODO: Find a keyframe for getting animation data
-			// ----------------------------------------------------------
-			int keyframeIndex = this->findKeyframeIndex(times,animationTime);	// determine the starting point of the interpolation
-
-			const unsigned char *outputPtr = &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset];
-			const float *outputBuf = reinterpret_cast<const float*>(outputPtr);
-
-			// -----------------------------------------------------------
-			// TODO: Add interpolation for smooth interpolation
-			// -----------------------------------------------------------
-
-			// take the value from keyFrameIndex to targetNodeIndex and interpolate the values with respect to time to find out the extra variable
+		// The current local and global transforms for each joint
+		// Update this will result in skeleton in different poses
+		std::vector<glm::mat4> localTransforms;
+		std::vector<glm::mat4> globalTransforms;
+	};
+	std::vector<InstanceObject> instanceObjects;
 
-			// if(sampler.interpolation=="LINEAR"){
-			// 	// nodeTransforms[keyframeIndex]
-			// }
+	void update(float time) {
+		// TODO:
+		// return;	// Do nothing for T-pose, comment out for animation
 
-			float t0 = times[keyframeIndex];
-			float t1 = times[keyframeIndex+1];
+		if (animationClips.size() > 0) {
+			const AnimationClip &clip = animationClips[0];
 
-			float factor = (animationTime-t1)/(t0-t1);
+			for (size_t i = 0; i < instanceObjects.size(); ++i) {
+				InstanceObject &instance = instanceObjects[i];
 
-			if (channel.target_path == "translation") {
-				glm::vec3 translation0, translation1;
-				memcpy(&translation0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-				memcpy(&translation1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
+				// One playback cursor per track, kept across frames
+				instance.keyframeCursors.resize(clip.tracks.size());
 
-				// glm::vec3 translation = glm::mix(translation0,translation1,factor);
-				glm::vec3 translation;
-				if(sampler.interpolation=="STEP"){
-					translation = translation1;
-				} else if(sampler.interpolation=="LINEAR"){
-					translation = glm::mix(translation0,translation1,factor);
-				}
-				nodeTransforms[targetNodeIndex] = glm::translate(nodeTransforms[targetNodeIndex], translation);
-
-			} else if (channel.target_path == "rotation") {
-				glm::quat rotation0, rotation1;
-				memcpy(&rotation0, outputPtr + keyframeIndex * 4 * sizeof(float), 4 * sizeof(float));
-				memcpy(&rotation1, outputPtr + (keyframeIndex+1) * 4 * sizeof(float), 4 * sizeof(float));
-
-				// glm::quat rotation = rotation0;
-				glm::quat rotation;
-				if(sampler.interpolation=="STEP"){
-					rotation = rotation1;
-				} else if(sampler.interpolation=="LINEAR"){
-					rotation = glm::slerp(rotation0,rotation1,factor);
-				}
-				nodeTransforms[targetNodeIndex] *= glm::mat4_cast(rotation);
-			} else if (channel.target_path == "scale") {
-				glm::vec3 scale0, scale1;
-				memcpy(&scale0, outputPtr + keyframeIndex * 3 * sizeof(float), 3 * sizeof(float));
-				memcpy(&scale1, outputPtr + (keyframeIndex+1) * 3 * sizeof(float), 3 * sizeof(float));
-
-				// glm::vec3 scale = glm::mix(scale0,scale1,factor);
-				glm::vec3 scale;
-				if(sampler.interpolation=="STEP"){
-					scale = scale1;
-				} else if(sampler.interpolation=="LINEAR"){
-					scale = glm::mix(scale0,scale1,factor);
-				}
-				nodeTransforms[targetNodeIndex] = glm::scale(nodeTransforms[targetNodeIndex], scale);
+				sampleAnimation(clip, hierarchy, time + instance.timeOffset, instance.keyframeCursors,
+					instance.localTransforms);
+				computeGlobalTransforms(hierarchy, instance.localTransforms, instance.globalTransforms);
 			}
 		}
 	}
 
-	void update(float time) {
-		// TODO:
-		// return;	// Do nothing for T-pose, comment out for animation
-
-		if (model.animations.size() > 0) {
-			const tinygltf::Animation &animation = model.animations[0];
-			const AnimationObject &animationObject = animationObjects[0];
-
-            const tinygltf::Skin &skin = model.skins[0];
-			std::vector<glm::mat4> nodeTransforms(skin.joints.size());
-			for (size_t i = 0; i < nodeTransforms.size(); ++i) {
-				nodeTransforms[i] = glm::mat4(1.0);
+	// Grow or shrink the crowd, laid out on a grid growing away from the
+	// camera. New skeletons start in the rest pose.
+	void setCrowdSize(int count) {
+		const float spacing = 150.0f;
+		int columns = (int)ceil(sqrt((float)count));
+
+		size_t first = instanceObjects.size();
+		instanceObjects.resize(count);
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			InstanceObject &instance = instanceObjects[i];
+
+			int row = (int)i / columns;
+			int column = (int)i % columns;
+			float x = (column - (columns - 1) * 0.5f) * spacing;
+			instance.modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, -row * spacing));
+
+			if (i >= first) {
+				instance.timeOffset = (i * 7919 % 1000) / 100.0f;
+				instance.localTransforms = hierarchy.restTransforms;
+				computeGlobalTransforms(hierarchy, instance.localTransforms, instance.globalTransforms);
 			}
-
-			updateAnimation(model, animation, animationObject, time, nodeTransforms);
-
-			// ----------------------------------------------
-            // TODO: Recompute global transforms at each node
-			// using the updated node transforms above
-            // ----------------------------------------------
-			// Compute local transforms at each node
-
-			std::vector<glm::mat4> globalNodeTransforms(skin.joints.size(), glm::mat4(1.0f));
-
-			// Start from the first joint
-			int rootNode = skin.joints[0];
-			// this function is already recursive
-			computeGlobalNodeTransform(model,nodeTransforms,rootNode,glm::mat4(1.0f),globalNodeTransforms);
-
-			// Update the value for global node transforms
-			globalTransforms = globalNodeTransforms;
-
 		}
 	}
 
@@ -530,40 +354,32 @@ struct MyBot {
 			return;
 		}
 
-		// Prepare animation data
-		animationObjects = prepareAnimation(model);
-
-		// Just take the first skin/skeleton model
+		// Just take the first skin/skeleton model, starting at its root joint
 		const tinygltf::Skin &skin = model.skins[0];
+		std::vector<int> roots(1, findSkinRoot(model, skin));
+		hierarchy = buildSkeletonHierarchy(model, roots);
 
-		std::vector<glm::mat4> localNodeTransforms(skin.joints.size());
-
-		glm::mat4 parentTransform(1.0f);
-		std::vector<glm::mat4> globalNodeTransforms(skin.joints.size());
-
-        // Compute local transforms at each node
-		for(int i=0;i<skin.joints.size();i++){
-			int rootNodeIndex = skin.joints[i];
-			computeLocalNodeTransform(model, i, localNodeTransforms);
+		// Compile animation data into flat tracks
+		for (const auto &anim : model.animations) {
+			animationClips.push_back(compileAnimation(model, anim, hierarchy));
 		}
 
-		// Compute global transforms at each node
-		computeGlobalNodeTransform(model, localNodeTransforms, 24, parentTransform, globalNodeTransforms);
-		globalTransforms = globalNodeTransforms;
-
+		// A single skeleton in the rest pose until the crowd is resized
+		setCrowdSize(1);
 
         skeleton.initialize();
 	}
 
 	void render(glm::mat4 cameraMatrix) {
-
-        const tinygltf::Skin &skin = model.skins[0];
-        skeleton.renderSkeleton(model, skin, globalTransforms, cameraMatrix);
-
+		skeleton.clear();
+		for (size_t i = 0; i < instanceObjects.size(); ++i) {
+			skeleton.addSkeleton(hierarchy, instanceObjects[i].globalTransforms, instanceObjects[i].modelMatrix);
+		}
+		skeleton.render(cameraMatrix);
 	}
 
 	void cleanup() {
-
+		skeleton.cleanup();
 	}
 };
 
@@ -621,6 +437,7 @@ int main(void)
 	static double lastTime = glfwGetTime();
 	float time = 0.0f;			// Animation time
 	float fTime = 0.0f;			// Time for measuring fps
+	double cpuTime = 0.0;		// Time spent updating and drawing the skeletons
 	unsigned long frames = 0;
 
 	// Main loop
@@ -633,6 +450,12 @@ int main(void)
         float deltaTime = float(currentTime - lastTime);
 		lastTime = currentTime;
 
+		if ((int)bot.instanceObjects.size() != crowdSize) {
+			bot.setCrowdSize(crowdSize);
+		}
+
+		double cpuStart = glfwGetTime();
+
 		if (playAnimation) {
 			time += deltaTime * playbackSpeed;
 			bot.update(time);
@@ -643,17 +466,22 @@ int main(void)
 		glm::mat4 vp = projectionMatrix * viewMatrix;
 		bot.render(vp);
 
+		cpuTime += glfwGetTime() - cpuStart;
+
 		// FPS tracking
 		// Count number of frames over a few seconds and take average
 		frames++;
 		fTime += deltaTime;
 		if (fTime > 2.0f) {
 			float fps = frames / fTime;
+			double cpuMs = cpuTime * 1000.0 / frames;
 			frames = 0;
 			fTime = 0;
+			cpuTime = 0;
 
 			std::stringstream stream;
-			stream << std::fixed << std::setprecision(2) << "Lab 4 | Frames per second (FPS): " << fps;
+			stream << std::fixed << std::setprecision(2) << "Lab 4 | Frames per second (FPS): " << fps
+				<< " | Skeletons: " << bot.instanceObjects.size() << " | CPU: " << cpuMs << " ms";
 			glfwSetWindowTitle(window, stream.str().c_str());
 		}
 
@@ -690,6 +518,14 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 		}
 	}
 
+	if ((key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) && action == GLFW_PRESS) {
+		crowdSize = std::min(crowdSize * 10, maxCrowdSize);
+	}
+
+	if ((key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) && action == GLFW_PRESS) {
+		crowdSize = std::max(crowdSize / 10, 1);
+	}
+
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
 		playAnimation = !playAnimation;
 	}
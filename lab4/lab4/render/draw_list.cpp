@@ -0,0 +1,30 @@
+#include "draw_list.h"
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+void DrawList::add(GLuint vao, GLenum mode, GLsizei count, GLenum indexType, size_t offset, GLint baseVertex)
+{
+	DrawCommand command;
+	command.vao = vao;
+	command.mode = mode;
+	command.count = count;
+	command.indexType = indexType;
+	command.offset = offset;
+	command.baseVertex = baseVertex;
+	commands.push_back(command);
+}
+
+void DrawList::submit(GLsizei instanceCount) const
+{
+	GLuint boundVAO = 0;
+	for (size_t i = 0; i < commands.size(); ++i) {
+		const DrawCommand &command = commands[i];
+		if (command.vao != boundVAO) {
+			glBindVertexArray(command.vao);
+			boundVAO = command.vao;
+		}
+		glDrawElementsInstancedBaseVertex(command.mode, command.count, command.indexType,
+			BUFFER_OFFSET(command.offset), instanceCount, command.baseVertex);
+	}
+	glBindVertexArray(0);
+}
@@ -0,0 +1,30 @@
+#ifndef _DRAW_LIST_H_
+#define _DRAW_LIST_H_
+
+#include <glad/gl.h>
+#include <stddef.h>
+#include <vector>
+
+// Everything one instanced draw call needs, resolved at load time
+struct DrawCommand {
+	GLuint vao;
+	GLenum mode;
+	GLsizei count;
+	GLenum indexType;
+	size_t offset;				// In bytes, within the VAO's index buffer
+	GLint baseVertex;
+};
+
+// A model flattened into draw commands once, after its buffers are
+// uploaded. Submitting replays the array without allocating or touching
+// the glTF data, and binds a VAO only when it changes between commands.
+struct DrawList {
+	std::vector<DrawCommand> commands;
+
+	void add(GLuint vao, GLenum mode, GLsizei count, GLenum indexType, size_t offset, GLint baseVertex);
+
+	// Draw every command for instanceCount instances
+	void submit(GLsizei instanceCount) const;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "frustum.h"
+
+void Frustum::extract(const glm::mat4 &m)
+{
+	// Rows of the matrix, glm stores columns
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	planes[0] = row3 + row0;	// Left
+	planes[1] = row3 - row0;	// Right
+	planes[2] = row3 + row1;	// Bottom
+	planes[3] = row3 - row1;	// Top
+	planes[4] = row3 + row2;	// Near
+	planes[5] = row3 - row2;	// Far
+
+	for (int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const
+{
+	for (int i = 0; i < 6; ++i) {
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,16 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+// View frustum planes extracted from a view-projection matrix, for culling
+// bounding spheres. Planes point inwards and are normalized.
+struct Frustum {
+	glm::vec4 planes[6];
+
+	void extract(const glm::mat4 &viewProjection);
+
+	bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
+
+#endif
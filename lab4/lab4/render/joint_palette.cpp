@@ -0,0 +1,84 @@
+#include "joint_palette.h"
+
+#include <algorithm>
+#include <iostream>
+
+void JointPaletteBuffer::initialize(size_t initialCapacity)
+{
+	GLint maxTextureBufferSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+	maxTexels = (size_t)maxTextureBufferSize;
+	initialCapacity = std::min(initialCapacity, maxTexels);
+
+	glGenBuffers(RING_SIZE, buffers);
+	glGenTextures(RING_SIZE, textures);
+
+	for (int i = 0; i < RING_SIZE; ++i) {
+		capacities[i] = initialCapacity;
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, initialCapacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	current = 0;
+	texels.reserve(initialCapacity);
+}
+
+void JointPaletteBuffer::clear()
+{
+	texels.clear();
+}
+
+int JointPaletteBuffer::add(const std::vector<glm::vec4> &palette)
+{
+	int offset = (int)texels.size();
+	texels.insert(texels.end(), palette.begin(), palette.end());
+	return offset;
+}
+
+bool JointPaletteBuffer::upload()
+{
+	current = (current + 1) % RING_SIZE;
+
+	// Texels past the limit would not be addressable by texelFetch
+	size_t count = texels.size();
+	if (count > maxTexels) {
+		std::cerr << "Joint palettes need " << count << " texels, the texture buffer limit is "
+			<< maxTexels << "." << std::endl;
+		count = maxTexels;
+	}
+
+	// Grow geometrically so a growing crowd does not reallocate every frame
+	size_t capacity = capacities[current] > 0 ? capacities[current] : 64;
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	capacity = std::min(capacity, maxTexels);
+	capacities[current] = capacity;
+
+	// Orphan the old storage; the driver hands back fresh memory if the GPU
+	// is still reading from it
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[current]);
+	glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	if (count > 0) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, count * sizeof(glm::vec4), &texels[0][0]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return count == texels.size();
+}
+
+void JointPaletteBuffer::bind(GLenum textureUnit) const
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, textures[current]);
+}
+
+void JointPaletteBuffer::cleanup()
+{
+	glDeleteTextures(RING_SIZE, textures);
+	glDeleteBuffers(RING_SIZE, buffers);
+}
@@ -0,0 +1,46 @@
+#ifndef _JOINT_PALETTE_H_
+#define _JOINT_PALETTE_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Joint palettes of any number of skinned characters, packed back to back
+// into one texture buffer (GL_RGBA32F) and uploaded once per frame. The
+// palettes are already encoded as texels (see encodePalette), so shaders
+// fetch a character's joints starting at the texel offset returned by
+// add(). A small ring of buffers, each orphaned before it is refilled,
+// keeps the CPU from waiting on draws that still read the previous
+// frames' palettes.
+struct JointPaletteBuffer {
+	static const int RING_SIZE = 3;
+
+	GLuint buffers[RING_SIZE];
+	GLuint textures[RING_SIZE];
+	size_t capacities[RING_SIZE];	// In texels
+	size_t maxTexels;				// GL_MAX_TEXTURE_BUFFER_SIZE
+	int current;
+
+	// Palettes gathered for the current frame
+	std::vector<glm::vec4> texels;
+
+	void initialize(size_t initialCapacity);
+
+	// Start gathering palettes for a new frame
+	void clear();
+
+	// Append a palette, returns the index of its first texel
+	int add(const std::vector<glm::vec4> &palette);
+
+	// Upload everything added since clear() into the next buffer of the ring.
+	// Returns false, uploading only the first maxTexels, if there are more
+	// texels than a texture buffer can address.
+	bool upload();
+
+	// Bind the buffer uploaded last to the given texture unit
+	void bind(GLenum textureUnit) const;
+
+	void cleanup();
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "staged_upload.h"
+
+#include <algorithm>
+
+void StagedUpload::addBuffer(GLuint buffer, const void *data, size_t size)
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)size, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Item item = { buffer, 0, 0, static_cast<const unsigned char *>(data), size, 0 };
+	items.push_back(item);
+	totalBytes += size;
+}
+
+void StagedUpload::addTexture(GLuint texture, int width, int height, const float *texels)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	size_t size = (size_t)width * height * 4 * sizeof(float);
+	Item item = { 0, texture, width, reinterpret_cast<const unsigned char *>(texels), size, 0 };
+	items.push_back(item);
+	totalBytes += size;
+}
+
+size_t StagedUpload::update(size_t budget)
+{
+	size_t uploaded = 0;
+	while (next < items.size() && uploaded < budget) {
+		Item &item = items[next];
+		size_t chunk = std::min(item.size - item.uploaded, budget - uploaded);
+
+		if (item.buffer != 0) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, item.buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)item.uploaded, (GLsizeiptr)chunk,
+				item.data + item.uploaded);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		} else {
+			// Whole rows only, and at least one so a row larger than the
+			// budget still goes through
+			size_t rowBytes = (size_t)item.width * 4 * sizeof(float);
+			size_t rows = std::max(chunk / rowBytes, uploaded == 0 ? (size_t)1 : (size_t)0);
+			if (rows == 0) {
+				break;
+			}
+			chunk = std::min(rows * rowBytes, item.size - item.uploaded);
+			glBindTexture(GL_TEXTURE_2D, item.texture);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, (GLint)(item.uploaded / rowBytes), item.width,
+				(GLsizei)(chunk / rowBytes), GL_RGBA, GL_FLOAT, item.data + item.uploaded);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		item.uploaded += chunk;
+		uploaded += chunk;
+		if (item.uploaded == item.size) {
+			next++;
+		}
+	}
+
+	uploadedBytes += uploaded;
+	return uploaded;
+}
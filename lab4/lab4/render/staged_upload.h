@@ -0,0 +1,44 @@
+#ifndef _STAGED_UPLOAD_H_
+#define _STAGED_UPLOAD_H_
+
+#include <glad/gl.h>
+#include <stddef.h>
+#include <vector>
+
+// Fills GL buffers and textures from CPU memory over several frames, so a
+// large asset does not stall the frame it finishes loading in. Storage is
+// allocated when an upload is queued; update() then copies at most a byte
+// budget per call. The source memory must stay valid until done().
+struct StagedUpload {
+	struct Item {
+		GLuint buffer;				// Either a buffer
+		GLuint texture;				// or a GL_RGBA32F 2D texture, filled by rows
+		int width;
+		const unsigned char *data;
+		size_t size;
+		size_t uploaded;
+	};
+	std::vector<Item> items;
+	size_t next;					// First unfinished item
+	size_t totalBytes;
+	size_t uploadedBytes;
+
+	StagedUpload() : next(0), totalBytes(0), uploadedBytes(0) {}
+
+	// Queue the contents of a buffer. It is bound to GL_COPY_WRITE_BUFFER
+	// for the copies, which leaves the VAO and array buffer bindings alone.
+	void addBuffer(GLuint buffer, const void *data, size_t size);
+
+	// Queue the level 0 image of a texture of RGBA floats
+	void addTexture(GLuint texture, int width, int height, const float *texels);
+
+	// Upload up to budget bytes, at least one texture row. Returns the bytes
+	// uploaded.
+	size_t update(size_t budget);
+
+	bool done() const {
+		return next == items.size();
+	}
+};
+
+#endif
@@ -4,6 +4,12 @@
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec2 vertexUV;
+layout(location = 3) in vec4 vertexJoints;
+layout(location = 4) in vec4 vertexWeights;
+
+// Per instance placement, only used with dual quaternions; the matrix
+// palettes include it already
+layout(location = 5) in mat4 instanceModel;
 
 // Output data, to be interpolated for each fragment
 out vec3 worldPosition;
@@ -11,11 +17,126 @@ out vec3 worldNormal;
 
 uniform mat4 MVP;
 
+// Joint palettes of all characters as RGBA32F texels
+uniform samplerBuffer jointPalette;
+// Index of the first instance's first texel in the palette. The palettes
+// of the following instances come right after it.
+uniform int paletteOffset;
+uniform int jointCount;
+
+// 0: mat4, four texels by column
+// 1: mat3x4, three texels holding the rows of the affine part
+// 2: dual quaternion, real then dual part, in skin space
+uniform int paletteEncoding;
+
+// Maps skin space, where the dual quaternion joints are rigid, to model space
+uniform mat4 skinSpace;
+uniform mat4 skinSpaceInverse;
+
+// Normals packed with PACK_QUANTIZE arrive octahedral encoded in xy
+uniform bool octNormals;
+
+vec3 objectNormal() {
+    if (!octNormals) {
+        return vertexNormal;
+    }
+    vec3 n = vec3(vertexNormal.xy, 1.0 - abs(vertexNormal.x) - abs(vertexNormal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Cofactor of the upper 3x3, the inverse transpose up to scale: the bot's
+// skin has non-uniform scale, so mat3(m) alone would skew the normals
+mat3 normalMatrix(mat3 m) {
+    return mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+}
+
+int jointTexel(float joint, int texelsPerJoint) {
+    return paletteOffset + (gl_InstanceID * jointCount + int(joint)) * texelsPerJoint;
+}
+
+mat4 jointMatrix(float joint) {
+    if (paletteEncoding == 1) {
+        int base = jointTexel(joint, 3);
+        return transpose(mat4(texelFetch(jointPalette, base),
+                              texelFetch(jointPalette, base + 1),
+                              texelFetch(jointPalette, base + 2),
+                              vec4(0.0, 0.0, 0.0, 1.0)));
+    }
+
+    int base = jointTexel(joint, 4);
+    return mat4(texelFetch(jointPalette, base),
+                texelFetch(jointPalette, base + 1),
+                texelFetch(jointPalette, base + 2),
+                texelFetch(jointPalette, base + 3));
+}
+
+// Linear blend skinning, the joint matrices include the instance placement
+void skinLinear(out vec4 skinnedPosition, out vec3 skinnedNormal) {
+    mat4 skinMatrix =
+        vertexWeights.x * jointMatrix(vertexJoints.x) +
+        vertexWeights.y * jointMatrix(vertexJoints.y) +
+        vertexWeights.z * jointMatrix(vertexJoints.z) +
+        vertexWeights.w * jointMatrix(vertexJoints.w);
+
+    skinnedPosition = skinMatrix * vec4(vertexPosition, 1.0);
+    skinnedNormal = normalMatrix(mat3(skinMatrix)) * objectNormal();
+}
+
+void addDualQuaternion(float joint, float weight, vec4 real0, inout vec4 real, inout vec4 dual) {
+    int base = jointTexel(joint, 2);
+    vec4 r = texelFetch(jointPalette, base);
+
+    // Stay in the hemisphere of the first joint
+    weight = dot(real0, r) < 0.0 ? -weight : weight;
+    real += weight * r;
+    dual += weight * texelFetch(jointPalette, base + 1);
+}
+
+// Dual quaternion blend skinning, which keeps volume around twisting joints
+void skinDualQuaternion(out vec4 skinnedPosition, out vec3 skinnedNormal) {
+    vec4 real0 = texelFetch(jointPalette, jointTexel(vertexJoints.x, 2));
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    addDualQuaternion(vertexJoints.x, vertexWeights.x, real0, real, dual);
+    addDualQuaternion(vertexJoints.y, vertexWeights.y, real0, real, dual);
+    addDualQuaternion(vertexJoints.z, vertexWeights.z, real0, real, dual);
+    addDualQuaternion(vertexJoints.w, vertexWeights.w, real0, real, dual);
+
+    float len = length(real);
+    real /= len;
+    dual /= len;
+
+    // The joints are rigid only in skin space, which is scaled non-uniformly
+    // for the bot, so normals go in and out with the inverse transposes.
+    // Normals still differ from skinLinear by up to ~12 degrees on the bot
+    // where two joints blend, since rotations blend rather than matrices.
+    vec3 p = (skinSpaceInverse * vec4(vertexPosition, 1.0)).xyz;
+    vec3 n = transpose(mat3(skinSpace)) * objectNormal();
+
+    p += 2.0 * cross(real.xyz, cross(real.xyz, p) + real.w * p) +
+         2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+    n += 2.0 * cross(real.xyz, cross(real.xyz, n) + real.w * n);
+
+    skinnedPosition = instanceModel * (skinSpace * vec4(p, 1.0));
+    skinnedNormal = mat3(instanceModel) * (transpose(mat3(skinSpaceInverse)) * n);
+}
+
 void main() {
+    vec4 skinnedPosition;
+    vec3 skinnedNormal;
+    if (paletteEncoding == 2) {
+        skinDualQuaternion(skinnedPosition, skinnedNormal);
+    } else {
+        skinLinear(skinnedPosition, skinnedNormal);
+    }
+
     // Transform vertex
-    gl_Position =  MVP * vec4(vertexPosition, 1.0);
+    gl_Position =  MVP * skinnedPosition;
 
-    // World-space geometry 
-    worldPosition = vertexPosition;
-    worldNormal = vertexNormal;
+    // World-space geometry
+    worldPosition = skinnedPosition.xyz;
+    worldNormal = normalize(skinnedNormal);
 }
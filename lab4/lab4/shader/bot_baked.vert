@@ -0,0 +1,79 @@
+#version 330 core
+
+// Input
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexUV;
+layout(location = 3) in vec4 vertexJoints;
+layout(location = 4) in vec4 vertexWeights;
+
+// Per instance: placement, then animation start time and speed
+layout(location = 5) in mat4 instanceModel;
+layout(location = 9) in vec2 instanceClock;
+
+// Output data, to be interpolated for each fragment
+out vec3 worldPosition;
+out vec3 worldNormal;
+
+uniform mat4 MVP;
+
+// Baked joint matrices, one row per frame and four RGBA32F texels per joint.
+// The last row repeats the first one.
+uniform sampler2D bakedPoses;
+uniform float frameRate;
+uniform int frameCount;
+
+// Playback time shared by all instances
+uniform float time;
+
+// Normals packed with PACK_QUANTIZE arrive octahedral encoded in xy
+uniform bool octNormals;
+
+vec3 objectNormal() {
+    if (!octNormals) {
+        return vertexNormal;
+    }
+    vec3 n = vec3(vertexNormal.xy, 1.0 - abs(vertexNormal.x) - abs(vertexNormal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Inverse transpose up to scale, as in bot.vert
+mat3 normalMatrix(mat3 m) {
+    return mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+}
+
+mat4 jointMatrix(int frame, float joint) {
+    int base = int(joint) * 4;
+    return mat4(texelFetch(bakedPoses, ivec2(base, frame), 0),
+                texelFetch(bakedPoses, ivec2(base + 1, frame), 0),
+                texelFetch(bakedPoses, ivec2(base + 2, frame), 0),
+                texelFetch(bakedPoses, ivec2(base + 3, frame), 0));
+}
+
+mat4 skinMatrix(int frame) {
+    return vertexWeights.x * jointMatrix(frame, vertexJoints.x) +
+           vertexWeights.y * jointMatrix(frame, vertexJoints.y) +
+           vertexWeights.z * jointMatrix(frame, vertexJoints.z) +
+           vertexWeights.w * jointMatrix(frame, vertexJoints.w);
+}
+
+void main() {
+    // Find the two baked frames around this instance's time
+    float frame = mod((instanceClock.x + instanceClock.y * time) * frameRate, float(frameCount - 1));
+    int frame0 = int(frame);
+
+    // Blend the neighbouring poses, then place the instance
+    mat4 skin = instanceModel * mix(skinMatrix(frame0), skinMatrix(frame0 + 1), fract(frame));
+
+    vec4 skinnedPosition = skin * vec4(vertexPosition, 1.0);
+
+    // Transform vertex
+    gl_Position =  MVP * skinnedPosition;
+
+    // World-space geometry
+    worldPosition = skinnedPosition.xyz;
+    worldNormal = normalize(normalMatrix(mat3(skin)) * objectNormal());
+}
@@ -0,0 +1,64 @@
+// Bakes the first animation of a glTF model into joint matrices sampled at
+// a fixed rate and writes them next to the model, e.g. bot.gltf -> bot.bake.
+// lab4_character loads that file for baked playback and bakes it itself
+// when it is missing.
+//
+// Usage: lab4_bake [model.gltf] [frames per second]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <animation/animation.h>
+#include <animation/skinning.h>
+#include <animation/bake.h>
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "../lab4/model/bot/bot.gltf";
+	float frameRate = argc > 2 ? (float)atof(argv[2]) : 30.0f;
+	if (frameRate <= 0.0f) {
+		std::cerr << "Frame rate must be positive." << std::endl;
+		return 1;
+	}
+
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+	if (model.skins.empty() || model.animations.empty()) {
+		std::cerr << "Model has no skin or no animation." << std::endl;
+		return 1;
+	}
+
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	AnimationClip clip = compileAnimation(model, model.animations[0], hierarchy);
+	std::vector<glm::mat4> inverseBindMatrices = loadInverseBindMatrices(model, model.skins[0]);
+
+	BakedAnimation baked = bakeAnimation(clip, hierarchy, 0, inverseBindMatrices, frameRate);
+
+	// Same name as the model with the extension replaced
+	std::string output = filename;
+	size_t dot = output.find_last_of('.');
+	if (dot != std::string::npos) {
+		output = output.substr(0, dot);
+	}
+	output += ".bake";
+
+	if (!saveBakedAnimation(output.c_str(), baked)) {
+		return 1;
+	}
+
+	std::cout << "Baked " << baked.frameCount << " frames x " << baked.jointCount << " joints at "
+		<< baked.frameRate << " fps (" << baked.matrices.size() * sizeof(glm::mat4) / 1024 << " KB) to "
+		<< output << std::endl;
+	return 0;
+}
@@ -0,0 +1,143 @@
+// Cooks a skinned glTF model into the binary format read by lab4_character
+// and writes it next to the model, e.g. bot.gltf -> bot.cooked. The cooked
+// file is then loaded back and both load times are reported, along with
+// the effect of the mesh optimization on vertex cache misses and size.
+// --raw cooks the mesh as exported, without optimization, quantization or
+// levels of detail.
+//
+// Usage: lab4_cook [model.gltf] [--raw]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <asset/cooked_model.h>
+#include <asset/mesh_optimizer.h>
+#include <animation/skinning.h>
+
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string.h>
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filename = "../lab4/model/bot/bot.gltf";
+	int packingFlags = PACK_OPTIMIZE | PACK_QUANTIZE | PACK_LODS;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--raw") == 0) {
+			packingFlags = 0;
+		} else {
+			filename = argv[i];
+		}
+	}
+
+	// Time the same work lab4_character does on the glTF path
+	auto start = std::chrono::high_resolution_clock::now();
+	tinygltf::Model model;
+	tinygltf::TinyGLTF loader;
+	std::string err, warn;
+	if (!loader.LoadASCIIFromFile(&model, &err, &warn, filename)) {
+		std::cerr << "Failed to load glTF: " << filename << " " << err << std::endl;
+		return 1;
+	}
+	SkeletonHierarchy hierarchy = buildSkeletonHierarchy(model);
+	for (size_t i = 0; i < model.animations.size(); ++i) {
+		compileAnimation(model, model.animations[i], hierarchy);
+	}
+	for (size_t i = 0; i < model.skins.size(); ++i) {
+		loadInverseBindMatrices(model, model.skins[i]);
+	}
+	PackedMesh mesh = packModelMeshes(model, packingFlags);
+	double gltfMs = elapsedMs(start);
+
+	// Same name as the model with the extension replaced
+	std::string output = filename;
+	size_t dot = output.find_last_of('.');
+	if (dot != std::string::npos) {
+		output = output.substr(0, dot);
+	}
+	output += ".cooked";
+
+	if (!cookModel(model, output.c_str(), packingFlags)) {
+		return 1;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	CookedModel cooked;
+	if (!loadCookedModel(output.c_str(), cooked)) {
+		return 1;
+	}
+
+	// Touch every page of the blobs, as the GL upload would
+	unsigned checksum = 0;
+	const CookedBlob *blobs[2] = { &cooked.vertices, &cooked.indices };
+	for (int i = 0; i < 2; ++i) {
+		const unsigned char *data = cooked.data + blobs[i]->offset;
+		for (size_t b = 0; b < blobs[i]->size; b += 4096) {
+			checksum += data[b];
+		}
+	}
+	double cookedMs = elapsedMs(start);
+
+	std::cout << "Cooked " << cooked.primitives.size() << " primitives, " << cooked.vertexCount
+		<< " vertices of " << cooked.vertexStride << " bytes, " << cooked.hierarchy.nodes.size() << " joints, " << cooked.animationClips.size()
+		<< " clips into " << output << " (" << cooked.size / 1024 << " KB)" << std::endl;
+	std::cout << "Load time: glTF " << gltfMs << " ms, cooked " << cookedMs << " ms"
+		<< " (checksum " << checksum << ")" << std::endl;
+
+	// Post-transform cache misses and vertex size against the mesh as exported
+	PackedMesh raw = packingFlags != 0 ? packModelMeshes(model) : mesh;
+	std::cout << std::fixed << std::setprecision(3);
+	size_t primitiveCount = raw.primitives.size();
+	for (size_t i = 0; i < primitiveCount; ++i) {
+		const PackedPrimitive &before = raw.primitives[i];
+		const PackedPrimitive &after = mesh.primitives[i];
+		int beforeVertices = (i + 1 < primitiveCount ? raw.primitives[i + 1].baseVertex : raw.vertexCount) - before.baseVertex;
+		int afterVertices = (i + 1 < primitiveCount ? mesh.primitives[i + 1].baseVertex : mesh.vertexCount) - after.baseVertex;
+		std::cout << "Primitive " << i << ": " << after.indexCount / 3 << " triangles, ACMR "
+			<< computeACMR(unpackIndices(raw, before), beforeVertices) << " -> "
+			<< computeACMR(unpackIndices(mesh, after), afterVertices) << ", "
+			<< beforeVertices << " -> " << afterVertices << " vertices" << std::endl;
+	}
+	std::cout << "Bytes per vertex: " << raw.vertexStride << " -> " << mesh.vertexStride << std::endl;
+
+	// Levels of detail, all drawing from the vertices of the full mesh
+	for (size_t l = 0; l < mesh.lods.size(); ++l) {
+		size_t triangles = 0;
+		std::vector<unsigned char> used(mesh.vertexCount, 0);
+		for (size_t i = 0; i < primitiveCount; ++i) {
+			const PackedPrimitive &primitive = mesh.primitives[mesh.lods[l].firstPrimitive + i];
+			std::vector<uint32_t> indices = unpackIndices(mesh, primitive);
+			for (size_t k = 0; k < indices.size(); ++k) {
+				used[primitive.baseVertex + indices[k]] = 1;
+			}
+			triangles += indices.size() / 3;
+		}
+		size_t vertices = std::count(used.begin(), used.end(), 1);
+		std::cout << "LOD " << l << ": " << triangles << " triangles, " << vertices
+			<< " vertices, error " << std::setprecision(2) << mesh.lods[l].error << std::endl;
+	}
+	std::cout << std::setprecision(3);
+
+	// GPU memory of the packed mesh against the glTF buffer views it replaces
+	size_t sourceBytes = 0;
+	for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+		if (model.bufferViews[i].target != 0) {
+			sourceBytes += model.bufferViews[i].byteLength;
+		}
+	}
+	std::cout << "Mesh data: " << (mesh.vertices.size() + mesh.indices.size()) / 1024 << " KB packed, "
+		<< sourceBytes / 1024 << " KB in glTF buffer views" << std::endl;
+
+	unloadCookedModel(cooked);
+	return 0;
+}